@@ -0,0 +1,239 @@
+#include "ProjectGenerator.h"
+#include "ClosureComputation.h"
+#include "GraphPatching.h"
+#include "RelationGraphBuilder.h"
+#include "RelationIndex.h"
+#include "SymbolLocating.h"
+#include "SymbolsListing.h"
+#include "clang/Tooling/JSONCompilationDatabase.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#ifdef LLVM_ON_UNIX
+#include <sys/resource.h>
+#endif
+
+using namespace clang;
+
+//===----------------------------------------------------------------------===//
+// Command line options
+//===----------------------------------------------------------------------===//
+
+static llvm::cl::OptionCategory BenchCategory("ClangClosureBench options");
+
+static llvm::cl::opt<unsigned> TUsCount("tus",
+  llvm::cl::desc("Number of TUs"),
+  llvm::cl::init(100),
+  llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<unsigned> HeadersPerLevel("headers",
+  llvm::cl::desc("Number of headers on each level of inclusion"),
+  llvm::cl::init(20),
+  llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<unsigned> IncludeDepth("depth",
+  llvm::cl::desc("Number of levels of headers"),
+  llvm::cl::init(4),
+  llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<unsigned> HeaderFanOut("fan-out",
+  llvm::cl::desc("Headers included by each file"),
+  llvm::cl::init(4),
+  llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<unsigned> FunctionsPerFile("functions",
+  llvm::cl::desc("Functions defined in each file"),
+  llvm::cl::init(10),
+  llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<unsigned> ReferencesPerFunction("references",
+  llvm::cl::desc("Calls each function makes to functions of other files"),
+  llvm::cl::init(3),
+  llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<bool> IsCXX("cxx",
+  llvm::cl::desc("Generate C++ instead of C"),
+  llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<unsigned> Seed("seed",
+  llvm::cl::desc("Seed of the generator"),
+  llvm::cl::init(1),
+  llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<unsigned> Jobs("j",
+  llvm::cl::desc("Number of TUs parsed in parallel by relation construction"),
+  llvm::cl::init(1),
+  llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<std::string> ProjectDirectory("project-dir",
+  llvm::cl::desc("Directory to generate the project into; a temporary one "
+    "by default"),
+  llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<bool> GenerateOnly("generate-only",
+  llvm::cl::desc("Generate the project without running the benchmarks"),
+  llvm::cl::cat(BenchCategory));
+
+//===----------------------------------------------------------------------===//
+// Measuring
+//===----------------------------------------------------------------------===//
+
+// Peak resident set size of the process in KiB, or 0 if unknown.
+static long GetPeakMemory() {
+#ifdef LLVM_ON_UNIX
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+  }
+#endif
+  return 0;
+}
+
+// Times a phase and prints one line about it when destroyed.
+class PhaseTimer {
+public:
+  PhaseTimer(StringRef name, size_t tusCount)
+    : mName(name), mTUsCount(tusCount),
+    mStart(std::chrono::steady_clock::now()) {}
+
+  ~PhaseTimer() {
+    std::chrono::duration<double> wall
+      = std::chrono::steady_clock::now() - mStart;
+    llvm::outs() << llvm::format("%-24s %10.3f s", mName.c_str(),
+      wall.count());
+    if (mTUsCount != 0) {
+      llvm::outs() << llvm::format(" %10.1f TUs/s",
+        mTUsCount / wall.count());
+    }
+    llvm::outs() << llvm::format(" %10ld KiB peak\n", GetPeakMemory());
+  }
+
+private:
+  std::string mName;
+  size_t mTUsCount;
+  std::chrono::steady_clock::time_point mStart;
+};
+
+//===----------------------------------------------------------------------===//
+// Main
+//===----------------------------------------------------------------------===//
+
+int main(int argc, const char **argv) {
+  llvm::cl::HideUnrelatedOptions(BenchCategory);
+  llvm::cl::ParseCommandLineOptions(argc, argv,
+    "Times clang-closure on a synthetic project\n");
+
+  llvm::SmallString<128> directory(ProjectDirectory);
+  if (directory.empty()
+    && llvm::sys::fs::createUniqueDirectory("clang-closure-bench",
+    directory)) {
+    llvm::errs() << "Can not create a project directory.\n";
+    return 1;
+  }
+
+  closure::ProjectOptions options;
+  options.TUsCount = TUsCount;
+  options.HeadersPerLevel = HeadersPerLevel;
+  options.IncludeDepth = IncludeDepth;
+  options.HeaderFanOut = HeaderFanOut;
+  options.FunctionsPerFile = FunctionsPerFile;
+  options.ReferencesPerFunction = ReferencesPerFunction;
+  options.IsCXX = IsCXX;
+  options.Seed = Seed;
+
+  std::vector<std::string> sources;
+  {
+    PhaseTimer timer("generation", 0);
+    if (!closure::GenerateProject(directory, options, sources)) {
+      llvm::errs() << "Can not generate the project.\n";
+      return 1;
+    }
+  }
+  llvm::outs() << "Project: " << directory << "\n";
+  if (GenerateOnly)
+    return 0;
+
+  std::string error;
+  std::unique_ptr<tooling::CompilationDatabase> compilations
+    = tooling::JSONCompilationDatabase::loadFromDirectory(directory, error);
+  if (!compilations) {
+    llvm::errs() << error << "\n";
+    return 1;
+  }
+
+  int r = 0;
+  {
+    PhaseTimer timer("symbols listing", sources.size());
+    for (const std::string &source : sources) {
+      closure::SymbolsList symbols;
+      if (!closure::RunFrontendActionOnFile(*compilations, source, [&]() {
+        return new closure::SymbolsListingAction(symbols);
+      }))
+        r = 1;
+    }
+  }
+
+  {
+    PhaseTimer timer("symbol locating", sources.size());
+    for (const std::string &source : sources) {
+      std::string signature;
+      if (!closure::RunFrontendActionOnFile(*compilations, source, [&]() {
+        return new closure::SymbolLocatingAction(signature, 0);
+      }))
+        r = 1;
+    }
+  }
+
+  closure::RelationGraph graph;
+  {
+    PhaseTimer timer("relation construction", sources.size());
+    closure::RelationGraphBuilder builder(*compilations, Jobs);
+    if (!builder.build(sources, graph))
+      r = 1;
+  }
+
+  // A save of one source patches the graph, and the index is made again
+  // from all of it.
+  if (!sources.empty()) {
+    closure::RelationGraphBuilder builder(*compilations, Jobs);
+    closure::PatchableGraph patchable(sources);
+    if (!patchable.build(builder))
+      r = 1;
+    std::vector<std::string> affected;
+    {
+      PhaseTimer timer("graph patching", 1);
+      if (!patchable.update(builder, std::vector<std::string>(1, sources[0]),
+        affected))
+        r = 1;
+    }
+    {
+      PhaseTimer timer("patched index rebuild", 0);
+      closure::RelationIndex index(patchable.getGraph());
+    }
+  }
+
+  {
+    PhaseTimer timer("closure computation", 0);
+    closure::RelationIndex index(graph);
+    closure::ClosureEngine engine(index);
+    std::vector<closure::FileIndexType> files;
+    for (closure::SymbolIndexType i = 0, count = index.getSymbolsCount();
+      i != count;
+      ++i) {
+      files.clear();
+      engine.getFiles(i, files);
+    }
+  }
+  return r;
+}
@@ -0,0 +1,246 @@
+#include "ProjectGenerator.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+
+namespace clang {
+namespace closure {
+
+namespace {
+
+// SplitMix64. Unlike the distributions of <random>, its output is the same
+// with every standard library, and so are the projects.
+class Random {
+public:
+  explicit Random(uint64_t seed) : mState(seed) {}
+
+  // Returns a number in [0, bound).
+  unsigned next(unsigned bound) {
+    uint64_t z = (mState += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    return static_cast<unsigned>(z % bound);
+  }
+
+  // Returns count distinct numbers in [0, bound), or all of them if there
+  // are fewer.
+  std::vector<unsigned> choose(unsigned count, unsigned bound) {
+    std::vector<unsigned> r(bound);
+    for (unsigned i = 0; i != bound; ++i)
+      r[i] = i;
+    count = std::min(count, bound);
+    for (unsigned i = 0; i != count; ++i)
+      std::swap(r[i], r[i + next(bound - i)]);
+    r.resize(count);
+    std::sort(r.begin(), r.end());
+    return r;
+  }
+
+private:
+  uint64_t mState;
+};
+
+class Generator {
+public:
+  Generator(StringRef directory, const ProjectOptions &options)
+    : mDirectory(directory), mOptions(options), mRandom(options.Seed) {}
+
+  bool run(std::vector<std::string> &sources);
+
+private:
+  static std::string getHeaderName(unsigned level, unsigned header) {
+    return ("h" + llvm::Twine(level) + "_" + llvm::Twine(header)).str();
+  }
+
+  static std::string getTUName(unsigned tu) {
+    return ("tu" + llvm::Twine(tu)).str();
+  }
+
+  // Writes the includes of a file whose inclusions are chosen from level,
+  // and appends the functions they provide to callees.
+  void writeInclusions(llvm::raw_ostream &os,
+    unsigned level,
+    std::vector<std::string> &callees);
+
+  // Writes the definition of function, which calls functions of callees.
+  void writeFunction(llvm::raw_ostream &os,
+    StringRef prefix,
+    StringRef function,
+    ArrayRef<std::string> callees);
+
+  bool writeHeader(unsigned level, unsigned header);
+  bool writeTU(unsigned tu, std::string &path);
+  bool writeCompilationDatabase(ArrayRef<std::string> sources);
+
+  std::string mDirectory;
+  const ProjectOptions &mOptions;
+  Random mRandom;
+};
+
+} // end anonymous namespace
+
+static bool OpenFile(StringRef path,
+  std::unique_ptr<llvm::raw_fd_ostream> &os) {
+  std::error_code ec;
+  os.reset(new llvm::raw_fd_ostream(path, ec, llvm::sys::fs::F_Text));
+  return !ec;
+}
+
+void Generator::writeInclusions(llvm::raw_ostream &os,
+  unsigned level,
+  std::vector<std::string> &callees) {
+  if (level >= mOptions.IncludeDepth)
+    return;
+  for (unsigned header
+    : mRandom.choose(mOptions.HeaderFanOut, mOptions.HeadersPerLevel)) {
+    std::string name = getHeaderName(level, header);
+    os << "#include \"" << name << ".h\"\n";
+    for (unsigned i = 0; i != mOptions.FunctionsPerFile; ++i)
+      callees.push_back(name + "_f" + llvm::Twine(i).str());
+  }
+  os << "\n";
+}
+
+void Generator::writeFunction(llvm::raw_ostream &os,
+  StringRef prefix,
+  StringRef function,
+  ArrayRef<std::string> callees) {
+  os << prefix << "int " << function << "(int x) {\n"
+    << "  int r = x;\n";
+  if (!callees.empty()) {
+    for (unsigned i = 0; i != mOptions.ReferencesPerFunction; ++i)
+      os << "  r += " << callees[mRandom.next(callees.size())] << "(r);\n";
+  }
+  os << "  return r;\n"
+    << "}\n\n";
+}
+
+bool Generator::writeHeader(unsigned level, unsigned header) {
+  std::string name = getHeaderName(level, header);
+  llvm::SmallString<256> path(mDirectory);
+  llvm::sys::path::append(path, "include", name + ".h");
+  std::unique_ptr<llvm::raw_fd_ostream> os;
+  if (!OpenFile(path, os))
+    return false;
+
+  std::string guard = llvm::StringRef(name).upper() + "_H";
+  *os << "#ifndef " << guard << "\n"
+    << "#define " << guard << "\n\n";
+  std::vector<std::string> callees;
+  writeInclusions(*os, level + 1, callees);
+  for (unsigned i = 0; i != mOptions.FunctionsPerFile; ++i) {
+    writeFunction(*os, "static inline ",
+      name + "_f" + llvm::Twine(i).str(), callees);
+  }
+  *os << "#endif\n";
+  return true;
+}
+
+bool Generator::writeTU(unsigned tu, std::string &path) {
+  std::string name = getTUName(tu);
+  llvm::SmallString<256> file(mDirectory);
+  llvm::sys::path::append(file, "src",
+    name + (mOptions.IsCXX ? ".cpp" : ".c"));
+  path = file.str().str();
+  std::unique_ptr<llvm::raw_fd_ostream> os;
+  if (!OpenFile(path, os))
+    return false;
+
+  std::vector<std::string> callees;
+  writeInclusions(*os, 0, callees);
+
+  // Functions of other TUs are declared where they are called.
+  if (mOptions.TUsCount > 1 && mOptions.FunctionsPerFile != 0) {
+    for (unsigned i = 0; i != mOptions.FunctionsPerFile; ++i) {
+      unsigned other = mRandom.next(mOptions.TUsCount - 1);
+      if (other >= tu)
+        ++other;
+      std::string callee = getTUName(other) + "_f"
+        + llvm::Twine(mRandom.next(mOptions.FunctionsPerFile)).str();
+      *os << "int " << callee << "(int x);\n";
+      callees.push_back(callee);
+    }
+    *os << "\n";
+  }
+
+  for (unsigned i = 0; i != mOptions.FunctionsPerFile; ++i)
+    writeFunction(*os, "", name + "_f" + llvm::Twine(i).str(), callees);
+  return true;
+}
+
+static void WriteJSONString(llvm::raw_ostream &os, StringRef s) {
+  os << '"';
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      os << '\\';
+    os << c;
+  }
+  os << '"';
+}
+
+bool Generator::writeCompilationDatabase(ArrayRef<std::string> sources) {
+  llvm::SmallString<256> path(mDirectory);
+  llvm::sys::path::append(path, "compile_commands.json");
+  std::unique_ptr<llvm::raw_fd_ostream> os;
+  if (!OpenFile(path, os))
+    return false;
+
+  std::string command = mOptions.IsCXX ? "c++ -std=c++11" : "cc";
+  command += " -c -Iinclude ";
+  *os << "[\n";
+  for (size_t i = 0, count = sources.size(); i != count; ++i) {
+    *os << "  {\"directory\": ";
+    WriteJSONString(*os, mDirectory);
+    *os << ", \"command\": ";
+    WriteJSONString(*os, command + sources[i]);
+    *os << ", \"file\": ";
+    WriteJSONString(*os, sources[i]);
+    *os << "}" << (i + 1 != count ? "," : "") << "\n";
+  }
+  *os << "]\n";
+  return true;
+}
+
+bool Generator::run(std::vector<std::string> &sources) {
+  llvm::SmallString<256> include(mDirectory), src(mDirectory);
+  llvm::sys::path::append(include, "include");
+  llvm::sys::path::append(src, "src");
+  if (llvm::sys::fs::create_directories(include)
+    || llvm::sys::fs::create_directories(src))
+    return false;
+
+  for (unsigned level = 0; level != mOptions.IncludeDepth; ++level) {
+    for (unsigned header = 0; header != mOptions.HeadersPerLevel; ++header) {
+      if (!writeHeader(level, header))
+        return false;
+    }
+  }
+
+  for (unsigned tu = 0; tu != mOptions.TUsCount; ++tu) {
+    std::string path;
+    if (!writeTU(tu, path))
+      return false;
+    sources.push_back(path);
+  }
+  return writeCompilationDatabase(sources);
+}
+
+bool GenerateProject(StringRef directory,
+  const ProjectOptions &options,
+  std::vector<std::string> &sources) {
+  llvm::SmallString<256> absolute(directory);
+  if (llvm::sys::fs::make_absolute(absolute))
+    return false;
+  Generator generator(absolute, options);
+  return generator.run(sources);
+}
+
+} // namespace closure
+} // namespace clang
@@ -0,0 +1,39 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_PROJECT_GENERATOR_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_PROJECT_GENERATOR_H
+
+#include "llvm/ADT/StringRef.h"
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace closure {
+
+// Shape of a synthetic project.
+struct ProjectOptions {
+  unsigned TUsCount = 100;
+  // Headers per level of inclusion.
+  unsigned HeadersPerLevel = 20;
+  // Levels of headers below the TUs.
+  unsigned IncludeDepth = 4;
+  // Headers included by every TU and every header above the last level.
+  unsigned HeaderFanOut = 4;
+  unsigned FunctionsPerFile = 10;
+  // Calls each function makes to functions of other files.
+  unsigned ReferencesPerFunction = 3;
+  bool IsCXX = false;
+  unsigned Seed = 1;
+};
+
+// Writes a synthetic project into directory: headers with inline functions
+// under include/, TUs under src/ and a compile_commands.json. Each TU and
+// header includes headers of the next level down and calls functions of the
+// headers it includes and of other TUs. The same options always produce the
+// same project. Returns the paths of the TUs, or false on write errors.
+bool GenerateProject(StringRef directory,
+  const ProjectOptions &options,
+  std::vector<std::string> &sources);
+
+} // namespace closure
+} // namespace clang
+
+#endif
@@ -0,0 +1,226 @@
+#include "ClosureComputation.h"
+#include <algorithm>
+#include <utility>
+
+namespace clang {
+namespace closure {
+
+CondensedGraph::CondensedGraph(uint32_t nodesCount,
+  llvm::function_ref<ArrayRef<uint32_t>(uint32_t)> successors) {
+  const uint32_t Unvisited = ~0u;
+  std::vector<uint32_t> order(nodesCount, Unvisited);
+  std::vector<uint32_t> lowLinks(nodesCount);
+  std::vector<char> onStack(nodesCount, false);
+  std::vector<uint32_t> stack;
+  // Node and position of the next successor to visit; Tarjan's algorithm
+  // without recursion, since dependency chains can be very deep.
+  std::vector<std::pair<uint32_t, uint32_t>> callStack;
+  uint32_t nextOrder = 0;
+
+  mComponents.resize(nodesCount);
+  mMemberOffsets.push_back(0);
+
+  auto enter = [&](uint32_t node) {
+    order[node] = lowLinks[node] = nextOrder++;
+    stack.push_back(node);
+    onStack[node] = true;
+    callStack.push_back(std::make_pair(node, 0u));
+  };
+
+  for (uint32_t root = 0; root != nodesCount; ++root) {
+    if (order[root] != Unvisited)
+      continue;
+    enter(root);
+
+    while (!callStack.empty()) {
+      uint32_t node = callStack.back().first;
+      ArrayRef<uint32_t> next = successors(node);
+      if (callStack.back().second != next.size()) {
+        uint32_t successor = next[callStack.back().second++];
+        if (successor >= nodesCount)
+          continue;
+        if (order[successor] == Unvisited)
+          enter(successor);
+        else if (onStack[successor])
+          lowLinks[node] = std::min(lowLinks[node], order[successor]);
+        continue;
+      }
+
+      callStack.pop_back();
+      if (!callStack.empty()) {
+        uint32_t parent = callStack.back().first;
+        lowLinks[parent] = std::min(lowLinks[parent], lowLinks[node]);
+      }
+      if (lowLinks[node] != order[node])
+        continue;
+
+      uint32_t component = mMemberOffsets.size() - 1;
+      uint32_t member;
+      do {
+        member = stack.back();
+        stack.pop_back();
+        onStack[member] = false;
+        mComponents[member] = component;
+        mMembers.push_back(member);
+      } while (member != node);
+      mMemberOffsets.push_back(mMembers.size());
+    }
+  }
+
+  mSuccessorOffsets.push_back(0);
+  for (uint32_t component = 0, count = getComponentsCount();
+    component != count;
+    ++component) {
+    size_t first = mSuccessors.size();
+    for (uint32_t member : getMembers(component)) {
+      for (uint32_t successor : successors(member)) {
+        if (successor < nodesCount && mComponents[successor] != component)
+          mSuccessors.push_back(mComponents[successor]);
+      }
+    }
+    std::sort(mSuccessors.begin() + first, mSuccessors.end());
+    mSuccessors.erase(
+      std::unique(mSuccessors.begin() + first, mSuccessors.end()),
+      mSuccessors.end());
+    mSuccessorOffsets.push_back(mSuccessors.size());
+  }
+}
+
+ClosureEngine::ClosureEngine(const RelationIndex &index)
+  : mIndex(index),
+  mFileGraph(index.getFilesCount(),
+    [&index](uint32_t file) { return index.getInclusions(file); }),
+  mSymbolGraph(index.getSymbolsCount(),
+    [&index](uint32_t symbol) { return index.getDependencies(symbol); }) {
+  mInclusionClosures.resize(mFileGraph.getComponentsCount());
+  mInclusionClosureComputed.resize(mFileGraph.getComponentsCount(), false);
+  mSymbolClosures.resize(mSymbolGraph.getComponentsCount());
+  mSymbolClosureComputed.resize(mSymbolGraph.getComponentsCount(), false);
+  mDefinitionClosures.resize(mSymbolGraph.getComponentsCount());
+  mDefinitionClosureComputed.resize(mSymbolGraph.getComponentsCount(), false);
+}
+
+void ClosureEngine::computeClosures(const CondensedGraph &graph,
+  uint32_t component,
+  std::vector<llvm::BitVector> &closures,
+  std::vector<char> &computed,
+  llvm::function_ref<void(uint32_t, llvm::BitVector&)> addMembers) {
+  if (computed[component])
+    return;
+
+  // Collect the components whose closures are missing. Since successors are
+  // numbered lower, computing them in ascending order only ever reads
+  // closures which are already complete.
+  std::vector<uint32_t> pending;
+  std::vector<uint32_t> stack(1, component);
+  computed[component] = true;
+  while (!stack.empty()) {
+    uint32_t c = stack.back();
+    stack.pop_back();
+    pending.push_back(c);
+    for (uint32_t successor : graph.getSuccessors(c)) {
+      if (!computed[successor]) {
+        computed[successor] = true;
+        stack.push_back(successor);
+      }
+    }
+  }
+  std::sort(pending.begin(), pending.end());
+
+  for (uint32_t c : pending) {
+    llvm::BitVector &closure = closures[c];
+    closure.resize(mIndex.getFilesCount());
+    addMembers(c, closure);
+    for (uint32_t successor : graph.getSuccessors(c))
+      closure |= closures[successor];
+  }
+}
+
+const llvm::BitVector &ClosureEngine::getInclusionClosure(
+  uint32_t fileComponent) {
+  computeClosures(mFileGraph, fileComponent,
+    mInclusionClosures, mInclusionClosureComputed,
+    [this](uint32_t component, llvm::BitVector &closure) {
+      for (FileIndexType file : mFileGraph.getMembers(component)) {
+        if (!mIndex.isSystemHeaderInMainFile(file))
+          closure.set(file);
+      }
+    });
+  return mInclusionClosures[fileComponent];
+}
+
+const llvm::BitVector &ClosureEngine::getFileClosure(SymbolIndexType symbol) {
+  uint32_t symbolComponent = mSymbolGraph.getComponent(symbol);
+  computeClosures(mSymbolGraph, symbolComponent,
+    mSymbolClosures, mSymbolClosureComputed,
+    [this](uint32_t component, llvm::BitVector &closure) {
+      for (SymbolIndexType member : mSymbolGraph.getMembers(component)) {
+        FileIndexType file = mIndex.getDefinitionFile(member);
+        if (file != RelationIndex::InvalidIndex)
+          closure |= getInclusionClosure(mFileGraph.getComponent(file));
+      }
+    });
+  return mSymbolClosures[symbolComponent];
+}
+
+const llvm::BitVector &ClosureEngine::getDefinitionClosure(
+  SymbolIndexType symbol) {
+  uint32_t symbolComponent = mSymbolGraph.getComponent(symbol);
+  computeClosures(mSymbolGraph, symbolComponent,
+    mDefinitionClosures, mDefinitionClosureComputed,
+    [this](uint32_t component, llvm::BitVector &closure) {
+      for (SymbolIndexType member : mSymbolGraph.getMembers(component)) {
+        FileIndexType file = mIndex.getDefinitionFile(member);
+        if (file != RelationIndex::InvalidIndex
+          && !mIndex.isSystemHeaderInMainFile(file))
+          closure.set(file);
+      }
+    });
+  return mDefinitionClosures[symbolComponent];
+}
+
+void ClosureEngine::getMinimalFiles(SymbolIndexType symbol,
+  std::vector<FileIndexType> &files) {
+  const llvm::BitVector &definitions = getDefinitionClosure(symbol);
+
+  // Whether each file component includes, possibly through others, a file
+  // which defines something. Successors are numbered lower, so one pass in
+  // ascending order sees them first.
+  size_t componentsCount = mFileGraph.getComponentsCount();
+  std::vector<char> leads(componentsCount, false);
+  for (uint32_t component = 0; component != componentsCount; ++component) {
+    for (FileIndexType file : mFileGraph.getMembers(component)) {
+      if (definitions.test(file)) {
+        leads[component] = true;
+        break;
+      }
+    }
+    for (uint32_t successor : mFileGraph.getSuccessors(component)) {
+      if (leads[successor]) {
+        leads[component] = true;
+        break;
+      }
+    }
+  }
+
+  llvm::BitVector closure(mIndex.getFilesCount());
+  for (int file = definitions.find_first(); file != -1;
+    file = definitions.find_next(file))
+    closure |= getInclusionClosure(mFileGraph.getComponent(file));
+  for (int file = closure.find_first(); file != -1;
+    file = closure.find_next(file)) {
+    if (leads[mFileGraph.getComponent(file)])
+      files.push_back(file);
+  }
+}
+
+void ClosureEngine::getFiles(SymbolIndexType symbol,
+  std::vector<FileIndexType> &files) {
+  const llvm::BitVector &closure = getFileClosure(symbol);
+  for (int file = closure.find_first(); file != -1;
+    file = closure.find_next(file))
+    files.push_back(file);
+}
+
+} // namespace closure
+} // namespace clang
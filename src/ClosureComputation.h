@@ -0,0 +1,101 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_CLOSURE_COMPUTATION_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_CLOSURE_COMPUTATION_H
+
+#include "RelationIndex.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/STLExtras.h"
+#include <cstdint>
+#include <vector>
+
+namespace clang {
+namespace closure {
+
+// Condensation of a directed graph into its strongly connected components.
+// Components are numbered in reverse topological order: the successors of a
+// component always have smaller numbers than the component itself.
+class CondensedGraph {
+public:
+  CondensedGraph(uint32_t nodesCount,
+    llvm::function_ref<ArrayRef<uint32_t>(uint32_t)> successors);
+
+  size_t getComponentsCount() const {
+    return mMemberOffsets.size() - 1;
+  }
+
+  uint32_t getComponent(uint32_t node) const {
+    return mComponents[node];
+  }
+
+  ArrayRef<uint32_t> getMembers(uint32_t component) const {
+    return ArrayRef<uint32_t>(mMembers.data() + mMemberOffsets[component],
+      mMemberOffsets[component + 1] - mMemberOffsets[component]);
+  }
+
+  ArrayRef<uint32_t> getSuccessors(uint32_t component) const {
+    return ArrayRef<uint32_t>(
+      mSuccessors.data() + mSuccessorOffsets[component],
+      mSuccessorOffsets[component + 1] - mSuccessorOffsets[component]);
+  }
+
+private:
+  std::vector<uint32_t> mComponents;
+  std::vector<uint32_t> mMemberOffsets;
+  std::vector<uint32_t> mMembers;
+  std::vector<uint32_t> mSuccessorOffsets;
+  std::vector<uint32_t> mSuccessors;
+};
+
+// Answers closure queries over a RelationIndex. The closure of a symbol is
+// the set of files which define the symbol or anything it depends on, plus
+// every file those include; system headers are left out.
+//
+// The minimal closure of a symbol keeps, of those files, the ones which
+// define the symbol or anything it depends on, and the headers through which
+// they include one of these. Headers which lead to no such definition are
+// left out. It is only as minimal as the dependencies are precise, that is
+// when relations were built with the types, typedefs and macros symbols use.
+//
+// Closures are computed per strongly connected component and memoized, so a
+// batch of queries shares the work for everything their closures have in
+// common.
+class ClosureEngine {
+public:
+  explicit ClosureEngine(const RelationIndex &index);
+
+  const llvm::BitVector &getFileClosure(SymbolIndexType symbol);
+
+  void getFiles(SymbolIndexType symbol, std::vector<FileIndexType> &files);
+
+  void getMinimalFiles(SymbolIndexType symbol,
+    std::vector<FileIndexType> &files);
+
+private:
+  // Computes closures of component and everything reachable from it which
+  // are not known yet. addMembers adds what a component contributes itself.
+  void computeClosures(const CondensedGraph &graph,
+    uint32_t component,
+    std::vector<llvm::BitVector> &closures,
+    std::vector<char> &computed,
+    llvm::function_ref<void(uint32_t, llvm::BitVector&)> addMembers);
+
+  const llvm::BitVector &getInclusionClosure(uint32_t fileComponent);
+
+  // The files which define symbol or anything it depends on.
+  const llvm::BitVector &getDefinitionClosure(SymbolIndexType symbol);
+
+  const RelationIndex &mIndex;
+  CondensedGraph mFileGraph;
+  CondensedGraph mSymbolGraph;
+  std::vector<llvm::BitVector> mInclusionClosures;
+  std::vector<char> mInclusionClosureComputed;
+  std::vector<llvm::BitVector> mSymbolClosures;
+  std::vector<char> mSymbolClosureComputed;
+  std::vector<llvm::BitVector> mDefinitionClosures;
+  std::vector<char> mDefinitionClosureComputed;
+};
+
+} // namespace closure
+} // namespace clang
+
+#endif
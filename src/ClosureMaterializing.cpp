@@ -0,0 +1,276 @@
+#include "ClosureMaterializing.h"
+#include "RecordWriting.h"
+#include "RelationGraphBuilder.h"
+#include "TimeTracing.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+#include <mutex>
+#include <vector>
+
+#ifdef LLVM_ON_UNIX
+#include <cerrno>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+namespace clang {
+namespace closure {
+
+// Tries the ways of copying in to out which share or copy the blocks inside
+// the kernel. Returns false, with out at its start, if none of them works.
+static bool CloneFile(int in, int out, PlacementKind &kind) {
+#ifdef FICLONE
+  if (::ioctl(out, FICLONE, in) == 0) {
+    kind = PK_Reflink;
+    return true;
+  }
+#endif
+#ifdef __NR_copy_file_range
+  struct stat status;
+  if (::fstat(in, &status) != 0)
+    return false;
+  off_t left = status.st_size;
+  while (left > 0) {
+    long copied = ::syscall(__NR_copy_file_range, in, nullptr, out, nullptr,
+      static_cast<size_t>(left), 0u);
+    if (copied < 0 && errno == EINTR)
+      continue;
+    // The file got shorter while it was copied.
+    if (copied == 0)
+      break;
+    // Files across filesystems and older kernels are copied otherwise, over
+    // what was copied already.
+    if (copied < 0) {
+      ::lseek(out, 0, SEEK_SET);
+      return false;
+    }
+    left -= copied;
+  }
+  kind = PK_CopyFileRange;
+  return true;
+#else
+  (void)in;
+  (void)out;
+  (void)kind;
+  return false;
+#endif
+}
+
+bool PlaceFile(StringRef from,
+  StringRef to,
+  bool hardlink,
+  PlacementKind &kind,
+  std::string &error) {
+  // A previous run may have placed the file already.
+  llvm::sys::fs::remove(to);
+#ifdef LLVM_ON_UNIX
+  llvm::SmallString<256> fromStorage(from), toStorage(to);
+  if (hardlink && ::link(fromStorage.c_str(), toStorage.c_str()) == 0) {
+    kind = PK_Hardlink;
+    return true;
+  }
+#else
+  (void)hardlink;
+#endif
+
+  int in, out;
+  if (std::error_code ec = llvm::sys::fs::openFileForRead(from, in)) {
+    error = from.str() + ": " + ec.message();
+    return false;
+  }
+  if (std::error_code ec = llvm::sys::fs::openFileForWrite(to, out,
+    llvm::sys::fs::F_None)) {
+    llvm::sys::Process::SafelyCloseFileDescriptor(in);
+    error = to.str() + ": " + ec.message();
+    return false;
+  }
+
+  bool r = true;
+  if (!CloneFile(in, out, kind)) {
+    kind = PK_Copy;
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer
+      = llvm::MemoryBuffer::getOpenFile(in, from, -1);
+    llvm::raw_fd_ostream os(out, /*shouldClose=*/false);
+    if (buffer)
+      os << (*buffer)->getBuffer();
+    os.flush();
+    if (!buffer) {
+      error = from.str() + ": " + buffer.getError().message();
+      r = false;
+    }
+    else if (os.has_error()) {
+      os.clear_error();
+      error = "can not write " + to.str();
+      r = false;
+    }
+  }
+  llvm::sys::Process::SafelyCloseFileDescriptor(in);
+  llvm::sys::Process::SafelyCloseFileDescriptor(out);
+  return r;
+}
+
+ClosureMaterializer::ClosureMaterializer(StringRef directory)
+  : mDirectory(NormalizePath(directory)), mHardlinks(false) {}
+
+std::string ClosureMaterializer::getOutputPath(StringRef file) const {
+  std::string path = NormalizePath(file);
+  llvm::SmallString<256> r(mDirectory);
+  llvm::sys::path::append(r, llvm::sys::path::relative_path(path));
+  return r.str();
+}
+
+void ClosureMaterializer::addFile(StringRef file) {
+  std::string path = NormalizePath(file);
+  if (!mFiles.insert(path).second)
+    return;
+  for (StringRef parent = llvm::sys::path::parent_path(path);
+    !parent.empty() && mDirectories.insert(parent.str()).second;
+    parent = llvm::sys::path::parent_path(parent))
+    ;
+}
+
+bool ClosureMaterializer::isPlaced(StringRef path) const {
+  std::string normalized = NormalizePath(path);
+  return mFiles.count(normalized) || mDirectories.count(normalized);
+}
+
+bool ClosureMaterializer::materialize(unsigned jobs, std::string &error) {
+  TimeTraceScope scope("MaterializeFiles");
+  std::vector<std::string> files(mFiles.begin(), mFiles.end());
+  std::mutex errorMutex;
+  bool r = true;
+  auto placeFile = [&](size_t i) {
+    std::string output = getOutputPath(files[i]);
+    std::string fileError;
+    PlacementKind kind;
+    std::error_code ec = llvm::sys::fs::create_directories(
+      llvm::sys::path::parent_path(output));
+    if (ec)
+      fileError = output + ": " + ec.message();
+    if (!ec && PlaceFile(files[i], output, mHardlinks, kind, fileError))
+      return;
+    std::lock_guard<std::mutex> lock(errorMutex);
+    r = false;
+    error = fileError;
+  };
+
+  if (jobs <= 1) {
+    for (size_t i = 0, count = files.size(); i != count; ++i)
+      placeFile(i);
+  }
+  else {
+    llvm::ThreadPool pool(jobs);
+    for (size_t i = 0, count = files.size(); i != count; ++i)
+      pool.async([&placeFile, i]() { placeFile(i); });
+    pool.wait();
+  }
+  return r;
+}
+
+// Options which name directories searched for headers.
+static bool IsSearchOption(StringRef option) {
+  return option == "-I" || option == "-isystem" || option == "-iquote"
+    || option == "-idirafter";
+}
+
+void ClosureMaterializer::rewriteArgument(ArrayRef<std::string> commandLine,
+  size_t index,
+  std::vector<std::string> &arguments) const {
+  StringRef argument = commandLine[index];
+  // Only the headers of the closures are placed in a directory, so the
+  // directory is still searched where it was, after where it is placed.
+  if (llvm::sys::path::is_absolute(argument) && isPlaced(argument)) {
+    arguments.push_back(getOutputPath(argument));
+    if (index != 0 && IsSearchOption(commandLine[index - 1])
+      && mDirectories.count(NormalizePath(argument))) {
+      arguments.push_back(commandLine[index - 1]);
+      arguments.push_back(argument);
+    }
+    return;
+  }
+  // The same goes for paths joined to their options.
+  StringRef path;
+  StringRef option = GetJoinedPathOption(argument, path);
+  if (!option.empty() && llvm::sys::path::is_absolute(path)
+    && isPlaced(path)) {
+    arguments.push_back(option.str() + getOutputPath(path));
+    if (IsSearchOption(option) && mDirectories.count(NormalizePath(path)))
+      arguments.push_back(argument);
+    return;
+  }
+  arguments.push_back(argument);
+}
+
+bool ClosureMaterializer::writeCompilationDatabase(
+  const tooling::CompilationDatabase &compilations,
+  ArrayRef<std::string> sources,
+  std::string &error) const {
+  llvm::SmallString<256> path(mDirectory);
+  llvm::sys::path::append(path, "compile_commands.json");
+  if (std::error_code ec = llvm::sys::fs::create_directories(mDirectory)) {
+    error = ec.message();
+    return false;
+  }
+  std::error_code ec;
+  llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::F_Text);
+  if (ec) {
+    error = ec.message();
+    return false;
+  }
+
+  bool first = true;
+  os << "[";
+  for (const std::string &source : sources) {
+    if (!mFiles.count(NormalizePath(source)))
+      continue;
+    for (const tooling::CompileCommand &command
+      : compilations.getCompileCommands(source)) {
+      // Relative paths of the command are relative to its directory, which
+      // is placed along with the files.
+      std::string directory = getOutputPath(command.Directory);
+      llvm::sys::fs::create_directories(directory);
+
+      os << (first ? "\n" : ",\n") << "  {\"directory\": ";
+      WriteJSONString(os, directory);
+      os << ", \"arguments\": [";
+      // Relative arguments would be relative to the placed directory, where
+      // the files they name outside of the closure are not.
+      std::vector<std::string> commandLine = command.CommandLine;
+      MakeArgumentsAbsolute(command.Directory, commandLine);
+      std::vector<std::string> arguments;
+      for (size_t i = 0, count = commandLine.size(); i != count; ++i)
+        rewriteArgument(commandLine, i, arguments);
+      for (size_t i = 0, count = arguments.size(); i != count; ++i) {
+        if (i != 0)
+          os << ", ";
+        WriteJSONString(os, arguments[i]);
+      }
+      os << "], \"file\": ";
+      WriteJSONString(os, getOutputPath(source));
+      os << "}";
+      first = false;
+    }
+  }
+  os << "\n]\n";
+  os.close();
+  if (os.has_error()) {
+    os.clear_error();
+    error = "can not write " + path.str().str();
+    return false;
+  }
+  return true;
+}
+
+} // namespace closure
+} // namespace clang
@@ -0,0 +1,84 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_CLOSURE_MATERIALIZING_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_CLOSURE_MATERIALIZING_H
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include <set>
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace closure {
+
+// How PlaceFile put a file in place.
+enum PlacementKind {
+  PK_Hardlink,
+  PK_Reflink,
+  PK_CopyFileRange,
+  PK_Copy
+};
+
+// Makes to a copy of from in the cheapest way the filesystem supports: a
+// hardlink if hardlink is set, which shares the file itself, then a reflink,
+// which shares its blocks until either is written, then a copy made by the
+// kernel, and a buffered copy at last. Sets kind to the way which worked.
+bool PlaceFile(StringRef from,
+  StringRef to,
+  bool hardlink,
+  PlacementKind &kind,
+  std::string &error);
+
+// Places the files of closures in a directory, each at its absolute path
+// under it, so that the include directives and search paths of the files
+// still find each other.
+class ClosureMaterializer {
+public:
+  explicit ClosureMaterializer(StringRef directory);
+
+  // Hardlinks the files where possible.
+  void setHardlinks(bool hardlink) {
+    mHardlinks = hardlink;
+  }
+
+  // Where file is placed.
+  std::string getOutputPath(StringRef file) const;
+
+  void addFile(StringRef file);
+
+  // Places every file added on up to jobs threads. Returns false, with the
+  // error of one of the files which could not be placed, if any.
+  bool materialize(unsigned jobs, std::string &error);
+
+  // Writes compile_commands.json to the directory, with the commands of the
+  // sources among the files added. Paths of the commands which are those of
+  // files placed, or of directories which hold some, are replaced by where
+  // these are placed, so that the placed sources build on their own. Search
+  // directories which hold some are searched where they were too, after
+  // where they are placed, for the headers outside of the closures.
+  bool writeCompilationDatabase(
+    const tooling::CompilationDatabase &compilations,
+    ArrayRef<std::string> sources,
+    std::string &error) const;
+
+private:
+  // Whether path is a file added or a directory which holds one.
+  bool isPlaced(StringRef path) const;
+
+  // Appends what the argument at index of commandLine is in the commands
+  // written to arguments.
+  void rewriteArgument(ArrayRef<std::string> commandLine,
+    size_t index,
+    std::vector<std::string> &arguments) const;
+
+  std::string mDirectory;
+  bool mHardlinks;
+  // Absolute paths without "." and "..".
+  std::set<std::string> mFiles;
+  std::set<std::string> mDirectories;
+};
+
+} // namespace closure
+} // namespace clang
+
+#endif
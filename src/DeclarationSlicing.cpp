@@ -0,0 +1,238 @@
+#include "DeclarationSlicing.h"
+#include "ClosureComputation.h"
+#include "TimeTracing.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/Path.h"
+#include <algorithm>
+#include <tuple>
+
+namespace clang {
+namespace closure {
+
+void ScanSystemInclusions(StringRef buffer, std::vector<std::string> &names) {
+  StringRef rest = buffer;
+  while (!rest.empty()) {
+    StringRef line;
+    std::tie(line, rest) = rest.split('\n');
+    line = line.ltrim(" \t");
+    if (!line.startswith("#"))
+      continue;
+    line = line.drop_front().ltrim(" \t");
+    if (!line.startswith("include"))
+      continue;
+    line = line.drop_front(7).ltrim(" \t");
+    size_t close = line.find('>');
+    if (!line.startswith("<") || close == StringRef::npos)
+      continue;
+    names.push_back(line.substr(1, close - 1));
+  }
+}
+
+// Returns the file of the inclusions of file whose name ends with the header
+// name, or InvalidIndex if none does, as for a directive of a block the
+// preprocessor skipped.
+static FileIndexType FindIncludedFile(const RelationIndex &index,
+  FileIndexType file,
+  StringRef name) {
+  for (FileIndexType included : index.getInclusions(file)) {
+    StringRef path = index.getFileName(included);
+    if (path.endswith(name) && (path.size() == name.size()
+      || llvm::sys::path::is_separator(path[path.size() - name.size() - 1])))
+      return included;
+  }
+  return RelationIndex::InvalidIndex;
+}
+
+namespace {
+
+// Part of a file which the slice copies.
+struct Extent {
+  uint32_t Order;
+  FileIndexType File;
+  unsigned Begin;
+  unsigned End;
+  unsigned Flags;
+};
+
+} // end anonymous namespace
+
+void DeclarationSlicer::addSymbol(SymbolIndexType symbol) {
+  if (mReached.test(symbol))
+    return;
+  std::vector<SymbolIndexType> stack(1, symbol);
+  mReached.set(symbol);
+  while (!stack.empty()) {
+    SymbolIndexType s = stack.back();
+    stack.pop_back();
+    mSymbols.push_back(s);
+    for (SymbolIndexType dependency : mIndex.getDependencies(s)) {
+      if (!mReached.test(dependency)) {
+        mReached.set(dependency);
+        stack.push_back(dependency);
+      }
+    }
+  }
+}
+
+const llvm::MemoryBuffer *DeclarationSlicer::getBuffer(FileIndexType file,
+  std::string &error) {
+  std::unique_ptr<llvm::MemoryBuffer> &buffer = mBuffers[file];
+  if (buffer)
+    return buffer.get();
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> r
+    = llvm::MemoryBuffer::getFile(mIndex.getFileName(file));
+  if (!r) {
+    error = "can not read " + mIndex.getFileName(file).str() + ": "
+      + r.getError().message();
+    return nullptr;
+  }
+  buffer = std::move(*r);
+  return buffer.get();
+}
+
+bool DeclarationSlicer::write(llvm::raw_ostream &os, std::string &error) {
+  TimeTraceScope scope("WriteSlice");
+
+  // The components of the graph of the slice are numbered after those they
+  // depend on.
+  llvm::DenseMap<SymbolIndexType, uint32_t> locals;
+  for (uint32_t i = 0, count = mSymbols.size(); i != count; ++i)
+    locals[mSymbols[i]] = i;
+  std::vector<std::vector<uint32_t>> successors(mSymbols.size());
+  for (uint32_t i = 0, count = mSymbols.size(); i != count; ++i) {
+    for (SymbolIndexType dependency : mIndex.getDependencies(mSymbols[i]))
+      successors[i].push_back(locals[dependency]);
+  }
+  CondensedGraph graph(mSymbols.size(), [&successors](uint32_t node) {
+    return ArrayRef<uint32_t>(successors[node]);
+  });
+
+  std::vector<Extent> extents;
+  llvm::BitVector files(mIndex.getFilesCount());
+  mMissing.clear();
+  for (uint32_t i = 0, count = mSymbols.size(); i != count; ++i) {
+    SymbolIndexType symbol = mSymbols[i];
+    FileIndexType file = mIndex.getDefinitionFile(symbol);
+    if (file == RelationIndex::InvalidIndex
+      || mIndex.isSystemHeaderInMainFile(file)
+      || mIndex.getFileName(file).empty())
+      continue;
+    files.set(file);
+    Extent extent = { graph.getComponent(i), file,
+      mIndex.getExtentBegin(symbol), mIndex.getExtentEnd(symbol),
+      mIndex.getExtentFlags(symbol) };
+    if (extent.Begin == extent.End) {
+      mMissing.push_back(symbol);
+      continue;
+    }
+    // Slices do not open namespaces again, and a declaration written
+    // outside of its own would declare another symbol.
+    if (extent.Flags & SymbolNode::EF_InNamespace) {
+      error = "can not slice " + mIndex.getSymbolName(symbol).str()
+        + ", which is declared in a namespace";
+      return false;
+    }
+    extents.push_back(extent);
+  }
+
+  std::sort(extents.begin(), extents.end(),
+    [](const Extent &a, const Extent &b) {
+      return std::tie(a.Order, a.File, a.Begin)
+        < std::tie(b.Order, b.File, b.Begin);
+    });
+  for (uint32_t i = 0, count = extents.size(); i != count; ++i)
+    extents[i].Order = i;
+
+  // Overlapping extents of a file are merged into the first of them.
+  std::sort(extents.begin(), extents.end(),
+    [](const Extent &a, const Extent &b) {
+      return std::tie(a.File, a.Begin) < std::tie(b.File, b.Begin);
+    });
+  std::vector<Extent> merged;
+  for (const Extent &extent : extents) {
+    if (!merged.empty() && merged.back().File == extent.File
+      && extent.Begin < merged.back().End) {
+      if (extent.End > merged.back().End) {
+        merged.back().End = extent.End;
+        merged.back().Flags = extent.Flags;
+      }
+      merged.back().Order = std::min(merged.back().Order, extent.Order);
+    }
+    else {
+      merged.push_back(extent);
+    }
+  }
+  std::sort(merged.begin(), merged.end(),
+    [](const Extent &a, const Extent &b) { return a.Order < b.Order; });
+
+  // The files of the definitions are flattened into the slice. Those they
+  // include may declare what they use from system headers.
+  llvm::BitVector flattened = files;
+  std::vector<FileIndexType> stack;
+  for (int file = files.find_first(); file != -1;
+    file = files.find_next(file))
+    stack.push_back(file);
+  while (!stack.empty()) {
+    FileIndexType file = stack.back();
+    stack.pop_back();
+    for (FileIndexType included : mIndex.getInclusions(file)) {
+      if (!files.test(included)) {
+        files.set(included);
+        stack.push_back(included);
+      }
+    }
+  }
+
+  std::vector<std::string> directives;
+  for (int file = files.find_first(); file != -1;
+    file = files.find_next(file)) {
+    if (mIndex.isSystemHeaderInMainFile(file)
+      || mIndex.getFileName(file).empty())
+      continue;
+    const llvm::MemoryBuffer *buffer = getBuffer(file, error);
+    if (!buffer)
+      return false;
+    std::vector<std::string> names;
+    ScanSystemInclusions(buffer->getBuffer(), names);
+    // The directives of skipped blocks include nothing, and headers which
+    // are flattened into the slice are not included again.
+    for (const std::string &name : names) {
+      FileIndexType included = FindIncludedFile(mIndex, file, name);
+      if (included != RelationIndex::InvalidIndex && !flattened.test(included))
+        directives.push_back("#include <" + name + ">");
+    }
+  }
+
+  llvm::StringSet<> written;
+  for (const std::string &directive : directives) {
+    if (written.insert(directive).second)
+      os << directive << "\n";
+  }
+  if (!written.empty())
+    os << "\n";
+
+  for (const Extent &extent : merged) {
+    const llvm::MemoryBuffer *buffer = getBuffer(extent.File, error);
+    if (!buffer)
+      return false;
+    if (extent.End > buffer->getBufferSize()) {
+      error = mIndex.getFileName(extent.File).str()
+        + " changed since it was parsed";
+      return false;
+    }
+    StringRef text = buffer->getBuffer().slice(extent.Begin, extent.End);
+    os << text;
+    // The extent of a declaration followed by another declarator ends before
+    // the semicolon.
+    if (!(extent.Flags & SymbolNode::EF_FunctionDefinition)
+      && !text.ltrim().startswith("#") && !text.endswith(";"))
+      os << ";";
+    os << "\n\n";
+  }
+  return true;
+}
+
+} // namespace closure
+} // namespace clang
@@ -0,0 +1,66 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_DECLARATION_SLICING_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_DECLARATION_SLICING_H
+
+#include "RelationIndex.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace closure {
+
+// Finds the names of the headers the #include directives of buffer name in
+// angle brackets, as written. Nothing is preprocessed, so those of
+// conditional blocks are found too.
+void ScanSystemInclusions(StringRef buffer, std::vector<std::string> &names);
+
+// Writes what some symbols need as one source file, made of the extents of
+// the declarations of the symbols and of everything they depend on, rather
+// than of whole files. Declarations come after those they depend on, and
+// those of a cycle in the order of their files. Headers which are not system
+// headers are flattened into the slice; the system headers the files of the
+// closure include in angle brackets are included at its top, if the index
+// has the inclusions.
+//
+// Extents which overlap, such as those of a structure and of a typedef which
+// defines it, are written once, where the first of them would be. A
+// declaration is written as it is in its file, so the slice of a symbol
+// which needs one in a namespace fails instead.
+class DeclarationSlicer {
+public:
+  explicit DeclarationSlicer(const RelationIndex &index)
+    : mIndex(index), mReached(index.getSymbolsCount()) {}
+
+  // Adds symbol and everything it depends on to the slice.
+  void addSymbol(SymbolIndexType symbol);
+
+  // Returns false and sets error if a file can not be read, or if a
+  // declaration of the slice is in a namespace.
+  bool write(llvm::raw_ostream &os, std::string &error);
+
+  // Symbols of the slice which are defined in a file of the closure but
+  // whose extent is not known, such as functions whose bodies were skipped.
+  const std::vector<SymbolIndexType> &getMissingSymbols() const {
+    return mMissing;
+  }
+
+private:
+  // The content of file, read once.
+  const llvm::MemoryBuffer *getBuffer(FileIndexType file, std::string &error);
+
+  const RelationIndex &mIndex;
+  llvm::BitVector mReached;
+  std::vector<SymbolIndexType> mSymbols;
+  std::vector<SymbolIndexType> mMissing;
+  std::map<FileIndexType, std::unique_ptr<llvm::MemoryBuffer>> mBuffers;
+};
+
+} // namespace closure
+} // namespace clang
+
+#endif
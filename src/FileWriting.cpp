@@ -0,0 +1,39 @@
+#include "FileWriting.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace clang {
+namespace closure {
+
+bool WriteFileAtomically(StringRef path,
+  StringRef content,
+  std::string &error) {
+  int fd;
+  llvm::SmallString<256> temporary;
+  if (std::error_code ec = llvm::sys::fs::createUniqueFile(
+    path + ".tmp-%%%%%%%%", fd, temporary)) {
+    error = ec.message();
+    return false;
+  }
+  {
+    llvm::raw_fd_ostream out(fd, /*shouldClose=*/true);
+    out << content;
+    out.close();
+    if (out.has_error()) {
+      out.clear_error();
+      llvm::sys::fs::remove(temporary);
+      error = "can not write " + temporary.str().str();
+      return false;
+    }
+  }
+  if (std::error_code ec = llvm::sys::fs::rename(temporary, path)) {
+    llvm::sys::fs::remove(temporary);
+    error = ec.message();
+    return false;
+  }
+  return true;
+}
+
+} // namespace closure
+} // namespace clang
@@ -0,0 +1,20 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_FILE_WRITING_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_FILE_WRITING_H
+
+#include "llvm/ADT/StringRef.h"
+#include <string>
+
+namespace clang {
+namespace closure {
+
+// Writes content to a temporary file next to path and renames it over path,
+// so that concurrent readers and writers only ever see whole files. Returns
+// false, with error set and no temporary file left, if either step fails.
+bool WriteFileAtomically(StringRef path,
+  StringRef content,
+  std::string &error);
+
+} // namespace closure
+} // namespace clang
+
+#endif
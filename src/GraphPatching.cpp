@@ -0,0 +1,257 @@
+#include "GraphPatching.h"
+#include "RelationGraphBuilder.h"
+#include "StringPool.h"
+#include "TimeTracing.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/FileSystem.h"
+#include <algorithm>
+#include <map>
+
+namespace clang {
+namespace closure {
+
+bool PatchableGraph::build(RelationGraphBuilder &builder) {
+  StringPoolScope poolScope(mStringPool);
+  std::vector<RelationGraph> shards;
+  bool r = builder.buildShards(mSources, shards);
+  TimeTraceScope scope("MergeShards");
+  mGraph = RelationGraph();
+  mSystemHeaderCounts.clear();
+  mFileCounts.clear();
+  mInclusionCounts.clear();
+  mSymbolOwners.clear();
+  mDependencyCounts.clear();
+  mContributions.clear();
+  for (const RelationGraph &shard : shards)
+    mContributions.push_back(makeContribution(shard));
+  for (size_t i = 0, count = mContributions.size(); i != count; ++i)
+    insertContribution(i);
+  ++mVersion;
+  return r;
+}
+
+PatchableGraph::Contribution PatchableGraph::makeContribution(
+  const RelationGraph &shard) {
+  Contribution c;
+  c.SystemHeadersInMainFiles = shard.getSystemHeadersInMainFiles();
+  for (const auto &file : shard.getFiles()) {
+    c.Files.push_back(std::make_pair(file.first, file.second.getFileName()));
+    for (size_t i = 0, count = file.second.getInclusionsCount();
+      i != count;
+      ++i)
+      c.Inclusions.push_back(std::make_pair(file.first,
+        file.second.getInclusion(i)));
+  }
+  // Symbols come in the order of their keys already.
+  for (const auto &symbol : shard.getSymbols()) {
+    StringRef key = InternString(symbol.first);
+    SymbolDefinition definition = { symbol.second.getDefinitionFile(),
+      symbol.second.getExtentBegin(), symbol.second.getExtentEnd(),
+      symbol.second.getExtentFlags() };
+    c.Symbols.push_back(std::make_pair(key, definition));
+    for (size_t i = 0, count = symbol.second.getDependencyCount();
+      i != count;
+      ++i)
+      c.Dependencies.push_back(std::make_pair(key,
+        symbol.second.getDependency(i)));
+  }
+  return c;
+}
+
+const PatchableGraph::SymbolDefinition &PatchableGraph::getDefinition(
+  size_t index,
+  StringRef symbol) const {
+  const std::vector<std::pair<StringRef, SymbolDefinition>> &symbols
+    = mContributions[index].Symbols;
+  return std::lower_bound(symbols.begin(), symbols.end(), symbol,
+    [](const std::pair<StringRef, SymbolDefinition> &entry, StringRef key) {
+    return entry.first < key;
+  })->second;
+}
+
+void PatchableGraph::insertContribution(size_t index) {
+  const Contribution &c = mContributions[index];
+  for (const FileKeyType &header : c.SystemHeadersInMainFiles) {
+    if (mSystemHeaderCounts[header]++ == 0)
+      mGraph.getSystemHeadersInMainFiles().insert(header);
+  }
+
+  FilesMapType &files = mGraph.getFiles();
+  for (const auto &file : c.Files) {
+    if (mFileCounts[file.first]++ == 0)
+      files.insert(std::make_pair(file.first, FileNode(file.second)));
+  }
+  for (const auto &inclusion : c.Inclusions) {
+    if (mInclusionCounts[inclusion]++ == 0)
+      files.find(inclusion.first)->second.appendInclusion(inclusion.second);
+  }
+
+  SymbolsMapType &symbols = mGraph.getSymbols();
+  for (const auto &symbol : c.Symbols) {
+    const SymbolDefinition &definition = symbol.second;
+    SymbolOwners &owners = mSymbolOwners[symbol.first];
+    SymbolNode &node = symbols.insert(std::make_pair(symbol.first.str(),
+      SymbolNode(definition.File))).first->second;
+    std::vector<size_t> &indices = owners.Indices;
+    indices.insert(std::upper_bound(indices.begin(), indices.end(), index),
+      index);
+    if (indices.front() == index)
+      node.setDefinitionFile(definition.File);
+    if (definition.ExtentBegin != definition.ExtentEnd
+      && (owners.ExtentOwner == ~size_t(0) || index < owners.ExtentOwner)) {
+      owners.ExtentOwner = index;
+      node.setExtent(definition.ExtentBegin, definition.ExtentEnd,
+        definition.ExtentFlags);
+    }
+  }
+  for (const auto &dependency : c.Dependencies) {
+    if (mDependencyCounts[dependency]++ == 0) {
+      symbols.find(dependency.first.str())->second.appendDependency(
+        dependency.second);
+    }
+  }
+}
+
+void PatchableGraph::retractContribution(size_t index) {
+  const Contribution &c = mContributions[index];
+  SymbolsMapType &symbols = mGraph.getSymbols();
+  for (const auto &dependency : c.Dependencies) {
+    auto count = mDependencyCounts.find(dependency);
+    if (--count->second == 0) {
+      mDependencyCounts.erase(count);
+      symbols.find(dependency.first.str())->second.removeDependency(
+        dependency.second);
+    }
+  }
+  for (const auto &symbol : c.Symbols) {
+    auto owners = mSymbolOwners.find(symbol.first);
+    std::vector<size_t> &indices = owners->second.Indices;
+    indices.erase(std::lower_bound(indices.begin(), indices.end(), index));
+    if (indices.empty()) {
+      mSymbolOwners.erase(owners);
+      symbols.erase(symbol.first.str());
+      continue;
+    }
+
+    SymbolNode &node = symbols.find(symbol.first.str())->second;
+    node.setDefinitionFile(getDefinition(indices.front(), symbol.first).File);
+    if (owners->second.ExtentOwner != index)
+      continue;
+    owners->second.ExtentOwner = ~size_t(0);
+    node.setExtent(0, 0);
+    for (size_t owner : indices) {
+      const SymbolDefinition &definition = getDefinition(owner, symbol.first);
+      if (definition.ExtentBegin != definition.ExtentEnd) {
+        owners->second.ExtentOwner = owner;
+        node.setExtent(definition.ExtentBegin, definition.ExtentEnd,
+          definition.ExtentFlags);
+        break;
+      }
+    }
+  }
+
+  FilesMapType &files = mGraph.getFiles();
+  for (const auto &inclusion : c.Inclusions) {
+    auto count = mInclusionCounts.find(inclusion);
+    if (--count->second == 0) {
+      mInclusionCounts.erase(count);
+      files.find(inclusion.first)->second.removeInclusion(inclusion.second);
+    }
+  }
+  // The inclusions of a file are contributed by the TUs which see it, so
+  // none are left once no TU sees it.
+  for (const auto &file : c.Files) {
+    auto count = mFileCounts.find(file.first);
+    if (--count->second == 0) {
+      mFileCounts.erase(count);
+      files.erase(file.first);
+    }
+  }
+  for (const FileKeyType &header : c.SystemHeadersInMainFiles) {
+    auto count = mSystemHeaderCounts.find(header);
+    if (--count->second == 0) {
+      mSystemHeaderCounts.erase(count);
+      mGraph.getSystemHeadersInMainFiles().erase(header);
+    }
+  }
+}
+
+std::vector<size_t> PatchableGraph::getAffectedSources(
+  ArrayRef<std::string> files) const {
+  const FilesMapType &nodes = mGraph.getFiles();
+  // Files are matched by normalized names, since clang names files as they
+  // are spelled in include directives and search paths.
+  llvm::StringMap<std::vector<FileKeyType>> keysByName;
+  std::map<FileKeyType, std::vector<FileKeyType>> includers;
+  for (auto iter = nodes.begin(); iter != nodes.end(); ++iter) {
+    keysByName[NormalizePath(iter->second.getFileName())].push_back(
+      iter->first);
+    for (size_t i = 0, count = iter->second.getInclusionsCount();
+      i != count;
+      ++i)
+      includers[iter->second.getInclusion(i)].push_back(iter->first);
+  }
+
+  auto findKeys = [&](StringRef file, std::vector<FileKeyType> &keys) {
+    auto named = keysByName.find(NormalizePath(file));
+    if (named != keysByName.end())
+      keys.insert(keys.end(), named->second.begin(), named->second.end());
+    FileKeyType id;
+    if (!llvm::sys::fs::getUniqueID(file, id))
+      keys.push_back(id);
+  };
+
+  FilesSetType reached;
+  std::vector<FileKeyType> worklist;
+  for (const std::string &file : files)
+    findKeys(file, worklist);
+  while (!worklist.empty()) {
+    FileKeyType key = worklist.back();
+    worklist.pop_back();
+    if (!reached.insert(key).second)
+      continue;
+    auto iter = includers.find(key);
+    if (iter != includers.end())
+      worklist.insert(worklist.end(), iter->second.begin(), iter->second.end());
+  }
+
+  std::vector<size_t> r;
+  for (size_t i = 0, count = mSources.size(); i != count; ++i) {
+    std::vector<FileKeyType> keys;
+    findKeys(mSources[i], keys);
+    for (const FileKeyType &key : keys) {
+      if (reached.count(key)) {
+        r.push_back(i);
+        break;
+      }
+    }
+  }
+  return r;
+}
+
+bool PatchableGraph::update(RelationGraphBuilder &builder,
+  ArrayRef<std::string> files,
+  std::vector<std::string> &affected) {
+  TimeTraceScope scope("PatchGraph");
+  StringPoolScope poolScope(mStringPool);
+  std::vector<size_t> indices = getAffectedSources(files);
+  if (indices.empty())
+    return true;
+
+  std::vector<std::string> sources;
+  for (size_t i : indices)
+    sources.push_back(mSources[i]);
+  std::vector<RelationGraph> shards;
+  bool r = builder.buildShards(sources, shards);
+  for (size_t k = 0, count = indices.size(); k != count; ++k) {
+    retractContribution(indices[k]);
+    mContributions[indices[k]] = makeContribution(shards[k]);
+    insertContribution(indices[k]);
+  }
+  ++mVersion;
+  affected.insert(affected.end(), sources.begin(), sources.end());
+  return r;
+}
+
+} // namespace closure
+} // namespace clang
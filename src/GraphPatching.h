@@ -0,0 +1,117 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_GRAPH_PATCHING_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_GRAPH_PATCHING_H
+
+#include "RelationConstruction.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace clang {
+namespace closure {
+
+class RelationGraphBuilder;
+class StringPool;
+
+// The graph of a set of sources which keeps what the graph of every TU
+// contributed to it, with the number of TUs which contribute each file,
+// symbol and edge, so that when files change only the TUs which see them
+// are parsed again, and only what these contribute is taken out of the
+// graph and put back. The graph has the same files, symbols and edges as
+// the one a full build would make, and symbols are defined as the first TU
+// in the order of the sources defines them, but edges may come in another
+// order.
+class PatchableGraph {
+public:
+  explicit PatchableGraph(ArrayRef<std::string> sources)
+    : mSources(sources.begin(), sources.end()), mStringPool(nullptr),
+    mVersion(0) {}
+
+  // Interns the strings of the graph in pool instead of that of the
+  // thread. The pool must outlive the graph.
+  void setStringPool(StringPool *pool) {
+    mStringPool = pool;
+  }
+
+  // Parses every source with builder. Returns false if any TU failed to
+  // parse.
+  bool build(RelationGraphBuilder &builder);
+
+  // The indices of the sources whose TUs see any of files, found by
+  // following inclusions backwards from them. Files are matched by name as
+  // well as by unique ID, since editors often save a file as a new one.
+  std::vector<size_t> getAffectedSources(ArrayRef<std::string> files) const;
+
+  // Parses the TUs which see any of files again with builder, and replaces
+  // what they contributed to the graph, in time linear in the size of their
+  // graphs rather than in that of the whole one. The sources of these TUs
+  // are added to affected. Returns false if any of them failed to parse.
+  bool update(RelationGraphBuilder &builder,
+    ArrayRef<std::string> files,
+    std::vector<std::string> &affected);
+
+  const RelationGraph &getGraph() const {
+    return mGraph;
+  }
+
+  // Bumped whenever the graph changes, so that what was computed from an
+  // older graph can be told apart.
+  unsigned getVersion() const {
+    return mVersion;
+  }
+
+private:
+  // Where a TU defines a symbol.
+  struct SymbolDefinition {
+    FileKeyType File;
+    unsigned ExtentBegin;
+    unsigned ExtentEnd;
+    unsigned ExtentFlags;
+  };
+
+  // The keys and edges of the graph of a TU. Strings are interned, and
+  // symbols are sorted by their keys.
+  struct Contribution {
+    FilesSetType SystemHeadersInMainFiles;
+    std::vector<std::pair<FileKeyType, StringRef>> Files;
+    std::vector<std::pair<FileKeyType, FileKeyType>> Inclusions;
+    std::vector<std::pair<StringRef, SymbolDefinition>> Symbols;
+    std::vector<std::pair<StringRef, StringRef>> Dependencies;
+  };
+
+  // The indices of the sources whose TUs define a symbol, in order. The
+  // symbol is defined as in the first, with the extent of the first which
+  // knows it.
+  struct SymbolOwners {
+    std::vector<size_t> Indices;
+    // ~0 if none of them knows it.
+    size_t ExtentOwner = ~size_t(0);
+  };
+
+  static Contribution makeContribution(const RelationGraph &shard);
+
+  // Adds what the TU of the source at index contributes to the graph, or
+  // takes it out of it.
+  void insertContribution(size_t index);
+  void retractContribution(size_t index);
+
+  const SymbolDefinition &getDefinition(size_t index, StringRef symbol) const;
+
+  std::vector<std::string> mSources;
+  StringPool *mStringPool;
+  std::vector<Contribution> mContributions;
+  RelationGraph mGraph;
+  std::map<FileKeyType, unsigned> mSystemHeaderCounts;
+  std::map<FileKeyType, unsigned> mFileCounts;
+  std::map<std::pair<FileKeyType, FileKeyType>, unsigned> mInclusionCounts;
+  std::map<StringRef, SymbolOwners> mSymbolOwners;
+  std::map<std::pair<StringRef, StringRef>, unsigned> mDependencyCounts;
+  unsigned mVersion;
+};
+
+} // namespace closure
+} // namespace clang
+
+#endif
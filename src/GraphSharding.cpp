@@ -0,0 +1,123 @@
+#include "GraphSharding.h"
+#include "FileWriting.h"
+#include "IndexCache.h"
+#include "TimeTracing.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <map>
+#include <tuple>
+
+namespace clang {
+namespace closure {
+
+static const char *GraphSignature = "clang-closure-graph 2";
+
+bool ShardSpec::parse(StringRef s) {
+  StringRef index, count;
+  std::tie(index, count) = s.split('/');
+  unsigned i, n;
+  if (index.getAsInteger(10, i) || count.getAsInteger(10, n) || i >= n)
+    return false;
+  Index = i;
+  Count = n;
+  return true;
+}
+
+std::vector<std::string> ShardSpec::select(
+  ArrayRef<std::string> sources) const {
+  std::vector<std::string> sorted(sources.begin(), sources.end());
+  std::sort(sorted.begin(), sorted.end());
+  sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+  std::vector<std::string> r;
+  for (size_t i = Index, count = sorted.size(); i < count; i += Count)
+    r.push_back(sorted[i]);
+  return r;
+}
+
+bool WriteGraphFile(const RelationGraph &graph,
+  StringRef path,
+  std::string &error) {
+  TimeTraceScope scope("WriteGraphFile", path);
+  std::map<FileKeyType, size_t> indices;
+  const FilesMapType &files = graph.getFiles();
+  for (auto iter = files.begin(); iter != files.end(); ++iter) {
+    indices[iter->first];
+    for (size_t i = 0, count = iter->second.getInclusionsCount();
+      i != count;
+      ++i)
+      indices[iter->second.getInclusion(i)];
+  }
+  for (const FileKeyType &id : graph.getSystemHeadersInMainFiles())
+    indices[id];
+  const SymbolsMapType &symbols = graph.getSymbols();
+  for (auto iter = symbols.begin(); iter != symbols.end(); ++iter)
+    indices[iter->second.getDefinitionFile()];
+
+  std::string content;
+  llvm::raw_string_ostream os(content);
+  os << GraphSignature << "\n";
+  size_t index = 0;
+  for (auto &key : indices) {
+    key.second = index++;
+    auto file = files.find(key.first);
+    os << "key " << key.first.getDevice() << " " << key.first.getFile()
+      << " " << (file == files.end() ? StringRef()
+        : StringRef(file->second.getFileName())) << "\n";
+  }
+  WriteRelationRecords(graph, indices, os);
+  os.flush();
+  return WriteFileAtomically(path, content, error);
+}
+
+bool ReadGraphFile(StringRef path, RelationGraph &graph, std::string &error) {
+  TimeTraceScope scope("ReadGraphFile", path);
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer
+    = llvm::MemoryBuffer::getFile(path);
+  if (!buffer) {
+    error = buffer.getError().message();
+    return false;
+  }
+
+  llvm::line_iterator line(**buffer), end;
+  if (line == end || *line != GraphSignature) {
+    error = "not a clang-closure graph";
+    return false;
+  }
+
+  std::vector<FileKeyType> ids;
+  std::vector<StringRef> records;
+  for (++line; line != end; ++line) {
+    StringRef tag, rest, device, file, name;
+    std::tie(tag, rest) = line->split(' ');
+    if (tag != "key") {
+      records.push_back(*line);
+      continue;
+    }
+
+    std::tie(device, rest) = rest.split(' ');
+    std::tie(file, name) = rest.split(' ');
+    uint64_t deviceNumber, fileNumber;
+    if (device.getAsInteger(10, deviceNumber)
+      || file.getAsInteger(10, fileNumber)) {
+      error = "malformed file key";
+      return false;
+    }
+    FileKeyType id(deviceNumber, fileNumber);
+    FileKeyType found;
+    if (!name.empty() && !llvm::sys::fs::getUniqueID(name, found))
+      id = found;
+    ids.push_back(id);
+  }
+
+  if (!ReadRelationRecords(records, ids, graph)) {
+    error = "malformed relations";
+    return false;
+  }
+  return true;
+}
+
+} // namespace closure
+} // namespace clang
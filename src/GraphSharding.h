@@ -0,0 +1,45 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_GRAPH_SHARDING_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_GRAPH_SHARDING_H
+
+#include "RelationConstruction.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace closure {
+
+// One of Count parts of the sources, so that the graph of a large database
+// can be built by separate processes whose graph files are merged.
+struct ShardSpec {
+  ShardSpec() : Index(0), Count(1) {}
+
+  // Parses "i/N" with i < N.
+  bool parse(StringRef s);
+
+  // The sources of this shard. Sources are dealt out in the order of their
+  // names, so every process given the same sources agrees on the shards
+  // whatever the order of the database.
+  std::vector<std::string> select(ArrayRef<std::string> sources) const;
+
+  unsigned Index;
+  unsigned Count;
+};
+
+// Graph files hold a graph in the text form of cache entries, after a table
+// of the files it refers to with their unique IDs and names.
+bool WriteGraphFile(const RelationGraph &graph,
+  StringRef path,
+  std::string &error);
+
+// Merges the graph of the file at path into graph. Files are keyed by the
+// unique ID of their name where it can be looked up, and by the ID stored
+// otherwise, so the graphs of processes which see a file under different
+// IDs still share it.
+bool ReadGraphFile(StringRef path, RelationGraph &graph, std::string &error);
+
+} // namespace closure
+} // namespace clang
+
+#endif
@@ -0,0 +1,581 @@
+#include "InclusionScanning.h"
+#include "RelationGraphBuilder.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/Utils.h"
+#include "clang/Lex/HeaderSearchOptions.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include <cctype>
+#include <algorithm>
+#include <cstring>
+#include <set>
+
+namespace clang {
+namespace closure {
+
+static bool IsHorizontalSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+// Returns buffer without the backslash-newline pairs which continue lines,
+// in storage if it has any.
+static StringRef SpliceLines(StringRef buffer, std::string &storage) {
+  if (buffer.find("\\\n") == StringRef::npos
+    && buffer.find("\\\r\n") == StringRef::npos)
+    return buffer;
+
+  storage.reserve(buffer.size());
+  for (size_t i = 0, size = buffer.size(); i != size; ++i) {
+    if (buffer[i] == '\\') {
+      StringRef rest = buffer.drop_front(i + 1);
+      if (rest.startswith("\n")) {
+        i += 1;
+        continue;
+      }
+      if (rest.startswith("\r\n")) {
+        i += 2;
+        continue;
+      }
+    }
+    storage += buffer[i];
+  }
+  return storage;
+}
+
+static const char *SkipLine(const char *p, const char *end) {
+  const char *newline
+    = static_cast<const char*>(std::memchr(p, '\n', end - p));
+  return newline ? newline : end;
+}
+
+// Skips a block comment starting after "/*". Sets newline if it spans lines.
+static const char *SkipBlockComment(const char *p, const char *end,
+  bool &newline) {
+  for (; p != end; ++p) {
+    if (*p == '\n')
+      newline = true;
+    else if (*p == '*' && p + 1 != end && p[1] == '/')
+      return p + 2;
+  }
+  return end;
+}
+
+// Skips horizontal space, then returns the identifier at p, if any.
+static StringRef ReadIdentifier(const char *&p, const char *end) {
+  while (p != end && IsHorizontalSpace(*p))
+    ++p;
+  const char *name = p;
+  while (p != end && (isalnum(static_cast<unsigned char>(*p)) || *p == '_'))
+    ++p;
+  return StringRef(name, p - name);
+}
+
+// Scans the directive after '#' and returns the end of its line. Clears
+// leading unless the directive is an include with a literal file name.
+static const char *ScanDirective(const char *p, const char *end,
+  bool &leading,
+  std::vector<ScannedInclusion> &inclusions) {
+  StringRef directive = ReadIdentifier(p, end);
+  if (directive != "include" && directive != "include_next"
+    && directive != "import") {
+    leading = false;
+    return SkipLine(p, end);
+  }
+
+  while (p != end && IsHorizontalSpace(*p))
+    ++p;
+  if (p == end || (*p != '"' && *p != '<')) {
+    leading = false;
+    return SkipLine(p, end);
+  }
+
+  // Names given by macros can not be resolved without preprocessing.
+  char terminator = *p == '"' ? '"' : '>';
+  const char *lineEnd = SkipLine(p, end);
+  const char *fileName = p + 1;
+  const char *close = static_cast<const char*>(
+    std::memchr(fileName, terminator, lineEnd - fileName));
+  if (close && close != fileName) {
+    ScannedInclusion inclusion;
+    inclusion.FileName.assign(fileName, close);
+    inclusion.IsAngled = terminator == '>';
+    inclusion.IsNext = directive == "include_next";
+    inclusion.IsLeading = leading;
+    inclusions.push_back(inclusion);
+  }
+  return lineEnd;
+}
+
+void ScanInclusions(StringRef buffer,
+  std::vector<ScannedInclusion> &inclusions) {
+  std::string storage;
+  buffer = SpliceLines(buffer, storage);
+  const char *p = buffer.begin(), *end = buffer.end();
+  // Whether only whitespace and comments precede p on its line.
+  bool atLineStart = true;
+  // Whether only whitespace, comments and includes precede p.
+  bool leading = true;
+
+  while (p != end) {
+    char c = *p;
+    if (c == '\n') {
+      atLineStart = true;
+      ++p;
+    }
+    else if (IsHorizontalSpace(c)) {
+      ++p;
+    }
+    else if (c == '/' && p + 1 != end && p[1] == '/') {
+      p = SkipLine(p, end);
+    }
+    else if (c == '/' && p + 1 != end && p[1] == '*') {
+      bool newline = false;
+      p = SkipBlockComment(p + 2, end, newline);
+      if (newline)
+        atLineStart = true;
+    }
+    else if (c == '#' && atLineStart) {
+      p = ScanDirective(p + 1, end, leading, inclusions);
+    }
+    else if (c == '"' || c == '\'') {
+      atLineStart = false;
+      leading = false;
+      for (++p; p != end && *p != c && *p != '\n'; ++p) {
+        if (*p == '\\' && p + 1 != end)
+          ++p;
+      }
+      if (p != end && *p == c)
+        ++p;
+    }
+    else {
+      atLineStart = false;
+      leading = false;
+      ++p;
+    }
+  }
+}
+
+// Skips whitespace and comments, including newlines.
+static const char *SkipTrivia(const char *p, const char *end) {
+  while (p != end) {
+    if (IsHorizontalSpace(*p) || *p == '\n') {
+      ++p;
+    }
+    else if (*p == '/' && p + 1 != end && p[1] == '/') {
+      p = SkipLine(p, end);
+    }
+    else if (*p == '/' && p + 1 != end && p[1] == '*') {
+      bool newline;
+      p = SkipBlockComment(p + 2, end, newline);
+    }
+    else {
+      break;
+    }
+  }
+  return p;
+}
+
+bool HasIncludeGuard(StringRef buffer) {
+  std::string storage;
+  buffer = SpliceLines(buffer, storage);
+  const char *p = buffer.begin(), *end = buffer.end();
+  StringRef guard;
+  while (true) {
+    p = SkipTrivia(p, end);
+    if (p == end || *p != '#')
+      return false;
+    ++p;
+    StringRef directive = ReadIdentifier(p, end);
+    StringRef argument = ReadIdentifier(p, end);
+    if (directive == "pragma" && argument == "once")
+      return true;
+    if (!guard.empty())
+      return directive == "define" && argument == guard;
+    if (directive != "ifndef" || argument.empty())
+      return false;
+    guard = argument;
+    p = SkipLine(p, end);
+  }
+}
+
+// Returns the position of an include directory group in the search order,
+// or -1 if angled includes of the language do not search it.
+static int GetAngledRank(frontend::IncludeDirGroup group,
+  const LangOptions &language) {
+  switch (group) {
+  case frontend::Quoted:
+    return -1;
+  case frontend::Angled:
+  case frontend::IndexHeaderMap:
+    return 0;
+  case frontend::System:
+  case frontend::ExternCSystem:
+    return 1;
+  case frontend::CSystem:
+    return !language.ObjC1 && !language.CPlusPlus ? 1 : -1;
+  case frontend::CXXSystem:
+    return !language.ObjC1 && language.CPlusPlus ? 1 : -1;
+  case frontend::ObjCSystem:
+    return language.ObjC1 && !language.CPlusPlus ? 1 : -1;
+  case frontend::ObjCXXSystem:
+    return language.ObjC1 && language.CPlusPlus ? 1 : -1;
+  case frontend::After:
+    return 2;
+  }
+  return -1;
+}
+
+static int StaticSymbol;
+
+std::vector<AngledDirectory> GetAngledDirectories(StringRef directory,
+  std::vector<std::string> args,
+  StringRef mainPath) {
+  args[0] = llvm::sys::fs::getMainExecutable("clang_tool", &StaticSymbol);
+  args.push_back("-fsyntax-only");
+  args.push_back(mainPath);
+  std::vector<const char*> argv;
+  for (const std::string &arg : args)
+    argv.push_back(arg.c_str());
+  IntrusiveRefCntPtr<DiagnosticsEngine> diags
+    = CompilerInstance::createDiagnostics(new DiagnosticOptions,
+    new IgnoringDiagConsumer);
+  std::unique_ptr<CompilerInvocation> invocation(
+    createInvocationFromCommandLine(argv, diags));
+  std::vector<AngledDirectory> r;
+  if (!invocation)
+    return r;
+
+  // The preprocessor searches the groups in turn, and the directories of a
+  // group in the order they are given.
+  auto makeAbsolute = [&](StringRef path) {
+    llvm::SmallString<256> absolute(path);
+    if (!llvm::sys::path::is_absolute(path)) {
+      absolute = directory;
+      llvm::sys::path::append(absolute, path);
+    }
+    return absolute.str().str();
+  };
+  const HeaderSearchOptions &options = invocation->getHeaderSearchOpts();
+  std::vector<std::pair<int, AngledDirectory>> ranked;
+  for (const HeaderSearchOptions::Entry &entry : options.UserEntries) {
+    int rank = GetAngledRank(entry.Group, *invocation->getLangOpts());
+    if (rank < 0 || entry.IsFramework)
+      continue;
+    ranked.push_back(std::make_pair(rank,
+      AngledDirectory{ makeAbsolute(entry.Path), rank != 0 }));
+  }
+  std::stable_sort(ranked.begin(), ranked.end(),
+    [](const std::pair<int, AngledDirectory> &a,
+      const std::pair<int, AngledDirectory> &b) {
+      return a.first < b.first;
+    });
+  for (auto &entry : ranked)
+    r.push_back(std::move(entry.second));
+
+  // Drivers which do not pass the builtin directory leave it to the
+  // frontend.
+  if (options.UseBuiltinIncludes) {
+    llvm::SmallString<256> builtin(options.ResourceDir);
+    llvm::sys::path::append(builtin, "include");
+    std::string path = makeAbsolute(builtin);
+    if (std::none_of(r.begin(), r.end(), [&](const AngledDirectory &entry) {
+      return entry.Path == path;
+    }))
+      r.push_back(AngledDirectory{ path, true });
+  }
+  return r;
+}
+
+// Include search paths taken from a compile command, in the order the
+// preprocessor searches them.
+class InclusionScanner::SearchPaths {
+public:
+  // The directory of files which were not found in a search path.
+  static const size_t NoDirectory = ~size_t(0);
+
+  SearchPaths(const tooling::CompileCommand &command,
+    ArrayRef<AngledDirectory> angled) {
+    const std::vector<std::string> &args = command.CommandLine;
+    for (size_t i = 1; i < args.size(); ++i) {
+      StringRef value;
+      if (matchOption(args, i, "-iquote", value))
+        addPath(command, value, false, mDirectories);
+    }
+    mAngledStart = mDirectories.size();
+    for (const AngledDirectory &directory : angled) {
+      mDirectories.push_back(std::make_pair(directory.Path,
+        directory.IsSystem));
+    }
+  }
+
+  // Resolves inclusion found in includer, which was found in the search
+  // path includerDirectory. Sets isSystem if the file comes from a system
+  // directory, and directory to the search path it was found in.
+  bool resolve(InclusionScanner &scanner,
+    StringRef includer,
+    size_t includerDirectory,
+    const ScannedInclusion &inclusion,
+    std::string &path,
+    bool &isSystem,
+    size_t &directory) const {
+    isSystem = false;
+    directory = NoDirectory;
+    if (llvm::sys::path::is_absolute(inclusion.FileName)) {
+      path = inclusion.FileName;
+      return llvm::sys::fs::is_regular_file(path);
+    }
+
+    // Otherwise #include_next would find its own file again. In a file
+    // which was not found in a search path, it is an #include.
+    size_t first = inclusion.IsAngled ? mAngledStart : 0;
+    if (inclusion.IsNext && includerDirectory != NoDirectory) {
+      first = includerDirectory + 1;
+    }
+    else if (!inclusion.IsAngled && scanner.lookupFile(
+      llvm::sys::path::parent_path(includer), inclusion.FileName, path)) {
+      return true;
+    }
+
+    for (size_t i = first, count = mDirectories.size(); i < count; ++i) {
+      if (scanner.lookupFile(mDirectories[i].first, inclusion.FileName,
+        path)) {
+        isSystem = mDirectories[i].second;
+        directory = i;
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  typedef std::vector<std::pair<std::string, bool>> DirectoriesType;
+
+  // Matches both "-Ivalue" and "-I value".
+  static bool matchOption(const std::vector<std::string> &args,
+    size_t &i,
+    StringRef option,
+    StringRef &value) {
+    StringRef arg = args[i];
+    if (arg == option) {
+      if (i + 1 == args.size())
+        return false;
+      value = args[++i];
+      return true;
+    }
+    if (!arg.startswith(option))
+      return false;
+    value = arg.substr(option.size());
+    return true;
+  }
+
+  static void addPath(const tooling::CompileCommand &command,
+    StringRef value,
+    bool isSystem,
+    DirectoriesType &directories) {
+    llvm::SmallString<256> path(value);
+    if (!llvm::sys::path::is_absolute(path)) {
+      path = command.Directory;
+      llvm::sys::path::append(path, value);
+    }
+    directories.push_back(std::make_pair(path.str().str(), isSystem));
+  }
+
+  // -iquote directories, then the angled ones, which angled inclusions
+  // start at.
+  DirectoriesType mDirectories;
+  size_t mAngledStart;
+};
+
+const size_t InclusionScanner::SearchPaths::NoDirectory;
+
+bool InclusionScanner::lookupFile(StringRef directory,
+  StringRef fileName,
+  std::string &path) {
+  std::string key = directory.str();
+  key += '\0';
+  key += fileName;
+  {
+    std::lock_guard<std::mutex> lock(mLookupsMutex);
+    auto iter = mLookups.find(key);
+    if (iter != mLookups.end()) {
+      path = iter->second;
+      return !path.empty();
+    }
+  }
+
+  llvm::SmallString<256> candidate(directory);
+  llvm::sys::path::append(candidate, fileName);
+  path.clear();
+  if (llvm::sys::fs::is_regular_file(candidate))
+    path = candidate.str().str();
+
+  std::lock_guard<std::mutex> lock(mLookupsMutex);
+  mLookups[key] = path;
+  return !path.empty();
+}
+
+std::vector<AngledDirectory> InclusionScanner::getAngledDirectories(
+  const tooling::CompileCommand &command,
+  StringRef mainPath) {
+  // The language of the driver depends on the extension of the main file.
+  std::vector<std::string> args = GetConfigurationArguments(command, mainPath);
+  std::string key = command.Directory;
+  for (const std::string &arg : args) {
+    key += '\0';
+    key += arg;
+  }
+  key += '\0';
+  key += llvm::sys::path::extension(mainPath);
+  {
+    std::lock_guard<std::mutex> lock(mAngledDirectoriesMutex);
+    auto iter = mAngledDirectories.find(key);
+    if (iter != mAngledDirectories.end())
+      return iter->second;
+  }
+
+  std::vector<AngledDirectory> directories
+    = GetAngledDirectories(command.Directory, std::move(args), mainPath);
+  std::lock_guard<std::mutex> lock(mAngledDirectoriesMutex);
+  mAngledDirectories[key] = directories;
+  return directories;
+}
+
+const InclusionScanner::ScannedFile *InclusionScanner::getFile(
+  StringRef path,
+  const FileKeyType &key) {
+  ScannedFile *file;
+  {
+    std::lock_guard<std::mutex> lock(mFilesMutex);
+    file = &mFiles[key];
+  }
+
+  std::call_once(file->Scanned, [&]() {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer
+      = llvm::MemoryBuffer::getFile(path);
+    if (!buffer)
+      return;
+    ScanInclusions((*buffer)->getBuffer(), file->Inclusions);
+    file->IsGuarded = HasIncludeGuard((*buffer)->getBuffer());
+    file->Readable = true;
+  });
+  return file->Readable ? file : nullptr;
+}
+
+static void GetMainPath(const tooling::CompileCommand &command,
+  StringRef source,
+  llvm::SmallVectorImpl<char> &mainPath) {
+  mainPath.assign(source.begin(), source.end());
+  if (!llvm::sys::path::is_absolute(source)) {
+    mainPath.assign(command.Directory.begin(), command.Directory.end());
+    llvm::sys::path::append(mainPath, source);
+  }
+}
+
+bool InclusionScanner::scanLeadingInclusions(
+  const tooling::CompileCommand &command,
+  StringRef source,
+  std::vector<LeadingInclusion> &inclusions) {
+  llvm::SmallString<256> mainPath;
+  GetMainPath(command, source, mainPath);
+  SearchPaths searchPaths(command, getAngledDirectories(command, mainPath));
+  FileKeyType mainKey;
+  if (llvm::sys::fs::getUniqueID(mainPath, mainKey))
+    return false;
+  const ScannedFile *mainFile = getFile(mainPath, mainKey);
+  if (!mainFile)
+    return false;
+
+  for (const ScannedInclusion &inclusion : mainFile->Inclusions) {
+    if (!inclusion.IsLeading)
+      break;
+    LeadingInclusion leading;
+    leading.Inclusion = inclusion;
+    leading.IsGuarded = false;
+    FileKeyType key;
+    size_t directory;
+    if (!searchPaths.resolve(*this, mainPath, SearchPaths::NoDirectory,
+      inclusion, leading.Path, leading.IsSystem, directory)
+      || llvm::sys::fs::getUniqueID(leading.Path, key)) {
+      leading.Path.clear();
+      leading.IsSystem = false;
+    }
+    else if (const ScannedFile *file = getFile(leading.Path, key)) {
+      leading.IsGuarded = file->IsGuarded;
+    }
+    inclusions.push_back(std::move(leading));
+  }
+  return true;
+}
+
+bool InclusionScanner::scanTranslationUnit(
+  const tooling::CompileCommand &command,
+  StringRef source,
+  RelationGraph &graph) {
+  llvm::SmallString<256> mainPath;
+  GetMainPath(command, source, mainPath);
+  SearchPaths searchPaths(command, getAngledDirectories(command, mainPath));
+  FileKeyType mainKey;
+  if (llvm::sys::fs::getUniqueID(mainPath, mainKey))
+    return false;
+  if (!getFile(mainPath, mainKey))
+    return false;
+
+  FilesMapType &files = graph.getFiles();
+  files.insert(std::make_pair(mainKey, FileNode(mainPath)));
+
+  struct PendingFile {
+    std::string Path;
+    FileKeyType Key;
+    bool IsSystem;
+    // The search path the file was found in.
+    size_t Directory;
+  };
+  std::vector<PendingFile> pending;
+  pending.push_back(PendingFile{ mainPath.str().str(), mainKey, false,
+    SearchPaths::NoDirectory });
+  std::set<FileKeyType> visited;
+  visited.insert(mainKey);
+
+  while (!pending.empty()) {
+    PendingFile current = std::move(pending.back());
+    pending.pop_back();
+
+    const ScannedFile *file = getFile(current.Path, current.Key);
+    if (!file)
+      continue;
+    const std::vector<ScannedInclusion> &inclusions = file->Inclusions;
+
+    // As with InclusionPPCallbacks, the inclusions of system headers are not
+    // edges; the header is only marked.
+    if (current.IsSystem) {
+      if (!inclusions.empty())
+        graph.getSystemHeadersInMainFiles().insert(current.Key);
+      continue;
+    }
+
+    FileNode &node = files.insert(std::make_pair(
+      current.Key, FileNode(current.Path))).first->second;
+    for (const ScannedInclusion &inclusion : inclusions) {
+      PendingFile included;
+      FileKeyType key;
+      if (!searchPaths.resolve(*this, current.Path, current.Directory,
+        inclusion, included.Path, included.IsSystem, included.Directory)
+        || llvm::sys::fs::getUniqueID(included.Path, key))
+        continue;
+
+      files.insert(std::make_pair(key, FileNode(included.Path)));
+      node.appendInclusion(key);
+      if (visited.insert(key).second) {
+        included.Key = key;
+        pending.push_back(std::move(included));
+      }
+    }
+  }
+  return true;
+}
+
+} // namespace closure
+} // namespace clang
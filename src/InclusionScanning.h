@@ -0,0 +1,115 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_INCLUSION_SCANNING_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_INCLUSION_SCANNING_H
+
+#include "RelationConstruction.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/StringMap.h"
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace closure {
+
+// An include directive as written in a file.
+struct ScannedInclusion {
+  std::string FileName;
+  bool IsAngled;
+  // Whether the directive is #include_next.
+  bool IsNext;
+  // Whether only comments and other such inclusions precede the directive.
+  bool IsLeading;
+};
+
+// Finds the include directives of a file with a scan over its bytes, without
+// lexing tokens or preprocessing. Lines continued with a backslash are
+// spliced first. Comments and literals are skipped, but conditional
+// directives are not evaluated, so every branch contributes.
+void ScanInclusions(StringRef buffer,
+  std::vector<ScannedInclusion> &inclusions);
+
+// Returns whether the file starts with "#pragma once" or with an #ifndef and
+// #define pair on the same macro. The matching #endif is assumed to close the
+// file.
+bool HasIncludeGuard(StringRef buffer);
+
+// A directory angled includes are searched in.
+struct AngledDirectory {
+  std::string Path;
+  bool IsSystem;
+};
+
+// Returns the directories angled includes are searched in under the
+// arguments of a compile command for mainPath, in the order they are
+// searched, with the default system directories the driver adds for the
+// target. Relative directories are made absolute against directory. Empty
+// if the driver makes no frontend command.
+std::vector<AngledDirectory> GetAngledDirectories(StringRef directory,
+  std::vector<std::string> args,
+  StringRef mainPath);
+
+// Builds the file inclusion graph of TUs without parsing them. Files are
+// scanned at most once per scanner, however many TUs include them, and the
+// scanner may be shared by several threads.
+//
+// Quoted includes are resolved against the -iquote options of the compile
+// command, and angled ones against the directories the driver makes of it,
+// which the scanner asks for once per configuration. As with the
+// preprocessor, #include_next searches the directories after the one its
+// file was found in.
+class InclusionScanner {
+public:
+  // Adds the inclusions of every file source reaches to graph.
+  bool scanTranslationUnit(const tooling::CompileCommand &command,
+    StringRef source,
+    RelationGraph &graph);
+
+  // A leading inclusion of a main file. Path is empty if the inclusion can
+  // not be resolved.
+  struct LeadingInclusion {
+    ScannedInclusion Inclusion;
+    std::string Path;
+    bool IsSystem;
+    bool IsGuarded;
+  };
+
+  // Resolves the leading inclusions of source, in order.
+  bool scanLeadingInclusions(const tooling::CompileCommand &command,
+    StringRef source,
+    std::vector<LeadingInclusion> &inclusions);
+
+private:
+  class SearchPaths;
+
+  struct ScannedFile {
+    std::once_flag Scanned;
+    bool Readable = false;
+    bool IsGuarded = false;
+    std::vector<ScannedInclusion> Inclusions;
+  };
+
+  // Returns the file with key, scanning it if needed. Returns nullptr if the
+  // file can not be read.
+  const ScannedFile *getFile(StringRef path, const FileKeyType &key);
+
+  // Returns whether the file name exists in directory, and its path if so.
+  bool lookupFile(StringRef directory, StringRef fileName, std::string &path);
+
+  // Returns the angled directories of the compile command of mainPath.
+  std::vector<AngledDirectory> getAngledDirectories(
+    const tooling::CompileCommand &command,
+    StringRef mainPath);
+
+  std::mutex mFilesMutex;
+  std::map<FileKeyType, ScannedFile> mFiles;
+  std::mutex mLookupsMutex;
+  llvm::StringMap<std::string> mLookups;
+  std::mutex mAngledDirectoriesMutex;
+  llvm::StringMap<std::vector<AngledDirectory>> mAngledDirectories;
+};
+
+} // namespace closure
+} // namespace clang
+
+#endif
@@ -0,0 +1,359 @@
+#include "IndexCache.h"
+#include "FileWriting.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <map>
+#include <tuple>
+
+namespace clang {
+namespace closure {
+
+static const char *EntrySignature = "clang-closure-index 2";
+
+void InputFilesRecordingAction::EndSourceFileAction() {
+  CompilerInstance &CI = getCompilerInstance();
+  for (auto iter = CI.getSourceManager().fileinfo_begin(),
+    end = CI.getSourceManager().fileinfo_end(); iter != end; ++iter) {
+    llvm::SmallString<256> path(iter->first->getName());
+    CI.getFileManager().makeAbsolutePath(path);
+    mInputFiles.push_back(path.str().str());
+  }
+  WrapperFrontendAction::EndSourceFileAction();
+}
+
+static std::string HashToString(llvm::MD5 &hash) {
+  llvm::MD5::MD5Result result;
+  hash.final(result);
+  llvm::SmallString<32> hex;
+  llvm::MD5::stringifyResult(result, hex);
+  return hex.str();
+}
+
+static std::vector<std::string> SortInputFiles(
+  ArrayRef<std::string> inputFiles) {
+  std::vector<std::string> r(inputFiles.begin(), inputFiles.end());
+  std::sort(r.begin(), r.end());
+  r.erase(std::unique(r.begin(), r.end()), r.end());
+  return r;
+}
+
+std::string IndexCache::getEntryPath(
+  const tooling::CompilationDatabase &compilations,
+  StringRef file,
+  StringRef kind) const {
+  llvm::MD5 hash;
+  hash.update(file);
+  for (const tooling::CompileCommand &command
+    : compilations.getCompileCommands(file)) {
+    hash.update(StringRef("", 1));
+    hash.update(command.Directory);
+    for (const std::string &arg : command.CommandLine) {
+      hash.update(StringRef("", 1));
+      hash.update(arg);
+    }
+  }
+
+  llvm::SmallString<256> path(mDirectory);
+  llvm::sys::path::append(path, HashToString(hash) + "." + kind.str());
+  return path.str();
+}
+
+std::string IndexCache::getContentHash(StringRef file) {
+  {
+    std::lock_guard<std::mutex> lock(mHashesMutex);
+    auto iter = mHashes.find(file);
+    if (iter != mHashes.end())
+      return iter->second;
+  }
+
+  std::string r;
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer
+    = llvm::MemoryBuffer::getFile(file);
+  if (buffer) {
+    llvm::MD5 hash;
+    hash.update((*buffer)->getBuffer());
+    r = HashToString(hash);
+  }
+
+  std::lock_guard<std::mutex> lock(mHashesMutex);
+  mHashes[file] = r;
+  return r;
+}
+
+bool IndexCache::readEntry(StringRef path,
+  std::unique_ptr<llvm::MemoryBuffer> &buffer,
+  std::vector<StringRef> &inputFiles,
+  std::vector<StringRef> &records) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> r
+    = llvm::MemoryBuffer::getFile(path);
+  if (!r)
+    return false;
+  buffer = std::move(*r);
+
+  llvm::line_iterator line(*buffer), end;
+  if (line == end || *line != EntrySignature)
+    return false;
+
+  for (++line; line != end; ++line) {
+    StringRef tag, rest;
+    std::tie(tag, rest) = line->split(' ');
+    if (tag != "input") {
+      records.push_back(*line);
+      continue;
+    }
+
+    StringRef hash, file;
+    std::tie(hash, file) = rest.split(' ');
+    if (hash.empty() || file.empty() || getContentHash(file) != hash)
+      return false;
+    inputFiles.push_back(file);
+  }
+  return true;
+}
+
+void IndexCache::writeEntry(StringRef path,
+  ArrayRef<std::string> inputFiles,
+  StringRef records) {
+  std::string entry;
+  llvm::raw_string_ostream os(entry);
+  os << EntrySignature << "\n";
+  for (const std::string &file : inputFiles) {
+    // Inputs which can not be read back, such as virtual files, make the
+    // entry impossible to validate.
+    std::string hash = getContentHash(file);
+    if (hash.empty())
+      return;
+    os << "input " << hash << " " << file << "\n";
+  }
+  os << records;
+  os.flush();
+
+  if (llvm::sys::fs::create_directories(mDirectory))
+    return;
+
+  // An entry which can not be written is only a miss of a later run.
+  std::string error;
+  WriteFileAtomically(path, entry, error);
+}
+
+bool ReadRelationRecords(ArrayRef<StringRef> records,
+  ArrayRef<FileKeyType> ids,
+  RelationGraph &graph) {
+  auto parseFile = [&](StringRef s, FileKeyType &id) {
+    size_t index;
+    if (s.getAsInteger(10, index) || index >= ids.size())
+      return false;
+    id = ids[index];
+    return true;
+  };
+
+  RelationGraph loaded;
+  SymbolNode *currentSymbol = nullptr;
+  for (StringRef record : records) {
+    StringRef tag, rest, first, second;
+    std::tie(tag, rest) = record.split(' ');
+    std::tie(first, second) = rest.split(' ');
+    FileKeyType id, other;
+
+    if (tag == "file") {
+      if (!parseFile(first, id))
+        return false;
+      loaded.getFiles().insert(std::make_pair(id, FileNode(second)));
+    }
+    else if (tag == "inclusion") {
+      if (!parseFile(first, id) || !parseFile(second, other))
+        return false;
+      auto iter = loaded.getFiles().find(id);
+      if (iter == loaded.getFiles().end())
+        return false;
+      iter->second.appendInclusion(other);
+    }
+    else if (tag == "system") {
+      if (!parseFile(first, id))
+        return false;
+      loaded.getSystemHeadersInMainFiles().insert(id);
+    }
+    else if (tag == "symbol") {
+      if (!parseFile(first, id))
+        return false;
+      currentSymbol = &loaded.getSymbols().insert(std::make_pair(
+        second.str(), SymbolNode(id))).first->second;
+    }
+    else if (tag == "extent") {
+      StringRef last, flagsText;
+      std::tie(last, flagsText) = second.split(' ');
+      unsigned begin, end, flags;
+      if (!currentSymbol || first.getAsInteger(10, begin)
+        || last.getAsInteger(10, end) || flagsText.getAsInteger(10, flags))
+        return false;
+      currentSymbol->setExtent(begin, end, flags);
+    }
+    else if (tag == "dependency") {
+      if (!currentSymbol)
+        return false;
+      currentSymbol->appendDependency(rest.str());
+    }
+    else {
+      return false;
+    }
+  }
+
+  graph.merge(loaded);
+  return true;
+}
+
+bool WriteRelationRecords(const RelationGraph &graph,
+  const std::map<FileKeyType, size_t> &indices,
+  llvm::raw_ostream &os) {
+  auto writeFile = [&](const FileKeyType &id) {
+    auto iter = indices.find(id);
+    if (iter == indices.end())
+      return false;
+    os << iter->second;
+    return true;
+  };
+
+  const FilesMapType &files = graph.getFiles();
+  for (auto iter = files.begin(); iter != files.end(); ++iter) {
+    os << "file ";
+    if (!writeFile(iter->first))
+      return false;
+    os << " " << iter->second.getFileName() << "\n";
+  }
+  for (auto iter = files.begin(); iter != files.end(); ++iter) {
+    for (size_t i = 0, count = iter->second.getInclusionsCount();
+      i != count;
+      ++i) {
+      os << "inclusion ";
+      writeFile(iter->first);
+      os << " ";
+      if (!writeFile(iter->second.getInclusion(i)))
+        return false;
+      os << "\n";
+    }
+  }
+  for (const FileKeyType &id : graph.getSystemHeadersInMainFiles()) {
+    os << "system ";
+    if (!writeFile(id))
+      return false;
+    os << "\n";
+  }
+
+  const SymbolsMapType &symbols = graph.getSymbols();
+  for (auto iter = symbols.begin(); iter != symbols.end(); ++iter) {
+    os << "symbol ";
+    if (!writeFile(iter->second.getDefinitionFile()))
+      return false;
+    os << " " << iter->first << "\n";
+    if (iter->second.hasExtent()) {
+      os << "extent " << iter->second.getExtentBegin() << " "
+        << iter->second.getExtentEnd() << " "
+        << iter->second.getExtentFlags() << "\n";
+    }
+    for (size_t i = 0, count = iter->second.getDependencyCount();
+      i != count;
+      ++i)
+      os << "dependency " << iter->second.getDependency(i) << "\n";
+  }
+  return true;
+}
+
+bool IndexCache::loadRelations(
+  const tooling::CompilationDatabase &compilations,
+  StringRef file,
+  RelationGraph &graph,
+  bool headerBodies) {
+  std::unique_ptr<llvm::MemoryBuffer> buffer;
+  std::vector<StringRef> inputFiles;
+  std::vector<StringRef> records;
+  if (!readEntry(getEntryPath(compilations, file,
+    headerBodies ? "relations-headers" : "relations"),
+    buffer, inputFiles, records))
+    return false;
+
+  // Unique IDs are looked up again rather than stored, since they may change
+  // even when the content of a file does not.
+  std::vector<FileKeyType> ids(inputFiles.size());
+  for (size_t i = 0, count = inputFiles.size(); i != count; ++i) {
+    if (llvm::sys::fs::getUniqueID(inputFiles[i], ids[i]))
+      return false;
+  }
+  return ReadRelationRecords(records, ids, graph);
+}
+
+void IndexCache::storeRelations(
+  const tooling::CompilationDatabase &compilations,
+  StringRef file,
+  const RelationGraph &graph,
+  ArrayRef<std::string> inputFiles,
+  bool headerBodies) {
+  std::vector<std::string> inputs = SortInputFiles(inputFiles);
+  std::map<FileKeyType, size_t> indices;
+  for (size_t i = 0, count = inputs.size(); i != count; ++i) {
+    FileKeyType id;
+    if (!llvm::sys::fs::getUniqueID(inputs[i], id))
+      indices.insert(std::make_pair(id, i));
+  }
+
+  std::string records;
+  llvm::raw_string_ostream os(records);
+  if (!WriteRelationRecords(graph, indices, os))
+    return;
+  os.flush();
+
+  writeEntry(getEntryPath(compilations, file,
+    headerBodies ? "relations-headers" : "relations"), inputs, records);
+}
+
+bool IndexCache::loadSymbolsList(
+  const tooling::CompilationDatabase &compilations,
+  StringRef file,
+  SymbolsList &symbols) {
+  std::unique_ptr<llvm::MemoryBuffer> buffer;
+  std::vector<StringRef> inputFiles;
+  std::vector<StringRef> records;
+  if (!readEntry(getEntryPath(compilations, file, "symbols"),
+    buffer, inputFiles, records))
+    return false;
+
+  std::vector<std::pair<SymbolKind, StringRef>> loaded;
+  for (StringRef record : records) {
+    StringRef tag, rest, type, signature;
+    std::tie(tag, rest) = record.split(' ');
+    std::tie(type, signature) = rest.split(' ');
+    SymbolKind kind;
+    if (tag != "listing" || !ParseSymbolKind(type, kind))
+      return false;
+    loaded.push_back(std::make_pair(kind, signature));
+  }
+
+  for (const auto &symbol : loaded)
+    symbols.appendSymbol(symbol.first, symbol.second);
+  return true;
+}
+
+void IndexCache::storeSymbolsList(
+  const tooling::CompilationDatabase &compilations,
+  StringRef file,
+  const SymbolsList &symbols,
+  ArrayRef<std::string> inputFiles) {
+  std::string records;
+  llvm::raw_string_ostream os(records);
+  for (size_t i = 0, count = symbols.getCount(); i != count; ++i) {
+    os << "listing " << symbols.getType(i) << " "
+      << symbols.getSignature(i) << "\n";
+  }
+  os.flush();
+
+  writeEntry(getEntryPath(compilations, file, "symbols"),
+    SortInputFiles(inputFiles), records);
+}
+
+} // namespace closure
+} // namespace clang
@@ -0,0 +1,104 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_INDEX_CACHE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_INDEX_CACHE_H
+
+#include "RelationConstruction.h"
+#include "SymbolsListing.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace closure {
+
+// The text form of relations, one record per line, which refers to files by
+// their index in a table kept apart. Reading merges the records into graph;
+// ids are the keys of the files of the table. Returns false if the records
+// are malformed, or if graph has a file indices does not number.
+bool ReadRelationRecords(ArrayRef<StringRef> records,
+  ArrayRef<FileKeyType> ids,
+  RelationGraph &graph);
+bool WriteRelationRecords(const RelationGraph &graph,
+  const std::map<FileKeyType, size_t> &indices,
+  llvm::raw_ostream &os);
+
+// Wraps an action and collects the absolute names of every file its TU read.
+class InputFilesRecordingAction : public WrapperFrontendAction {
+public:
+  InputFilesRecordingAction(FrontendAction *wrappedAction,
+    std::vector<std::string> &inputFiles)
+    : WrapperFrontendAction(wrappedAction), mInputFiles(inputFiles) {}
+
+protected:
+  void EndSourceFileAction() override;
+
+private:
+  std::vector<std::string> &mInputFiles;
+};
+
+// On-disk cache of per-TU results. An entry is keyed by the compile commands
+// of the TU and is only valid while the content of every input file the TU
+// read is unchanged.
+class IndexCache {
+public:
+  explicit IndexCache(StringRef directory) : mDirectory(directory) {}
+
+  // Relations found with the bodies of header inline functions parsed are
+  // kept apart from the others.
+  bool loadRelations(const tooling::CompilationDatabase &compilations,
+    StringRef file,
+    RelationGraph &graph,
+    bool headerBodies = false);
+
+  void storeRelations(const tooling::CompilationDatabase &compilations,
+    StringRef file,
+    const RelationGraph &graph,
+    ArrayRef<std::string> inputFiles,
+    bool headerBodies = false);
+
+  bool loadSymbolsList(const tooling::CompilationDatabase &compilations,
+    StringRef file,
+    SymbolsList &symbols);
+
+  void storeSymbolsList(const tooling::CompilationDatabase &compilations,
+    StringRef file,
+    const SymbolsList &symbols,
+    ArrayRef<std::string> inputFiles);
+
+private:
+  std::string getEntryPath(const tooling::CompilationDatabase &compilations,
+    StringRef file,
+    StringRef kind) const;
+
+  // Reads the entry at path. Returns false if it is missing, malformed or
+  // any of its inputs changed; otherwise records receives its record lines,
+  // which point into buffer.
+  bool readEntry(StringRef path,
+    std::unique_ptr<llvm::MemoryBuffer> &buffer,
+    std::vector<StringRef> &inputFiles,
+    std::vector<StringRef> &records);
+
+  void writeEntry(StringRef path,
+    ArrayRef<std::string> inputFiles,
+    StringRef records);
+
+  // Returns the content hash of file, or an empty string if it can not be
+  // read. Each file is hashed at most once per run.
+  std::string getContentHash(StringRef file);
+
+  std::string mDirectory;
+  std::mutex mHashesMutex;
+  llvm::StringMap<std::string> mHashes;
+};
+
+} // namespace closure
+} // namespace clang
+
+#endif
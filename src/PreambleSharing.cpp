@@ -0,0 +1,246 @@
+#include "PreambleSharing.h"
+#include "IndexCache.h"
+#include "InclusionScanning.h"
+#include "RelationGraphBuilder.h"
+#include "TimeTracing.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Lex/Preprocessor.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <map>
+
+namespace clang {
+namespace closure {
+
+// Builds a PCH while recording the inclusions made into graph.
+class PreambleGeneratingAction : public GeneratePCHAction {
+public:
+  explicit PreambleGeneratingAction(RelationGraph &graph) : mGraph(graph) {}
+
+protected:
+  std::unique_ptr<ASTConsumer> CreateASTConsumer(
+    CompilerInstance &CI,
+    StringRef InFile) override {
+    CI.getPreprocessor().addPPCallbacks(
+      llvm::make_unique<InclusionPPCallbacks>(
+        CI.getSourceManager(),
+        mGraph.getSystemHeadersInMainFiles(),
+        mGraph.getFiles()));
+    return GeneratePCHAction::CreateASTConsumer(CI, InFile);
+  }
+
+private:
+  RelationGraph &mGraph;
+};
+
+// TUs sharing a preamble, with the compile command it is built by.
+struct PreambleBuilder::PreambleGroup {
+  std::string Directory;
+  std::vector<std::string> Arguments;
+  std::string Language;
+  std::string Text;
+  std::vector<std::string> Sources;
+};
+
+static void GetAbsolutePath(StringRef directory,
+  StringRef file,
+  llvm::SmallVectorImpl<char> &path) {
+  path.assign(file.begin(), file.end());
+  if (!llvm::sys::path::is_absolute(file)) {
+    path.assign(directory.begin(), directory.end());
+    llvm::sys::path::append(path, file);
+  }
+  llvm::sys::path::remove_dots(path, true);
+}
+
+static const char *GetHeaderLanguage(StringRef mainPath) {
+  StringRef extension = llvm::sys::path::extension(mainPath);
+  if (extension == ".c")
+    return "c-header";
+  if (extension == ".m")
+    return "objective-c-header";
+  if (extension == ".mm")
+    return "objective-c++-header";
+  return "c++-header";
+}
+
+// Returns the include directives of the prefix header, which may be empty.
+// Includes the scanner can not resolve end the prefix.
+static std::string GetPreambleText(
+  ArrayRef<InclusionScanner::LeadingInclusion> inclusions) {
+  std::string text;
+  llvm::raw_string_ostream os(text);
+  for (const InclusionScanner::LeadingInclusion &leading : inclusions) {
+    if (!leading.IsGuarded)
+      break;
+
+    // User headers are found relative to the main file, which the prefix
+    // header is not next to. System headers are included as written, so
+    // that they are still found in a system directory.
+    os << "#include ";
+    if (!leading.Path.empty() && !leading.IsSystem)
+      os << '"' << leading.Path << '"';
+    else if (leading.Inclusion.IsAngled)
+      os << '<' << leading.Inclusion.FileName << '>';
+    else
+      os << '"' << leading.Inclusion.FileName << '"';
+    os << "\n";
+  }
+  return os.str();
+}
+
+bool PreambleBuilder::buildPreamble(const PreambleGroup &group,
+  SharedPreamble &preamble) {
+  llvm::MD5 hash;
+  hash.update(group.Directory);
+  for (const std::string &arg : group.Arguments) {
+    hash.update(StringRef("", 1));
+    hash.update(arg);
+  }
+  hash.update(StringRef("", 1));
+  hash.update(group.Language);
+  hash.update(StringRef("", 1));
+  hash.update(group.Text);
+  llvm::MD5::MD5Result result;
+  hash.final(result);
+  llvm::SmallString<32> hex;
+  llvm::MD5::stringifyResult(result, hex);
+
+  llvm::SmallString<256> headerPath(mDirectory);
+  llvm::sys::fs::make_absolute(headerPath);
+  llvm::sys::path::append(headerPath, hex + ".h");
+  llvm::SmallString<256> pchPath(headerPath);
+  llvm::sys::path::replace_extension(pchPath, "pch");
+  preamble.PCHPath = pchPath.str().str();
+
+  {
+    std::error_code ec;
+    llvm::raw_fd_ostream os(headerPath, ec, llvm::sys::fs::F_None);
+    if (ec)
+      return false;
+    os << group.Text;
+  }
+
+  TimeTraceScope scope("BuildPreamble", headerPath);
+  std::vector<std::string> commandLine = group.Arguments;
+  commandLine.push_back("-x");
+  commandLine.push_back(group.Language);
+  commandLine.push_back(headerPath.str().str());
+  commandLine.push_back("-o");
+  commandLine.push_back(preamble.PCHPath);
+  if (!RunFrontendAction(group.Directory, std::move(commandLine), [&]() {
+    return new InputFilesRecordingAction(
+      new PreambleGeneratingAction(preamble.Relations),
+      preamble.InputFiles);
+  }))
+    return false;
+
+  // The prefix header is generated on every run and included by no TU.
+  FileKeyType key;
+  if (!llvm::sys::fs::getUniqueID(headerPath, key))
+    preamble.Relations.getFiles().erase(key);
+  preamble.InputFiles.erase(std::remove(preamble.InputFiles.begin(),
+    preamble.InputFiles.end(), headerPath.str().str()),
+    preamble.InputFiles.end());
+  return true;
+}
+
+bool PreambleBuilder::build(ArrayRef<std::string> sources, unsigned jobs) {
+  if (llvm::sys::fs::create_directories(mDirectory))
+    return false;
+
+  // Ordered, so that preambles are built in the same order on every run.
+  std::map<std::string, PreambleGroup> groups;
+  for (const std::string &source : sources) {
+    std::vector<tooling::CompileCommand> commands
+      = mCompilations.getCompileCommands(source);
+    if (commands.size() != 1)
+      continue;
+    const tooling::CompileCommand &command = commands.front();
+
+    std::vector<InclusionScanner::LeadingInclusion> inclusions;
+    if (!mScanner.scanLeadingInclusions(command, source, inclusions))
+      continue;
+
+    llvm::SmallString<256> mainPath;
+    GetAbsolutePath(command.Directory, source, mainPath);
+    // The source, the output and the dependency file options differ between
+    // the TUs of a group.
+    std::vector<std::string> args
+      = GetConfigurationArguments(command, mainPath);
+    const char *language = GetHeaderLanguage(mainPath);
+
+    std::string key = command.Directory;
+    for (const std::string &arg : args) {
+      key += '\0';
+      key += arg;
+    }
+    key += '\0';
+    key += language;
+
+    std::string text = GetPreambleText(inclusions);
+    if (text.empty())
+      continue;
+    key += '\0';
+    key += text;
+
+    PreambleGroup &group = groups[key];
+    if (group.Sources.empty()) {
+      group.Directory = command.Directory;
+      group.Arguments = std::move(args);
+      group.Language = language;
+      group.Text = std::move(text);
+    }
+    group.Sources.push_back(source);
+  }
+
+  std::vector<const PreambleGroup*> shared;
+  for (const auto &group : groups) {
+    if (group.second.Sources.size() >= 2)
+      shared.push_back(&group.second);
+  }
+
+  std::vector<std::unique_ptr<SharedPreamble>> preambles(shared.size());
+  std::vector<char> results(shared.size(), false);
+  auto buildGroup = [this, &shared, &preambles, &results](size_t i) {
+    preambles[i] = llvm::make_unique<SharedPreamble>();
+    results[i] = buildPreamble(*shared[i], *preambles[i]);
+  };
+  if (jobs <= 1) {
+    for (size_t i = 0, count = shared.size(); i != count; ++i)
+      buildGroup(i);
+  }
+  else {
+    llvm::ThreadPool pool(jobs);
+    for (size_t i = 0, count = shared.size(); i != count; ++i)
+      pool.async([&buildGroup, i]() { buildGroup(i); });
+    pool.wait();
+  }
+
+  // TUs whose preamble failed to build are parsed without one.
+  bool r = true;
+  for (size_t i = 0, count = shared.size(); i != count; ++i) {
+    if (!results[i]) {
+      r = false;
+      continue;
+    }
+    for (const std::string &source : shared[i]->Sources)
+      mPreamblesOfSources[source] = preambles[i].get();
+    mPreambles.push_back(std::move(preambles[i]));
+  }
+  return r;
+}
+
+const SharedPreamble *PreambleBuilder::getPreamble(StringRef source) const {
+  auto iter = mPreamblesOfSources.find(source);
+  return iter != mPreamblesOfSources.end() ? iter->second : nullptr;
+}
+
+} // namespace closure
+} // namespace clang
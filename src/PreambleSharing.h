@@ -0,0 +1,63 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_PREAMBLE_SHARING_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_PREAMBLE_SHARING_H
+
+#include "RelationConstruction.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace closure {
+
+class InclusionScanner;
+
+// A PCH of the include directives several TUs begin with.
+struct SharedPreamble {
+  std::string PCHPath;
+  // Inclusions made while building the PCH. A TU parsed on top of it still
+  // sees its own include directives, but not those inside the headers.
+  RelationGraph Relations;
+  std::vector<std::string> InputFiles;
+};
+
+// Finds TUs that begin with the same includes under the same compile
+// command, and builds the PCH of each such prefix once.
+//
+// Only includes of guarded headers are shared, so that the directives of
+// the TU itself include nothing a second time; the prefix ends at the first
+// directive which is not an include.
+class PreambleBuilder {
+public:
+  PreambleBuilder(const tooling::CompilationDatabase &compilations,
+    InclusionScanner &scanner,
+    StringRef directory)
+    : mCompilations(compilations), mScanner(scanner),
+    mDirectory(directory) {}
+
+  // Builds the PCHs into the directory on up to jobs threads. A prefix gets
+  // a PCH only if at least two of sources share it, and TUs with several
+  // compile commands are left out.
+  bool build(ArrayRef<std::string> sources, unsigned jobs);
+
+  // Returns nullptr if source has no preamble.
+  const SharedPreamble *getPreamble(StringRef source) const;
+
+private:
+  struct PreambleGroup;
+
+  bool buildPreamble(const PreambleGroup &group, SharedPreamble &preamble);
+
+  const tooling::CompilationDatabase &mCompilations;
+  InclusionScanner &mScanner;
+  std::string mDirectory;
+  std::vector<std::unique_ptr<SharedPreamble>> mPreambles;
+  llvm::StringMap<const SharedPreamble*> mPreamblesOfSources;
+};
+
+} // namespace closure
+} // namespace clang
+
+#endif
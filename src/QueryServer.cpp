@@ -0,0 +1,336 @@
+#include "QueryServer.h"
+#include "IndexCache.h"
+#include "RecordWriting.h"
+#include "RelationGraphBuilder.h"
+#include "StringPool.h"
+#include "SymbolLocating.h"
+#include "SymbolsListing.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/YAMLParser.h"
+
+namespace clang {
+namespace closure {
+
+static void IgnoreDiagnostic(const llvm::SMDiagnostic &, void *) {}
+
+// Reads a JSON object with scalar values only. JSON being a subset of YAML,
+// the YAML parser does the work.
+static bool ParseRequest(StringRef request,
+  llvm::StringMap<std::string> &fields,
+  std::string &id) {
+  llvm::SourceMgr sourceManager;
+  sourceManager.setDiagHandler(IgnoreDiagnostic);
+  llvm::yaml::Stream stream(request, sourceManager);
+  llvm::yaml::document_iterator document = stream.begin();
+  if (document == stream.end())
+    return false;
+  llvm::yaml::MappingNode *object
+    = dyn_cast_or_null<llvm::yaml::MappingNode>(document->getRoot());
+  if (!object)
+    return false;
+
+  for (llvm::yaml::KeyValueNode &field : *object) {
+    llvm::yaml::ScalarNode *key
+      = dyn_cast_or_null<llvm::yaml::ScalarNode>(field.getKey());
+    llvm::yaml::ScalarNode *value
+      = dyn_cast_or_null<llvm::yaml::ScalarNode>(field.getValue());
+    if (!key || !value)
+      return false;
+    llvm::SmallString<32> keyStorage, valueStorage;
+    StringRef name = key->getValue(keyStorage);
+    // The id is echoed as written, whether a number or a string.
+    if (name == "id")
+      id = value->getRawValue();
+    fields[name] = value->getValue(valueStorage).str();
+  }
+  return !stream.failed();
+}
+
+QueryServer::QueryServer(const tooling::CompilationDatabase &compilations,
+  ArrayRef<std::string> sources,
+  unsigned jobs,
+  IndexCache *cache)
+  : mCompilations(compilations), mSources(sources.begin(), sources.end()),
+  mJobs(jobs), mCache(cache), mVersion(0), mStringPool(new StringPool),
+  mGraph(sources), mStringPoolSize(0) {
+  mGraph.setStringPool(mStringPool.get());
+}
+
+bool QueryServer::reload() {
+  // The engine refers to the index, which is built from the graph.
+  mEngine.reset();
+  mIndex.reset();
+  mGraph = PatchableGraph(mSources);
+  mSymbolsLists.clear();
+  mResults.clear();
+  ++mVersion;
+  // Nothing refers to the strings of the old graph and lists any more.
+  mStringPool.reset(new StringPool);
+  mGraph.setStringPool(mStringPool.get());
+
+  bool r = true;
+  if (!mIndexFile.empty()) {
+    std::string error;
+    mIndex = RelationIndex::load(mIndexFile, error);
+    if (!mIndex) {
+      llvm::errs() << "Can not load " << mIndexFile << ": " << error << "\n";
+      return false;
+    }
+  }
+  else {
+    for (const std::string &source : mSources)
+      mSymbolsLists[source];
+    RelationGraphBuilder builder(mCompilations, mJobs);
+    builder.setCache(mCache);
+    builder.setSymbolsLists(&mSymbolsLists);
+    builder.setStringPool(mStringPool.get());
+    r = mGraph.build(builder);
+    mIndex = llvm::make_unique<RelationIndex>(mGraph.getGraph());
+    // TUs loaded from cache are not listed, and are listed at the first
+    // request instead, as are those without symbols.
+    for (auto iter = mSymbolsLists.begin(); iter != mSymbolsLists.end();) {
+      if (iter->second.getCount() == 0)
+        iter = mSymbolsLists.erase(iter);
+      else
+        ++iter;
+    }
+  }
+  mEngine = llvm::make_unique<ClosureEngine>(*mIndex);
+  mStringPoolSize = mStringPool->getSize();
+  return r;
+}
+
+bool QueryServer::update(ArrayRef<std::string> files,
+  std::vector<std::string> &affected) {
+  if (!mIndexFile.empty())
+    return false;
+
+  mResults.clear();
+  ++mVersion;
+  unsigned graphVersion = mGraph.getVersion();
+  RelationGraphBuilder builder(mCompilations, mJobs);
+  builder.setCache(mCache);
+  builder.setStringPool(mStringPool.get());
+  bool r = mGraph.update(builder, files, affected);
+  for (const std::string &source : affected)
+    mSymbolsLists.erase(source);
+  // Closures of the engine refer to the index of the old graph.
+  if (mGraph.getVersion() != graphVersion) {
+    mEngine.reset();
+    mIndex = llvm::make_unique<RelationIndex>(mGraph.getGraph());
+    mEngine = llvm::make_unique<ClosureEngine>(*mIndex);
+  }
+  // Strings the patches retracted stay in the pool, so once these are as
+  // many as those of the graph, the graph is built again in a new pool.
+  if (mStringPool->getSize() > 2 * mStringPoolSize)
+    r = reload() && r;
+  return r;
+}
+
+const SymbolsList *QueryServer::getSymbolsList(StringRef file) {
+  auto iter = mSymbolsLists.find(file.str());
+  if (iter != mSymbolsLists.end())
+    return &iter->second;
+
+  StringPoolScope poolScope(mStringPool.get());
+  SymbolsList &symbols = mSymbolsLists[file.str()];
+  if (!mCache || !mCache->loadSymbolsList(mCompilations, file, symbols)) {
+    std::vector<std::string> inputFiles;
+    if (!RunFrontendActionOnFile(mCompilations, file, [&]() {
+      return new InputFilesRecordingAction(
+        new SymbolsListingAction(symbols), inputFiles);
+    })) {
+      mSymbolsLists.erase(file.str());
+      return nullptr;
+    }
+    if (mCache)
+      mCache->storeSymbolsList(mCompilations, file, symbols, inputFiles);
+  }
+  return &symbols;
+}
+
+bool QueryServer::listSymbols(StringRef file, llvm::raw_ostream &result) {
+  const SymbolsList *symbols = getSymbolsList(file);
+  if (!symbols)
+    return false;
+
+  result << '[';
+  for (size_t i = 0, count = symbols->getCount(); i != count; ++i) {
+    if (i != 0)
+      result << ", ";
+    result << "{\"type\": ";
+    WriteJSONString(result, symbols->getType(i));
+    result << ", \"signature\": ";
+    WriteJSONString(result, symbols->getSignature(i));
+    result << '}';
+  }
+  result << ']';
+  return true;
+}
+
+bool QueryServer::resolveSymbol(StringRef file,
+  const SymbolSelector &selector,
+  llvm::raw_ostream &result) {
+  std::string signature;
+  if (selector.Kind == SymbolSelector::ByIndex) {
+    const SymbolsList *symbols = getSymbolsList(file);
+    if (!symbols || selector.Index < 0
+      || size_t(selector.Index) >= symbols->getCount())
+      return false;
+    signature = symbols->getSignature(selector.Index);
+  }
+  else if (selector.Kind == SymbolSelector::ByName) {
+    if (const SymbolsList *symbols = getSymbolsList(file)) {
+      for (size_t i = 0, count = symbols->getCount(); i != count; ++i) {
+        if (symbols->getSignature(i) == selector.Value) {
+          signature = selector.Value;
+          break;
+        }
+      }
+    }
+  }
+
+  if (signature.empty()
+    && !RunFrontendActionOnFile(mCompilations, file, [&]() {
+      return new SymbolLocatingAction(signature, selector);
+    }))
+    return false;
+  if (signature.empty())
+    return false;
+  WriteJSONString(result, signature);
+  return true;
+}
+
+bool QueryServer::computeClosure(StringRef signature,
+  llvm::raw_ostream &result) {
+  result << '[';
+  SymbolIndexType symbol
+    = mIndex ? mIndex->findSymbol(signature) : RelationIndex::InvalidIndex;
+  if (symbol != RelationIndex::InvalidIndex) {
+    std::vector<FileIndexType> files;
+    mEngine->getFiles(symbol, files);
+    for (size_t i = 0, count = files.size(); i != count; ++i) {
+      if (i != 0)
+        result << ", ";
+      WriteJSONString(result, mIndex->getFileName(files[i]));
+    }
+  }
+  result << ']';
+  return true;
+}
+
+std::string QueryServer::handleRequest(StringRef request) {
+  llvm::StringMap<std::string> fields;
+  std::string id = "null";
+  std::string error;
+  std::string result;
+
+  if (!ParseRequest(request, fields, id)) {
+    error = "malformed request";
+  }
+  else {
+    std::string method = fields.lookup("method");
+    std::string key = method;
+    key += '\0';
+    key += fields.lookup("file");
+    key += '\0';
+    key += fields.lookup("symbol");
+    key += '\0';
+    key += fields.lookup("signature");
+    key += '\0';
+    key += fields.lookup("name");
+    key += '\0';
+    key += fields.lookup("usr");
+
+    auto iter = mResults.find(key);
+    if (iter != mResults.end()) {
+      result = iter->second;
+    }
+    else {
+      llvm::raw_string_ostream os(result);
+      bool cached = true;
+      int index;
+      if (method == "list") {
+        if (!listSymbols(fields.lookup("file"), os))
+          error = "failed to parse the file";
+      }
+      else if (method == "resolve") {
+        SymbolSelector selector;
+        if (fields.count("usr")) {
+          selector = SymbolSelector(SymbolSelector::ByUSR,
+            fields.lookup("usr"));
+        }
+        else if (fields.count("name")) {
+          selector = SymbolSelector(SymbolSelector::ByName,
+            fields.lookup("name"));
+        }
+        else if (StringRef(fields.lookup("symbol")).getAsInteger(10, index)) {
+          error = "symbol is not an index";
+        }
+        else {
+          selector = SymbolSelector(index);
+        }
+        if (error.empty()
+          && !resolveSymbol(fields.lookup("file"), selector, os))
+          error = "symbol not found";
+      }
+      else if (method == "closure") {
+        computeClosure(fields.lookup("signature"), os);
+      }
+      else if (method == "reload") {
+        cached = false;
+        if (!reload())
+          error = "some sources failed to parse";
+        os << "true";
+      }
+      else if (method == "update") {
+        cached = false;
+        std::vector<std::string> affected;
+        if (!mIndexFile.empty())
+          error = "the graph was loaded from an index";
+        else if (!update(fields.lookup("file"), affected))
+          error = "some sources failed to parse";
+        os << '[';
+        for (size_t i = 0, count = affected.size(); i != count; ++i) {
+          if (i != 0)
+            os << ", ";
+          WriteJSONString(os, affected[i]);
+        }
+        os << ']';
+      }
+      else {
+        error = "unknown method";
+      }
+      os.flush();
+      if (error.empty() && cached)
+        mResults[key] = result;
+    }
+  }
+
+  std::string response;
+  llvm::raw_string_ostream os(response);
+  os << "{\"id\": " << id << ", \"version\": " << mVersion << ", ";
+  if (error.empty()) {
+    os << "\"result\": " << result;
+  }
+  else {
+    os << "\"error\": ";
+    WriteJSONString(os, error);
+  }
+  os << '}';
+  return os.str();
+}
+
+void QueryServer::run(std::istream &in, llvm::raw_ostream &out) {
+  std::string line;
+  while (std::getline(in, line)) {
+    if (StringRef(line).trim().empty())
+      continue;
+    out << handleRequest(line) << "\n";
+    out.flush();
+  }
+}
+
+} // namespace closure
+} // namespace clang
@@ -0,0 +1,126 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_QUERY_SERVER_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_QUERY_SERVER_H
+
+#include "ClosureComputation.h"
+#include "GraphPatching.h"
+#include "RelationConstruction.h"
+#include "RelationIndex.h"
+#include "StringPool.h"
+#include "SymbolLocating.h"
+#include "SymbolsListing.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/raw_ostream.h"
+#include <istream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace closure {
+
+class IndexCache;
+
+// Answers queries about the sources of a compilation database from a graph
+// kept in memory, so that a series of queries pays for building it once.
+//
+// Requests and responses are JSON objects, one per line:
+//   {"id": 1, "method": "list", "file": "a.cpp"}
+//   -> {"id": 1, "version": 1, "result": [{"type": "function",
+//       "signature": "_Z1fv"}]}
+//   {"id": 2, "method": "resolve", "file": "a.cpp", "symbol": 0}
+//   -> {"id": 2, "version": 1, "result": "_Z1fv"}
+// where a "name" or a "usr" may select the symbol in place of its index.
+// The graph has neither the kinds nor the order of the symbols of a file,
+// so the symbols of every TU parsed are listed along with the graph. Those
+// of other files, such as TUs loaded from the index cache, are loaded from
+// the cache if the file did not change, or listed by a parse of their own
+// at the first request. Symbols are resolved from these lists by their
+// index, and by their name if it is their signature, as for C functions.
+// Other names and USRs are resolved by a parse of the TU up to the symbol,
+// as the tool would, whose result is cached as described below.
+//   {"id": 3, "method": "closure", "signature": "_Z1fv"}
+//   -> {"id": 3, "version": 1, "result": ["/src/a.cpp", "/src/a.h"]}
+//   {"id": 4, "method": "reload"}
+//   -> {"id": 4, "version": 2, "result": true}
+//   {"id": 5, "method": "update", "file": "/src/a.h"}
+//   -> {"id": 5, "version": 3, "result": ["/src/a.cpp"]}
+// where only the TUs which see the changed file are parsed again, and the
+// result lists their sources. The graph is patched in time linear in the
+// graphs of these TUs, but the index is made again from the whole graph.
+// The graph and the lists keep their strings in a pool of the server, which
+// every reload replaces. Strings which updates retract stay in the pool, so
+// the graph is built again, in a new pool, once an update leaves the pool
+// twice as large as after the last build.
+// A request which fails is answered with an "error" string instead of a
+// result. Results are cached until the graph is reloaded or updated, which
+// bumps the version.
+class QueryServer {
+public:
+  QueryServer(const tooling::CompilationDatabase &compilations,
+    ArrayRef<std::string> sources,
+    unsigned jobs,
+    IndexCache *cache);
+
+  // Makes reload map the index at path instead of building the graph.
+  void setIndexFile(StringRef path) {
+    mIndexFile = path;
+  }
+
+  // Builds the graph of the sources again, or loads the index file, and
+  // forgets every cached result.
+  bool reload();
+
+  // Parses the TUs which see any of files again, and forgets every cached
+  // result. Their sources are added to affected. Graphs loaded from an
+  // index file can not be updated.
+  bool update(ArrayRef<std::string> files,
+    std::vector<std::string> &affected);
+
+  unsigned getVersion() const {
+    return mVersion;
+  }
+
+  // Answers requests read from in until its end.
+  void run(std::istream &in, llvm::raw_ostream &out);
+
+  // Returns the response to request, without the line break.
+  std::string handleRequest(StringRef request);
+
+private:
+  // Returns the symbols of file, listing them if needed, or null if it
+  // fails to parse.
+  const SymbolsList *getSymbolsList(StringRef file);
+
+  bool listSymbols(StringRef file, llvm::raw_ostream &result);
+  bool resolveSymbol(StringRef file,
+    const SymbolSelector &selector,
+    llvm::raw_ostream &result);
+  bool computeClosure(StringRef signature, llvm::raw_ostream &result);
+
+  const tooling::CompilationDatabase &mCompilations;
+  std::vector<std::string> mSources;
+  unsigned mJobs;
+  IndexCache *mCache;
+  std::string mIndexFile;
+  unsigned mVersion;
+  // The strings of the graph and of the lists, which must go after them.
+  std::unique_ptr<StringPool> mStringPool;
+  PatchableGraph mGraph;
+  std::unique_ptr<RelationIndex> mIndex;
+  std::unique_ptr<ClosureEngine> mEngine;
+  // The symbols of files, listed along with the graph or at the first
+  // request.
+  std::map<std::string, SymbolsList> mSymbolsLists;
+  // The size of the string pool after the graph was last built.
+  size_t mStringPoolSize;
+  // JSON text of results, by method and parameters.
+  llvm::StringMap<std::string> mResults;
+};
+
+} // namespace closure
+} // namespace clang
+
+#endif
@@ -0,0 +1,120 @@
+#include "RecordWriting.h"
+#include "RelationConstruction.h"
+#include "RelationIndex.h"
+#include "llvm/Support/Format.h"
+
+namespace clang {
+namespace closure {
+
+void WriteJSONString(llvm::raw_ostream &os, StringRef s) {
+  os << '"';
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      os << '\\' << c;
+    else if (static_cast<unsigned char>(c) < 0x20)
+      os << llvm::format("\\u%04x", c);
+    else
+      os << c;
+  }
+  os << '"';
+}
+
+void RecordWriter::writeRecord(StringRef kind,
+  std::initializer_list<std::pair<StringRef, StringRef>> fields) {
+  // Records are formatted outside of the lock.
+  std::string line;
+  llvm::raw_string_ostream os(line);
+  os << "{\"kind\": ";
+  WriteJSONString(os, kind);
+  for (const auto &field : fields) {
+    os << ", ";
+    WriteJSONString(os, field.first);
+    os << ": ";
+    WriteJSONString(os, field.second);
+  }
+  os << "}\n";
+  os.flush();
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  mBuffer += line;
+  if (mBuffer.size() >= mBufferSize) {
+    mStream << mBuffer;
+    mStream.flush();
+    mBuffer.clear();
+  }
+}
+
+void RecordWriter::flush() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mStream << mBuffer;
+  mStream.flush();
+  mBuffer.clear();
+}
+
+void RecordWriter::writeSymbol(StringRef file,
+  StringRef type,
+  StringRef signature) {
+  writeRecord("symbol",
+    { { "file", file }, { "type", type }, { "signature", signature } });
+}
+
+void RecordWriter::writeInclusion(StringRef includer, StringRef included) {
+  writeRecord("inclusion",
+    { { "includer", includer }, { "included", included } });
+}
+
+void RecordWriter::writeDependency(StringRef symbol, StringRef dependency) {
+  writeRecord("dependency",
+    { { "symbol", symbol }, { "dependency", dependency } });
+}
+
+void RecordWriter::writeSelectedSymbol(StringRef signature) {
+  writeRecord("selected", { { "signature", signature } });
+}
+
+void RecordWriter::writeClosureMember(StringRef symbol, StringRef file) {
+  writeRecord("closure", { { "symbol", symbol }, { "file", file } });
+}
+
+void RecordWriter::writeRelations(const RelationGraph &graph) {
+  const FilesMapType &files = graph.getFiles();
+  for (auto iter = files.begin(); iter != files.end(); ++iter) {
+    for (size_t i = 0, count = iter->second.getInclusionsCount();
+      i != count;
+      ++i) {
+      auto included = files.find(iter->second.getInclusion(i));
+      if (included != files.end()) {
+        writeInclusion(iter->second.getFileName(),
+          included->second.getFileName());
+      }
+    }
+  }
+
+  const SymbolsMapType &symbols = graph.getSymbols();
+  for (auto iter = symbols.begin(); iter != symbols.end(); ++iter) {
+    for (size_t i = 0, count = iter->second.getDependencyCount();
+      i != count;
+      ++i)
+      writeDependency(iter->first, iter->second.getDependency(i));
+  }
+}
+
+void RecordWriter::writeRelations(const RelationIndex &index) {
+  // Files only known by their key have no name to write.
+  for (FileIndexType i = 0, count = index.getFilesCount(); i != count; ++i) {
+    for (FileIndexType k : index.getInclusions(i)) {
+      if (!index.getFileName(k).empty())
+        writeInclusion(index.getFileName(i), index.getFileName(k));
+    }
+  }
+
+  for (SymbolIndexType i = 0, count = index.getSymbolsCount();
+    i != count;
+    ++i) {
+    for (SymbolIndexType k : index.getDependencies(i))
+      writeDependency(index.getSymbolName(i), index.getSymbolName(k));
+  }
+}
+
+} // namespace closure
+} // namespace clang
@@ -0,0 +1,72 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_RECORD_WRITING_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_RECORD_WRITING_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace clang {
+namespace closure {
+
+class RelationGraph;
+class RelationIndex;
+
+// Writes s as a quoted JSON string.
+void WriteJSONString(llvm::raw_ostream &os, StringRef s);
+
+// Writes results as newline-delimited JSON, one record per line, as they are
+// produced. Records of every thread go through one buffer, which is written
+// out in whole lines once it fills up and whenever flush is called, so lines
+// never interleave and readers see results while the run goes on.
+class RecordWriter {
+public:
+  explicit RecordWriter(llvm::raw_ostream &os, size_t bufferSize = 1 << 16)
+    : mStream(os), mBufferSize(bufferSize) {}
+
+  ~RecordWriter() {
+    flush();
+  }
+
+  // {"kind": "symbol", "file": ..., "type": ..., "signature": ...}
+  void writeSymbol(StringRef file, StringRef type, StringRef signature);
+
+  // {"kind": "inclusion", "includer": ..., "included": ...}
+  void writeInclusion(StringRef includer, StringRef included);
+
+  // {"kind": "dependency", "symbol": ..., "dependency": ...}
+  void writeDependency(StringRef symbol, StringRef dependency);
+
+  // {"kind": "selected", "signature": ...}
+  void writeSelectedSymbol(StringRef signature);
+
+  // {"kind": "closure", "symbol": ..., "file": ...}
+  void writeClosureMember(StringRef symbol, StringRef file);
+
+  // Write the inclusions and dependencies of results which were not
+  // produced by parsing, such as those loaded from the cache or an index.
+  // Like the records written during parsing, these include inclusions of
+  // system headers.
+  void writeRelations(const RelationGraph &graph);
+  void writeRelations(const RelationIndex &index);
+
+  void flush();
+
+private:
+  // Writes a record of kind with the given fields, which come in name and
+  // value pairs.
+  void writeRecord(StringRef kind,
+    std::initializer_list<std::pair<StringRef, StringRef>> fields);
+
+  llvm::raw_ostream &mStream;
+  size_t mBufferSize;
+  std::mutex mMutex;
+  std::string mBuffer;
+};
+
+} // namespace closure
+} // namespace clang
+
+#endif
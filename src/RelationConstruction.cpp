@@ -1,23 +1,39 @@
 #include "RelationConstruction.h"
-#include "clang/ASTMatchers/ASTMatchers.h"
-
-using namespace clang::ast_matchers;
+#include "RecordWriting.h"
+#include "TimeTracing.h"
+#include "clang/AST/AST.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/MultiplexConsumer.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Lex/MacroInfo.h"
+#include <algorithm>
 
 namespace clang {
 namespace closure {
 
 static FilesMapType::iterator FindOrInsert(FilesMapType &m,
   const FileEntry *file) {
-  FilesMapType::iterator iter = m.find(file->getUniqueID());
-  if (iter == m.end()) {
-    iter = m.insert(std::make_pair(
-      file->getUniqueID(),
-      FileNode(file->getName())
-      )).first;
-  }
+  // One lookup finds the node or where to insert it.
+  const FileKeyType &key = file->getUniqueID();
+  FilesMapType::iterator iter = m.lower_bound(key);
+  if (iter == m.end() || key < iter->first)
+    iter = m.insert(iter, std::make_pair(key, FileNode(file->getName())));
   return iter;
 }
 
+bool InclusionPPCallbacks::isKnownHeader(const FileKeyType &header) {
+  if (mSkippedHeaders.count(header))
+    return true;
+  if (mRecordedHeaders.count(header))
+    return false;
+  if (mKnownHeaders->contains(header, mConfiguration)) {
+    mSkippedHeaders.insert(header);
+    return true;
+  }
+  mRecordedHeaders.insert(header);
+  return false;
+}
+
 void InclusionPPCallbacks::InclusionDirective(
   SourceLocation HashLoc,
   const Token &IncludeTok,
@@ -28,6 +44,7 @@ void InclusionPPCallbacks::InclusionDirective(
   StringRef SearchPath,
   StringRef RelativePath,
   const Module *Imported) {
+  TimeTotalScope scope("InclusionPPCallbacks", mTimes);
   const FileEntry *h = mSourceManager.getFileEntryForID(
     mSourceManager.getFileID(HashLoc));
 
@@ -36,63 +53,451 @@ void InclusionPPCallbacks::InclusionDirective(
     return;
   }
 
+  if (mKnownHeaders && !mSourceManager.isInMainFile(HashLoc)
+    && isKnownHeader(h->getUniqueID()))
+    return;
+
   FilesMapType::iterator parentIter = FindOrInsert(mFiles, h);
-  FindOrInsert(mFiles, File);
-  parentIter->second.appendInclusion(File->getUniqueID());
-}
-
-class DeclRefExprHandler : public MatchFinder::MatchCallback {
-  virtual void run(const MatchFinder::MatchResult &Result) {
-    if (const DeclRefExpr *drExpr
-      = Result.Nodes.getNodeAs<DeclRefExpr>("declRefExpr")) {
-      const FunctionDecl *fd
-        = Result.Nodes.getNodeAs<FunctionDecl>("functionDecl");
-      if (fd == mFunctionDecl) {
-        const NamedDecl *foundDecl = drExpr->getFoundDecl();
-        SourceLocation location = foundDecl->getLocation();
-        if (!Result.Context->getSourceManager().isInMainFile(location)) {
-          llvm::outs() << "DeclRefExpr: " << drExpr->getDecl()->getName()
-            << " in " << fd->getName() << "\n";
-          location.print(llvm::outs(), Result.Context->getSourceManager());
-          llvm::outs() << "\n";
-        }
-      }
+  FilesMapType::iterator childIter = FindOrInsert(mFiles, File);
+  if (parentIter->second.appendInclusion(File->getUniqueID()) && mWriter) {
+    mWriter->writeInclusion(parentIter->second.getFileName(),
+      childIter->second.getFileName());
+  }
+}
+
+void InclusionPPCallbacks::EndOfMainFile() {
+  if (mKnownHeaders)
+    mKnownHeaders->insert(mRecordedHeaders, mConfiguration);
+}
+
+void MacroExpansions::append(const SourceManager &srcMgr,
+  SourceLocation loc,
+  const IdentifierInfo *name) {
+  std::pair<FileID, unsigned> decomposed = srcMgr.getDecomposedLoc(loc);
+  FileExpansionsType &expansions = mExpansions[decomposed.first];
+  FileExpansionsType::value_type expansion(decomposed.second, name);
+  if (expansions.empty() || expansions.back().first < decomposed.second) {
+    expansions.push_back(expansion);
+    return;
+  }
+  // Expansions within macro arguments may be reported late.
+  expansions.insert(std::upper_bound(expansions.begin(), expansions.end(),
+    expansion, llvm::less_first()), expansion);
+}
+
+const IdentifierInfo *MacroExpansions::find(const SourceManager &srcMgr,
+  SourceLocation loc) const {
+  std::pair<FileID, unsigned> decomposed = srcMgr.getDecomposedLoc(loc);
+  auto iter = mExpansions.find(decomposed.first);
+  if (iter == mExpansions.end())
+    return nullptr;
+  const FileExpansionsType &expansions = iter->second;
+  FileExpansionsType::value_type key(decomposed.second, nullptr);
+  auto expansion = std::lower_bound(expansions.begin(), expansions.end(),
+    key, llvm::less_first());
+  if (expansion == expansions.end() || expansion->first != decomposed.second)
+    return nullptr;
+  return expansion->second;
+}
+
+void MacroExpansions::forEachInRange(const SourceManager &srcMgr,
+  SourceRange range,
+  llvm::function_ref<void(const IdentifierInfo*)> f) const {
+  if (range.isInvalid())
+    return;
+  std::pair<FileID, unsigned> begin
+    = srcMgr.getDecomposedLoc(srcMgr.getExpansionLoc(range.getBegin()));
+  std::pair<FileID, unsigned> end = srcMgr.getDecomposedLoc(
+    srcMgr.getExpansionRange(range.getEnd()).second);
+  auto iter = mExpansions.find(begin.first);
+  if (begin.first != end.first || iter == mExpansions.end())
+    return;
+
+  const FileExpansionsType &expansions = iter->second;
+  FileExpansionsType::value_type key(begin.second, nullptr);
+  for (auto expansion = std::lower_bound(expansions.begin(),
+    expansions.end(), key, llvm::less_first());
+    expansion != expansions.end() && expansion->first <= end.second;
+    ++expansion)
+    f(expansion->second);
+}
+
+const FileEntry *MacroPPCallbacks::getDefinitionFile(
+  const MacroInfo *macro) const {
+  // Builtin macros and those of the command line are in no file.
+  SourceLocation loc = macro ? macro->getDefinitionLoc() : SourceLocation();
+  if (loc.isInvalid() || mSourceManager.isInSystemHeader(loc))
+    return nullptr;
+  return mSourceManager.getFileEntryForID(
+    mSourceManager.getFileID(mSourceManager.getExpansionLoc(loc)));
+}
+
+void MacroPPCallbacks::MacroDefined(const Token &MacroNameTok,
+  const MacroDirective *MD) {
+  const MacroInfo *macro = MD->getMacroInfo();
+  const FileEntry *file = getDefinitionFile(macro);
+  if (!file)
+    return;
+  auto r = mSymbols.insert(std::make_pair(
+    GetMacroSignature(MacroNameTok.getIdentifierInfo()->getName()),
+    SymbolNode(file->getUniqueID())));
+  if (r.second)
+    setMacroExtent(macro, r.first->second);
+}
+
+void MacroPPCallbacks::setMacroExtent(const MacroInfo *macro,
+  SymbolNode &symbol) const {
+  // The extent is made of the whole lines of the directive, from its hash
+  // to the end of its last continued line.
+  std::pair<FileID, unsigned> begin = mSourceManager.getDecomposedLoc(
+    macro->getDefinitionLoc());
+  std::pair<FileID, unsigned> end = mSourceManager.getDecomposedLoc(
+    macro->getDefinitionEndLoc());
+  if (begin.first != end.first || begin.second > end.second)
+    return;
+  bool invalid = false;
+  StringRef buffer = mSourceManager.getBufferData(begin.first, &invalid);
+  if (invalid)
+    return;
+  size_t first = buffer.rfind('\n', begin.second);
+  size_t last = buffer.find('\n', end.second);
+  symbol.setExtent(first == StringRef::npos ? 0 : first + 1,
+    last == StringRef::npos ? buffer.size() : last);
+}
+
+void MacroPPCallbacks::MacroExpands(const Token &MacroNameTok,
+  const MacroDefinition &MD,
+  SourceRange Range,
+  const MacroArgs *Args) {
+  TimeTotalScope scope("MacroPPCallbacks", mTimes);
+  const MacroInfo *macro = MD.getMacroInfo();
+  const FileEntry *file = getDefinitionFile(macro);
+  if (!file)
+    return;
+
+  const IdentifierInfo *name = MacroNameTok.getIdentifierInfo();
+  // Macros of a PCH were defined before the callbacks were added.
+  if (macro->isFromASTFile()) {
+    auto r = mSymbols.insert(std::make_pair(
+      GetMacroSignature(name->getName()), SymbolNode(file->getUniqueID())));
+    if (r.second)
+      setMacroExtent(macro, r.first->second);
+  }
+
+  SourceLocation loc = MacroNameTok.getLocation();
+  if (loc.isFileID()) {
+    mExpansions.append(mSourceManager, loc, name);
+    return;
+  }
+
+  // The name of a macro expanded by another one expands to where the name
+  // of the outermost macro is written.
+  SourceLocation outer = mSourceManager.getExpansionLoc(loc);
+  if (outer != mExpandingLocation) {
+    mExpandingLocation = outer;
+    mExpandingSymbol = nullptr;
+    if (const IdentifierInfo *outerName
+      = mExpansions.find(mSourceManager, outer)) {
+      mExpandingSignature = GetMacroSignature(outerName->getName());
+      auto iter = mSymbols.find(mExpandingSignature);
+      if (iter != mSymbols.end())
+        mExpandingSymbol = &iter->second;
     }
   }
 
-private:
-  const FunctionDecl *mFunctionDecl;
+  std::string signature = GetMacroSignature(name->getName());
+  if (!mExpandingSymbol
+    || signature == mExpandingSignature
+    || mExpandingSymbol->hasDependency(signature))
+    return;
+  if (mWriter)
+    mWriter->writeDependency(mExpandingSignature, signature);
+  mExpandingSymbol->appendDependency(signature);
+}
 
-public:
-  void setCurrentFunctionDecl(const FunctionDecl *fd) {
-    mFunctionDecl = fd;
+static bool IsSymbolDecl(const NamedDecl *d) {
+  if (isa<FunctionDecl>(d))
+    return true;
+  if (const VarDecl *vd = dyn_cast<VarDecl>(d))
+    return vd->isFileVarDecl();
+  return false;
+}
+
+bool RelationConstructionVisitor::isSymbolDefinition(
+  const NamedDecl *d) const {
+  const SourceManager &srcMgr = mContext->getSourceManager();
+  SourceLocation loc = d->getLocation();
+  if (const FunctionDecl *fd = dyn_cast<FunctionDecl>(d)) {
+    if ((!fd->doesThisDeclarationHaveABody() && !mSkippedBodies.count(fd))
+      || fd->isDependentContext())
+      return false;
+    return srcMgr.isInMainFile(loc)
+      || (mHeaderBodies && !srcMgr.isInSystemHeader(loc));
   }
-};
 
-static DeclRefExprHandler gDeclRefExprHandler;
+  if (d->isImplicit()
+    || loc.isInvalid()
+    || d->getParentFunctionOrMethod()
+    || d->getDeclContext()->isDependentContext()
+    || srcMgr.isInSystemHeader(loc))
+    return false;
+
+  if (const VarDecl *vd = dyn_cast<VarDecl>(d)) {
+    return vd->isFileVarDecl()
+      && vd->isThisDeclarationADefinition() != VarDecl::DeclarationOnly
+      && srcMgr.isInMainFile(loc);
+  }
+  if (const TagDecl *td = dyn_cast<TagDecl>(d)) {
+    // Records are keyed by their mangled name, which unnamed ones lack.
+    return td->isThisDeclarationADefinition()
+      && !td->isDependentContext()
+      && (isa<EnumDecl>(td) || td->hasNameForLinkage());
+  }
+  if (const ClassTemplateDecl *ctd = dyn_cast<ClassTemplateDecl>(d))
+    return ctd->isThisDeclarationADefinition();
+  return isa<TypedefNameDecl>(d) || isa<TypeAliasTemplateDecl>(d);
+}
+
+StringRef RelationConstructionVisitor::getSymbolSignature(
+  const NamedDecl *d) {
+  if (isa<FunctionDecl>(d)
+    && !mContext->getSourceManager().isInMainFile(d->getLocation()))
+    return mMangler.getDeclarationSignature(d);
+  return mMangler.getSignature(d);
+}
+
+SymbolsMapType::iterator RelationConstructionVisitor::insertSymbol(
+  const NamedDecl *d,
+  StringRef signature,
+  bool &inserted) {
+  inserted = false;
+  const SourceManager &srcMgr = mContext->getSourceManager();
+  const FileEntry *file = srcMgr.getFileEntryForID(
+    srcMgr.getFileID(srcMgr.getExpansionLoc(d->getLocation())));
+  if (!file || signature.empty())
+    return mSymbols.end();
+
+  auto r = mSymbols.insert(std::make_pair(signature.str(),
+    SymbolNode(file->getUniqueID())));
+  inserted = r.second;
+  if (!r.first->second.hasExtent())
+    setExtent(d, r.first->second);
+  return r.first;
+}
+
+void RelationConstructionVisitor::setExtent(const NamedDecl *d,
+  SymbolNode &symbol) {
+  // The prototype of a function whose body is skipped does not stand for
+  // its definition.
+  const FunctionDecl *fd = dyn_cast<FunctionDecl>(d);
+  if (fd && (fd->hasSkippedBody() || mSkippedBodies.count(fd)))
+    return;
+
+  const SourceManager &srcMgr = mContext->getSourceManager();
+  const LangOptions &langOpts = mContext->getLangOpts();
+  SourceRange range = d->getSourceRange();
+  if (range.isInvalid())
+    return;
+  SourceLocation begin = srcMgr.getExpansionLoc(range.getBegin());
+  SourceLocation end = Lexer::getLocForEndOfToken(
+    srcMgr.getExpansionRange(range.getEnd()).second, 0, srcMgr, langOpts);
+  SourceLocation semi = Lexer::findLocationAfterToken(end, tok::semi,
+    srcMgr, langOpts, /*SkipTrailingWhitespaceAndNewLine=*/false);
+  if (semi.isValid())
+    end = semi;
+
+  unsigned flags = 0;
+  if (fd && fd->doesThisDeclarationHaveABody())
+    flags |= SymbolNode::EF_FunctionDefinition;
+  for (const DeclContext *dc = d->getDeclContext(); dc; dc = dc->getParent()) {
+    if (isa<NamespaceDecl>(dc))
+      flags |= SymbolNode::EF_InNamespace;
+  }
 
-RelationConstructionVisitor::RelationConstructionVisitor(
-  SymbolsMapType &symbols) : mSymbols(symbols) {
-  Matcher.addMatcher(
-    functionDecl(
-      forEachDescendant(
-        declRefExpr().bind("declRefExpr"))).bind("functionDecl"),
-    &gDeclRefExprHandler);
+  std::pair<FileID, unsigned> first = srcMgr.getDecomposedLoc(begin);
+  std::pair<FileID, unsigned> last = srcMgr.getDecomposedLoc(end);
+  if (first.first == last.first && first.second < last.second)
+    symbol.setExtent(first.second, last.second, flags);
 }
 
-bool RelationConstructionVisitor::VisitFunctionDecl(FunctionDecl *fd) {
-  if (mContext->getSourceManager().isInMainFile(fd->getLocation())
-    && fd->hasBody()) {
-    Stmt *body = fd->getBody();
-    llvm::outs() << "Function: " << fd->getName() << "\n";
-    gDeclRefExprHandler.setCurrentFunctionDecl(fd);
-    Matcher.matchAST(*mContext);
-    llvm::outs() << "Function END.\n";
+bool RelationConstructionVisitor::traverseSymbol(
+  SymbolsMapType::value_type *symbol,
+  SourceRange range,
+  llvm::function_ref<bool()> traverse) {
+  SymbolNode *savedSymbol = mCurrentSymbol;
+  const SymbolKeyType *savedSignature = mCurrentSignature;
+  llvm::SmallPtrSet<const void*, 16> savedDependencies;
+  savedDependencies.swap(mCurrentDependencies);
+  mCurrentSymbol = symbol ? &symbol->second : nullptr;
+  mCurrentSignature = symbol ? &symbol->first : nullptr;
+
+  if (symbol && mMacroExpansions) {
+    mMacroExpansions->forEachInRange(mContext->getSourceManager(), range,
+      [this](const IdentifierInfo *name) {
+        if (mCurrentDependencies.insert(name).second)
+          addDependency(GetMacroSignature(name->getName()), nullptr);
+      });
   }
+  bool r = traverse();
+
+  mCurrentSymbol = savedSymbol;
+  mCurrentSignature = savedSignature;
+  mCurrentDependencies.swap(savedDependencies);
+  return r;
+}
+
+bool RelationConstructionVisitor::TraverseDecl(Decl *d) {
+  NamedDecl *nd = dyn_cast_or_null<NamedDecl>(d);
+  if (!nd || !isSymbolDefinition(nd))
+    return BaseType::TraverseDecl(d);
+
+  bool inserted;
+  SymbolsMapType::iterator iter
+    = insertSymbol(nd, getSymbolSignature(nd), inserted);
+  if (iter == mSymbols.end())
+    return BaseType::TraverseDecl(d);
+
+  // A definition nested in another one can not be extracted without it.
+  if (mCurrentSymbol && mCurrentDependencies.insert(nd->getCanonicalDecl())
+    .second)
+    addDependency(iter->first, nd);
+
+  // A function whose body is skipped is recorded without dependencies.
+  FunctionDecl *fd = dyn_cast<FunctionDecl>(nd);
+  bool skipped = fd && mSkippedBodies.count(fd);
+  return traverseSymbol(skipped ? nullptr : &*iter, nd->getSourceRange(),
+    [this, d]() { return BaseType::TraverseDecl(d); });
+}
+
+bool RelationConstructionVisitor::shouldSkipFunctionBody(Decl *d) {
+  // Dependencies are only recorded in the functions of the main file, and
+  // in those of headers if asked to.
+  FunctionDecl *fd = dyn_cast<FunctionDecl>(d);
+  if (!fd || fd->isDependentContext())
+    return true;
+  const SourceManager &srcMgr = mContext->getSourceManager();
+  if (!srcMgr.isInMainFile(fd->getLocation()))
+    return !mHeaderBodies || srcMgr.isInSystemHeader(fd->getLocation());
+
+  std::string signature = mMangler.getSignature(fd).str();
+  if (!mBodies || mBodies->count(signature))
+    return false;
+  mSkippedBodies.insert(fd);
+  if (mSkippedSignatures)
+    mSkippedSignatures->insert(signature);
+  return true;
+}
+
+void RelationConstructionVisitor::addDependency(StringRef signature,
+  const NamedDecl *d) {
+  if (signature.empty() || signature == *mCurrentSignature)
+    return;
+  if (mWriter)
+    mWriter->writeDependency(*mCurrentSignature, signature);
+  if (mIdentifiers && d && d->getIdentifier())
+    (*mIdentifiers)[signature] = d->getName();
+  mCurrentSymbol->appendDependency(signature.str());
+}
+
+void RelationConstructionVisitor::addReference(const NamedDecl *d) {
+  if (!mCurrentSymbol
+    || !mCurrentDependencies.insert(d->getCanonicalDecl()).second)
+    return;
+
+  // A name of a type refers to its definition, if there is one.
+  const NamedDecl *definition = d;
+  if (const TagDecl *td = dyn_cast<TagDecl>(d)) {
+    definition = td->getDefinition();
+  }
+  else if (const ClassTemplateDecl *ctd = dyn_cast<ClassTemplateDecl>(d)) {
+    const CXXRecordDecl *rd = ctd->getTemplatedDecl()->getDefinition();
+    definition = rd ? rd->getDescribedClassTemplate() : nullptr;
+  }
+
+  if (!definition) {
+    addDeclarationReference(d);
+    return;
+  }
+  if (!isSymbolDefinition(definition))
+    return;
+
+  StringRef signature = mMangler.getSignature(definition);
+  addDependency(signature, definition);
+  // The consumer is not handed the declarations of a PCH, so their symbols
+  // are recorded once referenced.
+  bool inserted;
+  SymbolsMapType::iterator iter = definition->isFromASTFile()
+    ? insertSymbol(definition, signature, inserted) : mSymbols.end();
+  if (iter != mSymbols.end() && inserted) {
+    NamedDecl *nd = const_cast<NamedDecl*>(definition);
+    traverseSymbol(&*iter, nd->getSourceRange(),
+      [this, nd]() { return BaseType::TraverseDecl(nd); });
+  }
+}
+
+void RelationConstructionVisitor::addDeclarationReference(
+  const NamedDecl *d) {
+  const SourceManager &srcMgr = mContext->getSourceManager();
+  SourceLocation loc = d->getLocation();
+  if (loc.isInvalid()
+    || srcMgr.isInMainFile(loc)
+    || srcMgr.isInSystemHeader(loc))
+    return;
+
+  bool inserted;
+  SymbolsMapType::iterator iter
+    = insertSymbol(d, mMangler.getDeclarationSignature(d), inserted);
+  if (iter == mSymbols.end())
+    return;
+  addDependency(iter->first, d);
+  if (!inserted)
+    return;
+
+  const DeclaratorDecl *dd = dyn_cast<DeclaratorDecl>(d);
+  TypeSourceInfo *type = dd ? dd->getTypeSourceInfo() : nullptr;
+  traverseSymbol(&*iter, d->getSourceRange(), [this, type]() {
+    return !type || TraverseTypeLoc(type->getTypeLoc());
+  });
+}
+
+bool RelationConstructionVisitor::VisitDeclRefExpr(DeclRefExpr *expr) {
+  if (!mCurrentSymbol)
+    return true;
+
+  const ValueDecl *d = expr->getDecl();
+  if (const EnumConstantDecl *ecd = dyn_cast<EnumConstantDecl>(d)) {
+    addReference(cast<EnumDecl>(ecd->getDeclContext()));
+    return true;
+  }
+  if (!IsSymbolDecl(d)
+    || !mCurrentDependencies.insert(d->getCanonicalDecl()).second)
+    return true;
+
+  addDependency(mMangler.getSignature(d), d);
+  addDeclarationReference(d);
+  return true;
+}
+
+bool RelationConstructionVisitor::VisitTagTypeLoc(TagTypeLoc tl) {
+  addReference(tl.getDecl());
+  return true;
+}
+
+bool RelationConstructionVisitor::VisitTypedefTypeLoc(TypedefTypeLoc tl) {
+  addReference(tl.getTypedefNameDecl());
+  return true;
+}
+
+bool RelationConstructionVisitor::VisitTemplateSpecializationTypeLoc(
+  TemplateSpecializationTypeLoc tl) {
+  if (TemplateDecl *td = tl.getTypePtr()->getTemplateName()
+    .getAsTemplateDecl())
+    addReference(td);
   return true;
 }
 
 bool RelationConstructionConsumer::HandleTopLevelDecl(DeclGroupRef DR) {
+  TimeTotalScope scope("RelationConstructionVisitor", mTimes);
   for (DeclGroupRef::iterator b = DR.begin(), e = DR.end(); b != e; ++b)
     mVisitor.TraverseDecl(*b);
   return true;
@@ -102,5 +507,101 @@ void RelationConstructionConsumer::Initialize(ASTContext &Context) {
   mVisitor.SetASTContext(&Context);
 }
 
+void RelationGraph::merge(const RelationGraph &other) {
+  mSystemHeadersInMainFiles.insert(other.mSystemHeadersInMainFiles.begin(),
+    other.mSystemHeadersInMainFiles.end());
+
+  for (auto iter = other.mFiles.begin(); iter != other.mFiles.end(); ++iter) {
+    auto r = mFiles.insert(*iter);
+    if (r.second)
+      continue;
+    FileNode &node = r.first->second;
+    for (size_t i = 0, count = iter->second.getInclusionsCount();
+      i != count;
+      ++i)
+      node.appendInclusion(iter->second.getInclusion(i));
+  }
+
+  for (auto iter = other.mSymbols.begin(); iter != other.mSymbols.end();
+    ++iter) {
+    auto r = mSymbols.insert(*iter);
+    if (r.second)
+      continue;
+    SymbolNode &node = r.first->second;
+    if (!node.hasExtent() && iter->second.hasExtent()) {
+      node.setExtent(iter->second.getExtentBegin(),
+        iter->second.getExtentEnd(), iter->second.getExtentFlags());
+    }
+    for (size_t i = 0, count = iter->second.getDependencyCount();
+      i != count;
+      ++i) {
+      // Dependencies of other are interned already.
+      StringRef k = iter->second.getDependency(i);
+      if (!node.hasDependency(k))
+        node.mDependencies.push_back(k);
+    }
+  }
+}
+
+// Leaves the choice of the bodies to skip to relation construction, since
+// the consumers it is multiplexed with need no bodies.
+class BodySkippingMultiplexConsumer : public MultiplexConsumer {
+public:
+  BodySkippingMultiplexConsumer(RelationConstructionConsumer *relations,
+    std::vector<std::unique_ptr<ASTConsumer>> consumers)
+    : MultiplexConsumer(std::move(consumers)), mRelations(relations) {}
+
+  bool shouldSkipFunctionBody(Decl *D) override {
+    return mRelations->shouldSkipFunctionBody(D);
+  }
+
+private:
+  RelationConstructionConsumer *mRelations;
+};
+
+std::unique_ptr<ASTConsumer> RelationConstructionAction::CreateASTConsumer(
+  CompilerInstance &CI,
+  StringRef InFile) {
+  // The main file gets a node even if it includes nothing, since it is the
+  // definition file of the symbols found in it.
+  SourceManager &srcMgr = CI.getSourceManager();
+  if (const FileEntry *file = srcMgr.getFileEntryForID(srcMgr.getMainFileID()))
+    FindOrInsert(mGraph.getFiles(), file);
+
+  Preprocessor &pp = CI.getPreprocessor();
+  pp.addPPCallbacks(llvm::make_unique<InclusionPPCallbacks>(
+    CI.getSourceManager(),
+    mGraph.getSystemHeadersInMainFiles(),
+    mGraph.getFiles(),
+    mWriter,
+    mKnownHeaders,
+    mConfiguration));
+  mMacroExpansions.clear();
+  pp.addPPCallbacks(llvm::make_unique<MacroPPCallbacks>(
+    CI.getSourceManager(),
+    mGraph.getSymbols(),
+    mMacroExpansions,
+    mWriter));
+  std::unique_ptr<RelationConstructionConsumer> consumer
+    = llvm::make_unique<RelationConstructionConsumer>(mGraph.getSymbols(),
+      &mMangler, mWriter);
+  // Bodies the consumer has no use for are skipped.
+  CI.getFrontendOpts().SkipFunctionBodies = true;
+  consumer->setFunctionBodies(mBodies);
+  consumer->setSkippedBodies(mSkippedBodies);
+  consumer->setHeaderFunctionBodies(mHeaderBodies);
+  consumer->setDependencyIdentifiers(mIdentifiers);
+  consumer->setMacroExpansions(&mMacroExpansions);
+  if (!mExtraConsumer)
+    return std::move(consumer);
+
+  RelationConstructionConsumer *relations = consumer.get();
+  std::vector<std::unique_ptr<ASTConsumer>> consumers;
+  consumers.push_back(std::move(consumer));
+  consumers.push_back(std::move(mExtraConsumer));
+  return llvm::make_unique<BodySkippingMultiplexConsumer>(relations,
+    std::move(consumers));
+}
+
 } // namespace closure
 } // namespace clang
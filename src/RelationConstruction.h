@@ -1,30 +1,49 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_RELATION_CONSTRUCTION_H
 #define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_RELATION_CONSTRUCTION_H
 
+#include "StringPool.h"
+#include "SymbolMangling.h"
+#include "TimeTracing.h"
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/RecursiveASTVisitor.h"
-#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/Frontend/FrontendAction.h"
 #include "clang/Lex/Preprocessor.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Support/FileSystem.h"
+#include <algorithm>
+#include <memory>
 #include <map>
+#include <mutex>
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace clang {
 namespace closure {
 
+class RecordWriter;
+
 typedef llvm::sys::fs::UniqueID FileKeyType;
 typedef std::set<FileKeyType> FilesSetType;
 class FileNode;
 typedef std::map<FileKeyType, FileNode> FilesMapType;
 typedef std::string SymbolKeyType;
 class SymbolNode;
+// Nodes are not allocated from an arena: graphs of TUs are merged, and
+// patched graphs retract nodes one by one, so an arena would keep every node
+// a graph ever had until the graph is gone. Their strings are pooled
+// instead, which is most of what they would allocate.
 typedef std::map<SymbolKeyType, SymbolNode> SymbolsMapType;
 
+// The name of a file node is interned, since the same headers are seen by
+// most TUs.
 class FileNode {
 public:
-  FileNode(StringRef fileName) : mFileName(fileName) {}
+  FileNode(StringRef fileName) : mFileName(InternString(fileName)) {}
 
   StringRef getFileName() const {
     return mFileName;
@@ -38,24 +57,74 @@ public:
     return mInclusions.size();
   }
 
-  void appendInclusion(const FileKeyType &id) {
-    mInclusions.push_back(id);
+  bool hasInclusion(const FileKeyType &id) const {
+    return mInclusions.count(id);
+  }
+
+  // Appends id unless it is already there. Returns whether it was appended.
+  bool appendInclusion(const FileKeyType &id) {
+    return mInclusions.insert(id);
+  }
+
+  void removeInclusion(const FileKeyType &id) {
+    mInclusions.remove(id);
   }
 
 private:
-  typedef std::vector<FileKeyType> InclusionsType;
-  std::string mFileName;
+  // Each edge is kept once, however many TUs see it, in the order it was
+  // first seen.
+  typedef llvm::SetVector<FileKeyType, std::vector<FileKeyType>,
+    FilesSetType> InclusionsType;
+  StringRef mFileName;
   InclusionsType mInclusions;
 };
 
+// The headers whose inclusions a TU of a build already recorded, so that the
+// TUs parsed later skip them. A header is known once the TU which recorded
+// it ends, so that its inclusions are complete. Headers are known per
+// configuration, a hash of the compile arguments of the TU, since a header
+// may include other files under other macros or search paths: only TUs
+// configured alike skip it.
+class KnownHeaders {
+public:
+  bool contains(const FileKeyType &header, size_t configuration) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mHeaders.count(std::make_pair(header, configuration));
+  }
+
+  void insert(const FilesSetType &headers, size_t configuration) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (const FileKeyType &header : headers)
+      mHeaders.insert(std::make_pair(header, configuration));
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mHeaders.clear();
+  }
+
+private:
+  mutable std::mutex mMutex;
+  std::set<std::pair<FileKeyType, size_t>> mHeaders;
+};
+
 class InclusionPPCallbacks : public PPCallbacks {
 public:
+  // Every inclusion new to files is also written to writer, if given. The
+  // inclusions of headers in knownHeaders under configuration are skipped,
+  // if given, and the headers this TU records are added to it once it ends.
   InclusionPPCallbacks(SourceManager &srcMgr,
     FilesSetType &filesSet,
-    FilesMapType &files)
+    FilesMapType &files,
+    RecordWriter *writer = nullptr,
+    KnownHeaders *knownHeaders = nullptr,
+    size_t configuration = 0)
     : mSourceManager(srcMgr),
     mSystemHeadersInMainFiles(filesSet),
-    mFiles(files) {}
+    mFiles(files),
+    mWriter(writer),
+    mKnownHeaders(knownHeaders),
+    mConfiguration(configuration) {}
 
   virtual void InclusionDirective(
     SourceLocation HashLoc,
@@ -68,64 +137,459 @@ public:
     StringRef RelativePath,
     const Module *Imported) override;
 
+  void EndOfMainFile() override;
+
 private:
+  // Whether the inclusions of header were recorded by another TU.
+  bool isKnownHeader(const FileKeyType &header);
+
   SourceManager &mSourceManager;
   FilesSetType &mSystemHeadersInMainFiles;
   FilesMapType &mFiles;
+  RecordWriter *mWriter;
+  KnownHeaders *mKnownHeaders;
+  size_t mConfiguration;
+  // The headers of this TU which were looked up in mKnownHeaders, whether
+  // they were found or are recorded by this TU.
+  FilesSetType mSkippedHeaders;
+  FilesSetType mRecordedHeaders;
+  // Flushed to the tracer at the end of the TU.
+  TimeTotals mTimes;
 };
 
+// Dependencies are interned, since most symbols are the dependency of many.
 class SymbolNode {
+  friend class RelationGraph;
+
 public:
-  SymbolNode(const FileKeyType &file) : mFile(file) {}
+  // What a slice needs to know of an extent besides its text.
+  enum ExtentFlags : uint8_t {
+    // The extent ends with the body of a function, so no semicolon follows.
+    EF_FunctionDefinition = 1,
+    // The declaration is in a namespace, which the extent does not include.
+    EF_InNamespace = 2
+  };
+
+  SymbolNode(const FileKeyType &file)
+    : mFile(file), mExtentBegin(0), mExtentEnd(0), mExtentFlags(0) {}
 
   size_t getDependencyCount() const {
     return mDependencies.size();
   }
 
-  const SymbolKeyType& getDependency(size_t index) const {
+  StringRef getDependency(size_t index) const {
     return mDependencies[index];
   }
 
-  void appendDependency(const SymbolKeyType &dep) {
-    mDependencies.push_back(dep);
+  bool hasDependency(StringRef dep) const {
+    return std::find(mDependencies.begin(), mDependencies.end(), dep)
+      != mDependencies.end();
+  }
+
+  void appendDependency(StringRef dep) {
+    mDependencies.push_back(InternString(dep));
+  }
+
+  void removeDependency(StringRef dep) {
+    auto iter = std::find(mDependencies.begin(), mDependencies.end(), dep);
+    if (iter != mDependencies.end())
+      mDependencies.erase(iter);
   }
 
   const FileKeyType& getDefinitionFile() const {
     return mFile;
   }
 
+  void setDefinitionFile(const FileKeyType &file) {
+    mFile = file;
+  }
+
+  // The offsets in the definition file of the source of the symbol, with
+  // the semicolon which ends it if any. Empty when it is not known, such as
+  // for functions whose bodies were skipped.
+  bool hasExtent() const {
+    return mExtentBegin != mExtentEnd;
+  }
+
+  unsigned getExtentBegin() const {
+    return mExtentBegin;
+  }
+
+  unsigned getExtentEnd() const {
+    return mExtentEnd;
+  }
+
+  // A combination of ExtentFlags.
+  unsigned getExtentFlags() const {
+    return mExtentFlags;
+  }
+
+  void setExtent(unsigned begin, unsigned end, unsigned flags = 0) {
+    mExtentBegin = begin;
+    mExtentEnd = end;
+    mExtentFlags = flags;
+  }
+
 private:
-  std::vector<SymbolKeyType> mDependencies;
+  std::vector<StringRef> mDependencies;
   FileKeyType mFile;
+  unsigned mExtentBegin;
+  unsigned mExtentEnd;
+  unsigned mExtentFlags;
+};
+
+// Locations of the expansions of the macros of the main file and of headers
+// which are not system headers, so that the declarations they are expanded
+// in can depend on them. Only expansions written in files are kept, those of
+// macros expanded by other macros being dependencies of the outer macro.
+class MacroExpansions {
+public:
+  void append(const SourceManager &srcMgr,
+    SourceLocation loc,
+    const IdentifierInfo *name);
+
+  // The name of the macro expanded at loc, if any.
+  const IdentifierInfo *find(const SourceManager &srcMgr,
+    SourceLocation loc) const;
+
+  // Calls f with the name of every macro expanded within range.
+  void forEachInRange(const SourceManager &srcMgr,
+    SourceRange range,
+    llvm::function_ref<void(const IdentifierInfo*)> f) const;
+
+  void clear() {
+    mExpansions.clear();
+  }
+
+private:
+  // Offsets in the file and names of the macros, in the order of offsets
+  // since files are lexed from start to end.
+  typedef std::vector<std::pair<unsigned, const IdentifierInfo*>>
+    FileExpansionsType;
+  std::map<FileID, FileExpansionsType> mExpansions;
+};
+
+// Records macros as symbols, defined in the file of their first definition,
+// and their expansions. A macro depends on the macros expanded by its
+// expansions.
+class MacroPPCallbacks : public PPCallbacks {
+public:
+  MacroPPCallbacks(SourceManager &srcMgr,
+    SymbolsMapType &symbols,
+    MacroExpansions &expansions,
+    RecordWriter *writer = nullptr)
+    : mSourceManager(srcMgr), mSymbols(symbols), mExpansions(expansions),
+    mWriter(writer), mExpandingSymbol(nullptr) {}
+
+  void MacroDefined(const Token &MacroNameTok,
+    const MacroDirective *MD) override;
+
+  void MacroExpands(const Token &MacroNameTok,
+    const MacroDefinition &MD,
+    SourceRange Range,
+    const MacroArgs *Args) override;
+
+private:
+  // The file of the definition of macro, if it is one of those tracked.
+  const FileEntry *getDefinitionFile(const MacroInfo *macro) const;
+
+  void setMacroExtent(const MacroInfo *macro, SymbolNode &symbol) const;
+
+  SourceManager &mSourceManager;
+  SymbolsMapType &mSymbols;
+  MacroExpansions &mExpansions;
+  RecordWriter *mWriter;
+  // The outermost macro of the expansion seen last, which is expanded at
+  // mExpandingLocation, if it is a symbol.
+  SourceLocation mExpandingLocation;
+  SymbolNode *mExpandingSymbol;
+  SymbolKeyType mExpandingSignature;
+  TimeTotals mTimes;
 };
 
+// Records the symbols of a TU and what they depend on. Symbols are
+// - the functions and variables defined in the main file,
+// - the records, enums, typedefs and templates defined in the main file or
+//   in headers other than system headers, outside function bodies,
+// - the declarations of headers which the symbols above use, keyed by
+//   getDeclarationSignature, so that the headers which declare what a
+//   function calls are part of its closure even when another file defines
+//   it; inline functions of headers are keyed the same way when their
+//   bodies are parsed,
+// - and the macros recorded by MacroPPCallbacks.
+// A symbol depends on the functions, variables and enumerators it refers to,
+// on the types it names, on the macros expanded within it and on the
+// definitions nested in it.
 class RelationConstructionVisitor
   : public RecursiveASTVisitor<RelationConstructionVisitor> {
 public:
-  RelationConstructionVisitor(SymbolsMapType &symbols);
+  // Every dependency found is also written to writer, if given.
+  RelationConstructionVisitor(SymbolsMapType &symbols,
+    SymbolMangler &mangler,
+    RecordWriter *writer = nullptr) :
+    mContext(nullptr), mSymbols(symbols), mMangler(mangler),
+    mWriter(writer), mBodies(nullptr), mSkippedSignatures(nullptr),
+    mHeaderBodies(false), mIdentifiers(nullptr), mMacroExpansions(nullptr),
+    mCurrentSymbol(nullptr), mCurrentSignature(nullptr) {}
+
+  // Tracks the symbol whose definition is being traversed, so that every
+  // dependency inside it is recorded in a single pass over the TU.
+  bool TraverseDecl(Decl *d);
+
+  // Only the bodies of the functions of the main file with a signature in
+  // bodies are parsed, if given, and those of every function of the main file
+  // otherwise. The others are still recorded as symbols, without
+  // dependencies.
+  void setFunctionBodies(const std::set<SymbolKeyType> *bodies) {
+    mBodies = bodies;
+  }
+
+  // Records the signatures of the functions whose bodies are skipped in
+  // skipped, since these are the only symbols whose dependencies depend on
+  // which bodies are parsed.
+  void setSkippedBodies(std::set<SymbolKeyType> *skipped) {
+    mSkippedSignatures = skipped;
+  }
+
+  // Parses the bodies of the inline functions of headers other than system
+  // headers too, which makes these functions symbols, so that what they use
+  // is known.
+  void setHeaderFunctionBodies(bool parse) {
+    mHeaderBodies = parse;
+  }
+
+  bool shouldSkipFunctionBody(Decl *d);
+
+  // Records the identifier every dependency is declared with in
+  // identifiers, if given, so that its definition can be looked for by name.
+  void setDependencyIdentifiers(llvm::StringMap<std::string> *identifiers) {
+    mIdentifiers = identifiers;
+  }
 
-  bool VisitFunctionDecl(FunctionDecl *fd);
+  // Symbols depend on the macros in expansions expanded within them.
+  void setMacroExpansions(const MacroExpansions *expansions) {
+    mMacroExpansions = expansions;
+  }
+
+  bool VisitDeclRefExpr(DeclRefExpr *expr);
+
+  bool VisitTagTypeLoc(TagTypeLoc tl);
+
+  bool VisitTypedefTypeLoc(TypedefTypeLoc tl);
+
+  bool VisitTemplateSpecializationTypeLoc(TemplateSpecializationTypeLoc tl);
 
   void SetASTContext(ASTContext *context) {
     mContext = context;
+    mMangler.setASTContext(*context);
   }
 
 private:
+  typedef RecursiveASTVisitor<RelationConstructionVisitor> BaseType;
+
+  // Whether d is the definition of a symbol, and its dependencies are
+  // recorded while it is traversed.
+  bool isSymbolDefinition(const NamedDecl *d) const;
+
+  // Returns the symbol with signature, which is inserted with the file of d
+  // as its definition file if there is none yet, or mSymbols.end() if d is
+  // in no file.
+  SymbolsMapType::iterator insertSymbol(const NamedDecl *d,
+    StringRef signature,
+    bool &inserted);
+
+  // Sets the extent of symbol to the source of d.
+  void setExtent(const NamedDecl *d, SymbolNode &symbol);
+
+  // The signature of the symbol d defines.
+  StringRef getSymbolSignature(const NamedDecl *d);
+
+  // Calls traverse with symbol as the current one, after adding the macros
+  // expanded within range to its dependencies. No dependency is recorded
+  // if symbol is null.
+  bool traverseSymbol(SymbolsMapType::value_type *symbol,
+    SourceRange range,
+    llvm::function_ref<bool()> traverse);
+
+  // Adds a dependency on the symbol d is, or declares.
+  void addReference(const NamedDecl *d);
+
+  // Adds a dependency on the declaration of d in a header, made a symbol
+  // which depends on the types of the declaration.
+  void addDeclarationReference(const NamedDecl *d);
+
+  // Adds a dependency of the current symbol on signature, which d, if
+  // given, is declared by.
+  void addDependency(StringRef signature, const NamedDecl *d);
+
   ASTContext *mContext;
   SymbolsMapType &mSymbols;
-  ast_matchers::MatchFinder Matcher;
+  SymbolMangler &mMangler;
+  RecordWriter *mWriter;
+  const std::set<SymbolKeyType> *mBodies;
+  std::set<SymbolKeyType> *mSkippedSignatures;
+  bool mHeaderBodies;
+  llvm::StringMap<std::string> *mIdentifiers;
+  const MacroExpansions *mMacroExpansions;
+  llvm::SmallPtrSet<const FunctionDecl*, 16> mSkippedBodies;
+  SymbolNode *mCurrentSymbol;
+  const SymbolKeyType *mCurrentSignature;
+  // Declarations and macro names the current symbol depends on.
+  llvm::SmallPtrSet<const void*, 16> mCurrentDependencies;
 };
 
 class RelationConstructionConsumer : public ASTConsumer {
 public:
-  RelationConstructionConsumer(SymbolsMapType &symbols) : mVisitor(symbols) {}
+  // Uses mangler if given, otherwise a mangler of its own.
+  RelationConstructionConsumer(SymbolsMapType &symbols,
+    SymbolMangler *mangler = nullptr,
+    RecordWriter *writer = nullptr)
+    : mOwnedMangler(mangler ? nullptr : new SymbolMangler),
+    mVisitor(symbols, mangler ? *mangler : *mOwnedMangler, writer) {}
+
+  void setFunctionBodies(const std::set<SymbolKeyType> *bodies) {
+    mVisitor.setFunctionBodies(bodies);
+  }
+
+  void setSkippedBodies(std::set<SymbolKeyType> *skipped) {
+    mVisitor.setSkippedBodies(skipped);
+  }
+
+  void setHeaderFunctionBodies(bool parse) {
+    mVisitor.setHeaderFunctionBodies(parse);
+  }
+
+  void setDependencyIdentifiers(llvm::StringMap<std::string> *identifiers) {
+    mVisitor.setDependencyIdentifiers(identifiers);
+  }
+
+  void setMacroExpansions(const MacroExpansions *expansions) {
+    mVisitor.setMacroExpansions(expansions);
+  }
 
   bool HandleTopLevelDecl(DeclGroupRef DR) override;
 
   void Initialize(ASTContext &Context) override;
 
+  bool shouldSkipFunctionBody(Decl *D) override {
+    return mVisitor.shouldSkipFunctionBody(D);
+  }
+
 private:
+  std::unique_ptr<SymbolMangler> mOwnedMangler;
   RelationConstructionVisitor mVisitor;
+  TimeTotals mTimes;
+};
+
+// Everything relation construction produces for a set of translation units.
+class RelationGraph {
+public:
+  FilesSetType& getSystemHeadersInMainFiles() {
+    return mSystemHeadersInMainFiles;
+  }
+
+  const FilesSetType& getSystemHeadersInMainFiles() const {
+    return mSystemHeadersInMainFiles;
+  }
+
+  FilesMapType& getFiles() {
+    return mFiles;
+  }
+
+  const FilesMapType& getFiles() const {
+    return mFiles;
+  }
+
+  SymbolsMapType& getSymbols() {
+    return mSymbols;
+  }
+
+  const SymbolsMapType& getSymbols() const {
+    return mSymbols;
+  }
+
+  // Adds the files, inclusions, symbols and dependencies of other which are
+  // not in this graph yet, and the extents of symbols which have none.
+  // Merging the same graphs in the same order always yields the same result.
+  void merge(const RelationGraph &other);
+
+private:
+  FilesSetType mSystemHeadersInMainFiles;
+  FilesMapType mFiles;
+  SymbolsMapType mSymbols;
+};
+
+class RelationConstructionAction : public ASTFrontendAction {
+public:
+  explicit RelationConstructionAction(RelationGraph &graph)
+    : mGraph(graph), mWriter(nullptr), mBodies(nullptr),
+    mSkippedBodies(nullptr), mHeaderBodies(false), mIdentifiers(nullptr),
+    mKnownHeaders(nullptr), mConfiguration(0) {}
+
+  // Parses only the bodies of the functions with a signature in bodies, if
+  // given. The function bodies of headers are skipped unless
+  // setHeaderFunctionBodies says otherwise.
+  void setFunctionBodies(const std::set<SymbolKeyType> *bodies) {
+    mBodies = bodies;
+  }
+
+  // Records the signatures of the functions whose bodies were skipped.
+  void setSkippedBodies(std::set<SymbolKeyType> *skipped) {
+    mSkippedBodies = skipped;
+  }
+
+  // Also parses the bodies of the inline functions of headers, which are
+  // otherwise skipped, so that what they use is known.
+  void setHeaderFunctionBodies(bool parse) {
+    mHeaderBodies = parse;
+  }
+
+  // Records the identifier of every dependency in identifiers.
+  void setDependencyIdentifiers(llvm::StringMap<std::string> *identifiers) {
+    mIdentifiers = identifiers;
+  }
+
+  // Inclusions and dependencies are also written to writer as they are
+  // found.
+  void setRecordWriter(RecordWriter *writer) {
+    mWriter = writer;
+  }
+
+  // Skips the inclusions of the headers other TUs of the build configured
+  // as configuration says recorded. The graph of the TU then lacks them, so
+  // it must not be cached.
+  void setKnownHeaders(KnownHeaders *headers, size_t configuration) {
+    mKnownHeaders = headers;
+    mConfiguration = configuration;
+  }
+
+  // The consumer sees the same AST as relation construction, so other
+  // analyses of the TU do not need a parse of their own. It should use
+  // getMangler() so that no declaration is mangled twice.
+  void setExtraConsumer(std::unique_ptr<ASTConsumer> consumer) {
+    mExtraConsumer = std::move(consumer);
+  }
+
+  SymbolMangler& getMangler() {
+    return mMangler;
+  }
+
+  std::unique_ptr<ASTConsumer> CreateASTConsumer(
+    CompilerInstance &CI,
+    StringRef InFile) override;
+
+private:
+  RelationGraph &mGraph;
+  RecordWriter *mWriter;
+  const std::set<SymbolKeyType> *mBodies;
+  std::set<SymbolKeyType> *mSkippedBodies;
+  bool mHeaderBodies;
+  llvm::StringMap<std::string> *mIdentifiers;
+  KnownHeaders *mKnownHeaders;
+  size_t mConfiguration;
+  SymbolMangler mMangler;
+  MacroExpansions mMacroExpansions;
+  std::unique_ptr<ASTConsumer> mExtraConsumer;
 };
 
 } // namespace closure
@@ -0,0 +1,636 @@
+#include "RelationGraphBuilder.h"
+#include "IndexCache.h"
+#include "InclusionScanning.h"
+#include "PreambleSharing.h"
+#include "RecordWriting.h"
+#include "StringPool.h"
+#include "SymbolPrescan.h"
+#include "SymbolLocating.h"
+#include "SymbolsListing.h"
+#include "TUScheduling.h"
+#include "TimeTracing.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Frontend/MultiplexConsumer.h"
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+namespace clang {
+namespace closure {
+
+class CallbackActionFactory : public tooling::FrontendActionFactory {
+public:
+  explicit CallbackActionFactory(llvm::function_ref<FrontendAction*()> create)
+    : mCreate(create) {}
+
+  FrontendAction *create() override {
+    return mCreate();
+  }
+
+private:
+  llvm::function_ref<FrontendAction*()> mCreate;
+};
+
+static int StaticSymbol;
+
+// Options whose value is a path, either joined to them or as the argument
+// which follows.
+static const char *PathOptions[] = {
+  "-I", "-isystem", "-iquote", "-idirafter", "-include", "-imacros",
+  "-include-pch", "-isysroot", "--sysroot=", "-F", "-o", "-MF"
+};
+
+// Options whose value is the argument which follows, but no path.
+static const char *ValueOptions[] = {
+  "-x", "-Xclang", "-Xpreprocessor", "-Xassembler", "-Xlinker", "-mllvm",
+  "-target", "-arch", "-D", "-U", "-MT", "-MQ"
+};
+
+static std::string MakeAbsolute(StringRef directory, StringRef path) {
+  if (path.empty() || llvm::sys::path::is_absolute(path))
+    return path.str();
+  llvm::SmallString<256> r(directory);
+  llvm::sys::path::append(r, path);
+  return r.str();
+}
+
+StringRef GetJoinedPathOption(StringRef argument, StringRef &path) {
+  for (const char *option : PathOptions) {
+    if (argument.startswith(option)) {
+      path = argument.drop_front(StringRef(option).size());
+      return option;
+    }
+  }
+  return StringRef();
+}
+
+std::string NormalizePath(StringRef path) {
+  llvm::SmallString<256> r(path);
+  llvm::sys::fs::make_absolute(r);
+  llvm::sys::path::remove_dots(r, /*remove_dot_dot=*/true);
+  return r.str();
+}
+
+// The driver looks inputs up before the FileManager does, against the
+// working directory of the process.
+void MakeArgumentsAbsolute(StringRef directory,
+  std::vector<std::string> &commandLine) {
+  bool isPath = false, isValue = false;
+  for (size_t i = 1, count = commandLine.size(); i != count; ++i) {
+    std::string &argument = commandLine[i];
+    if (isPath || (!isValue && !StringRef(argument).startswith("-"))) {
+      argument = MakeAbsolute(directory, argument);
+      isPath = isValue = false;
+      continue;
+    }
+    isValue = false;
+    for (const char *option : PathOptions)
+      isPath = isPath || argument == option;
+    for (const char *option : ValueOptions)
+      isValue = isValue || argument == option;
+    if (isPath || isValue)
+      continue;
+    StringRef path;
+    StringRef option = GetJoinedPathOption(argument, path);
+    if (!option.empty())
+      argument = option.str() + MakeAbsolute(directory, path);
+  }
+}
+
+std::vector<std::string> GetConfigurationArguments(
+  const tooling::CompileCommand &command,
+  StringRef file) {
+  llvm::SmallString<256> mainPath(MakeAbsolute(command.Directory, file));
+  llvm::sys::path::remove_dots(mainPath, /*remove_dot_dot=*/true);
+  std::vector<std::string> args
+    = tooling::getClangStripOutputAdjuster()(command.CommandLine, mainPath);
+  std::vector<std::string> r;
+  for (size_t i = 0; i < args.size(); ++i) {
+    StringRef arg = args[i];
+    if (i != 0 && !arg.startswith("-")) {
+      llvm::SmallString<256> path(MakeAbsolute(command.Directory, arg));
+      llvm::sys::path::remove_dots(path, /*remove_dot_dot=*/true);
+      if (path == mainPath)
+        continue;
+    }
+    if (arg == "-c" || arg == "-M" || arg == "-MM" || arg == "-MD"
+      || arg == "-MMD" || arg == "-MG" || arg == "-MP")
+      continue;
+    if (arg == "-MF" || arg == "-MT" || arg == "-MQ") {
+      ++i;
+      continue;
+    }
+    if (arg.startswith("-MF") || arg.startswith("-MT")
+      || arg.startswith("-MQ"))
+      continue;
+    r.push_back(args[i]);
+  }
+  return r;
+}
+
+bool RunFrontendAction(StringRef directory,
+  std::vector<std::string> commandLine,
+  llvm::function_ref<FrontendAction*()> create) {
+  commandLine[0]
+    = llvm::sys::fs::getMainExecutable("clang_tool", &StaticSymbol);
+  MakeArgumentsAbsolute(directory, commandLine);
+
+  // Other relative paths, such as those of include directives, are
+  // resolved against the working directory of the FileManager instead of
+  // the process one.
+  FileSystemOptions options;
+  options.WorkingDir = directory;
+  llvm::IntrusiveRefCntPtr<FileManager> files(new FileManager(options));
+
+  CallbackActionFactory factory(create);
+  tooling::ToolInvocation invocation(std::move(commandLine),
+    &factory, files.get());
+  return invocation.run();
+}
+
+bool RunFrontendActionOnFile(const tooling::CompilationDatabase &compilations,
+  StringRef file,
+  llvm::function_ref<FrontendAction*()> create,
+  ArrayRef<std::string> extraArgs) {
+  std::vector<tooling::CompileCommand> commands
+    = compilations.getCompileCommands(file);
+  if (commands.empty()) {
+    llvm::errs() << "Skipping " << file
+      << ". Compile command not found.\n";
+    return false;
+  }
+
+  tooling::ArgumentsAdjuster adjuster = tooling::combineAdjusters(
+    tooling::getClangSyntaxOnlyAdjuster(),
+    tooling::getClangStripOutputAdjuster());
+  if (!extraArgs.empty()) {
+    adjuster = tooling::combineAdjusters(adjuster,
+      tooling::getInsertArgumentAdjuster(
+        std::vector<std::string>(extraArgs.begin(), extraArgs.end()),
+        tooling::ArgumentInsertPosition::BEGIN));
+  }
+
+  bool r = true;
+  for (const tooling::CompileCommand &command : commands) {
+    TimeTraceScope scope("Frontend", file);
+    if (!RunFrontendAction(command.Directory,
+      adjuster(command.CommandLine, file), create))
+      r = false;
+  }
+  return r;
+}
+
+// Calls f with every index below count, on up to jobs threads.
+static void ForEachInParallel(unsigned jobs,
+  size_t count,
+  std::function<void(size_t)> f) {
+  if (jobs <= 1) {
+    for (size_t i = 0; i != count; ++i)
+      f(i);
+    return;
+  }
+
+  llvm::ThreadPool pool(jobs);
+  for (size_t i = 0; i != count; ++i)
+    pool.async(f, i);
+  pool.wait();
+}
+
+void RelationGraphBuilder::forEachTranslationUnit(
+  ArrayRef<std::string> sources,
+  std::function<void(size_t)> f) {
+  // Strings of the worker threads go to the pool of the builder too.
+  std::function<void(size_t)> g = [this, &f](size_t i) {
+    StringPoolScope poolScope(mStringPool);
+    f(i);
+  };
+  if (mCostModel)
+    ForEachByCost(mJobs, mCostModel->getCosts(sources), g);
+  else
+    ForEachInParallel(mJobs, sources.size(), g);
+}
+
+std::string *RelationGraphBuilder::claimSymbolLocating(StringRef source) {
+  FileKeyType key;
+  if (!mSignature || !mSignature->empty()
+    || llvm::sys::fs::getUniqueID(source, key))
+    return nullptr;
+  auto iter = mLocatingIndices.find(key);
+  if (iter == mLocatingIndices.end())
+    return nullptr;
+  std::lock_guard<std::mutex> lock(mLocatingMutex);
+  if (mLocatingClaimed[iter->second])
+    return nullptr;
+  mLocatingClaimed[iter->second] = true;
+  return &mLocatedSignatures[iter->second];
+}
+
+bool RelationGraphBuilder::finishSymbolLocating() {
+  bool r = true;
+  for (size_t i = 0, count = mLocatingFiles.size(); i != count; ++i) {
+    if (!mLocatingClaimed[i]) {
+      mLocatingClaimed[i] = true;
+      if (!RunFrontendActionOnFile(mCompilations, mLocatingFiles[i], [&]() {
+        return new SymbolLocatingAction(mLocatedSignatures[i],
+          mLocatingSelector);
+      }))
+        r = false;
+    }
+    if (!mLocatedSignatures[i].empty()) {
+      *mSignature = mLocatedSignatures[i];
+      break;
+    }
+  }
+  return r;
+}
+
+bool RelationGraphBuilder::buildTranslationUnit(StringRef source,
+  RelationGraph &shard,
+  ParseNotes *notes) {
+  TimeTraceScope scope("TranslationUnit", source);
+  bool r = buildTranslationUnitRelations(source, shard, notes);
+  if (mWriter)
+    mWriter->flush();
+  return r;
+}
+
+bool RelationGraphBuilder::buildTranslationUnitRelations(StringRef source,
+  RelationGraph &shard,
+  ParseNotes *notes) {
+  if (mScanner) {
+    std::vector<tooling::CompileCommand> commands
+      = mCompilations.getCompileCommands(source);
+    bool r = !commands.empty();
+    for (const tooling::CompileCommand &command : commands) {
+      if (!mScanner->scanTranslationUnit(command, source, shard))
+        r = false;
+    }
+    if (mWriter)
+      mWriter->writeRelations(shard);
+    return r;
+  }
+
+  if (mCache) {
+    TimeTraceScope cacheScope("LoadFromCache", source);
+    if (mCache->loadRelations(mCompilations, source, shard, mHeaderBodies)) {
+      if (mWriter)
+        mWriter->writeRelations(shard);
+      return true;
+    }
+  }
+
+  // Demand-driven builds parse the function bodies they need afterwards.
+  static const std::set<SymbolKeyType> NoBodies;
+  std::string *located = claimSymbolLocating(source);
+  std::vector<std::string> inputFiles;
+  bool r = parseTranslationUnit(source, isDemandDriven() ? &NoBodies : nullptr,
+    located, mWriter, shard, inputFiles, notes);
+
+  const SharedPreamble *preamble
+    = mPreambles ? mPreambles->getPreamble(source) : nullptr;
+  if (r && preamble) {
+    if (mWriter)
+      mWriter->writeRelations(preamble->Relations);
+    shard.merge(preamble->Relations);
+    inputFiles.insert(inputFiles.end(),
+      preamble->InputFiles.begin(), preamble->InputFiles.end());
+  }
+  if (r && mCache) {
+    TimeTraceScope cacheScope("StoreToCache", source);
+    mCache->storeRelations(mCompilations, source, shard, inputFiles,
+      mHeaderBodies);
+  }
+  return r;
+}
+
+// Hashes the directory and the configuration arguments of every compile
+// command of source.
+static size_t GetConfigurationHash(
+  const tooling::CompilationDatabase &compilations,
+  StringRef source) {
+  llvm::hash_code r = 0;
+  for (const tooling::CompileCommand &command
+    : compilations.getCompileCommands(source)) {
+    std::vector<std::string> args = GetConfigurationArguments(command, source);
+    r = llvm::hash_combine(r, command.Directory,
+      llvm::hash_combine_range(args.begin(), args.end()));
+  }
+  return r;
+}
+
+bool RelationGraphBuilder::parseTranslationUnit(StringRef source,
+  const std::set<SymbolKeyType> *bodies,
+  std::string *located,
+  RecordWriter *writer,
+  RelationGraph &shard,
+  std::vector<std::string> &inputFiles,
+  ParseNotes *notes) {
+  // The TU still sees the include directives the PCH covers, but the
+  // headers are skipped by their guards; their inclusions are recorded in
+  // the preamble instead.
+  const SharedPreamble *preamble
+    = mPreambles ? mPreambles->getPreamble(source) : nullptr;
+  std::vector<std::string> extraArgs;
+  if (preamble) {
+    extraArgs.push_back("-include-pch");
+    extraArgs.push_back(preamble->PCHPath);
+  }
+
+  // TUs share the inclusions of headers only with the TUs whose commands
+  // differ from theirs in the source and the output alone.
+  size_t configuration = 0;
+  if (!mCache && mSkipKnownHeaders)
+    configuration = GetConfigurationHash(mCompilations, source);
+
+  SymbolsList *list = nullptr;
+  if (mSymbolsLists) {
+    auto iter = mSymbolsLists->find(source);
+    if (iter != mSymbolsLists->end())
+      list = &iter->second;
+  }
+
+  // Only parses are timed, since loads from cache and scans of inclusions
+  // say nothing of what the next parse of the TU will take.
+  TUCostModel::ClockType::time_point start = TUCostModel::ClockType::now();
+  bool r = RunFrontendActionOnFile(mCompilations, source, [&]() {
+    RelationConstructionAction *action = new RelationConstructionAction(shard);
+    action->setRecordWriter(writer);
+    action->setFunctionBodies(bodies);
+    action->setHeaderFunctionBodies(mHeaderBodies);
+    // Cache entries and shards stand for their TU alone, so they need every
+    // inclusion.
+    if (!mCache && mSkipKnownHeaders)
+      action->setKnownHeaders(&mKnownHeaders, configuration);
+    if (notes) {
+      action->setSkippedBodies(&notes->SkippedBodies);
+      action->setDependencyIdentifiers(&notes->Identifiers);
+    }
+    // With several compile commands, the symbol is located and the symbols
+    // are listed in the first.
+    std::vector<std::unique_ptr<ASTConsumer>> consumers;
+    if (located && located->empty()) {
+      consumers.push_back(llvm::make_unique<SymbolLocatingConsumer>(
+        *located, mLocatingSelector, &action->getMangler()));
+    }
+    if (list && list->getCount() == 0) {
+      consumers.push_back(llvm::make_unique<SymbolsListingConsumer>(*list,
+        &action->getMangler()));
+    }
+    if (consumers.size() == 1) {
+      action->setExtraConsumer(std::move(consumers.front()));
+    }
+    else if (consumers.size() > 1) {
+      action->setExtraConsumer(
+        llvm::make_unique<MultiplexConsumer>(std::move(consumers)));
+    }
+    return new InputFilesRecordingAction(action, inputFiles);
+  }, extraArgs);
+  if (mCostModel)
+    mCostModel->record(source, TUCostModel::ClockType::now() - start);
+  return r;
+}
+
+bool RelationGraphBuilder::isStartingTranslationUnit(StringRef source) const {
+  FileKeyType key;
+  if (!mLocatingIndices.empty() && !llvm::sys::fs::getUniqueID(source, key)
+    && mLocatingIndices.count(key))
+    return true;
+  bool equivalent;
+  return !mRoots->File.empty()
+    && !llvm::sys::fs::equivalent(source, mRoots->File, equivalent)
+    && equivalent;
+}
+
+void RelationGraphBuilder::parseReachedBodies(ArrayRef<std::string> sources,
+  std::vector<RelationGraph> &shards,
+  std::vector<ParseNotes> &notes,
+  std::vector<char> &results,
+  std::vector<char> &parsedTUs) {
+  TimeTraceScope scope("ParseReachedBodies");
+
+  // The first TU to define a symbol is the one its body is parsed in, as
+  // merging keeps the definition file of the first shard.
+  llvm::StringMap<size_t> owners;
+  for (size_t i = 0, count = shards.size(); i != count; ++i) {
+    for (const auto &symbol : shards[i].getSymbols())
+      owners.insert(std::make_pair(symbol.first, i));
+  }
+
+  llvm::StringMap<size_t> sourceIndices;
+  if (mPrescanner) {
+    for (size_t i = 0, count = sources.size(); i != count; ++i)
+      sourceIndices.insert(std::make_pair(sources[i], i));
+  }
+
+  // Reached symbols, with the identifier they are declared with if known.
+  // That of a root is told from its signature, which is the identifier
+  // itself only for C names.
+  typedef std::pair<SymbolKeyType, std::string> ReachedSymbol;
+  std::vector<ReachedSymbol> worklist;
+  for (const std::string &signature : mRoots->Signatures) {
+    worklist.push_back(ReachedSymbol(signature,
+      GetSignatureIdentifier(signature)));
+  }
+  if (mRoots->IncludeLocatedSymbol && mSignature && !mSignature->empty()) {
+    worklist.push_back(ReachedSymbol(*mSignature,
+      mLocatingSelector.getIdentifier()));
+  }
+  FileKeyType rootFile;
+  if (!mRoots->File.empty()
+    && !llvm::sys::fs::getUniqueID(mRoots->File, rootFile)) {
+    for (const RelationGraph &shard : shards) {
+      for (const auto &symbol : shard.getSymbols()) {
+        if (symbol.second.getDefinitionFile() == rootFile)
+          worklist.push_back(ReachedSymbol(symbol.first, std::string()));
+      }
+    }
+  }
+
+  // Every round parses each TU which defines newly reached functions once,
+  // with the bodies of those functions only. With a prescanner, TUs which
+  // were not parsed yet are parsed for the first time if they may define a
+  // reached symbol no parsed TU defines. The dependencies of the other
+  // symbols, such as types, are known from the first parse.
+  std::set<SymbolKeyType> reached;
+  std::vector<std::set<SymbolKeyType>> bodies(shards.size());
+  while (!worklist.empty()) {
+    std::vector<size_t> tus;
+    auto request = [&](size_t tu, const SymbolKeyType &symbol) {
+      if (bodies[tu].empty())
+        tus.push_back(tu);
+      bodies[tu].insert(symbol);
+    };
+
+    for (size_t w = 0; w != worklist.size(); ++w) {
+      ReachedSymbol symbol = worklist[w];
+      if (!reached.insert(symbol.first).second)
+        continue;
+      auto owner = owners.find(symbol.first);
+      if (owner != owners.end()
+        && notes[owner->second].SkippedBodies.count(symbol.first)) {
+        request(owner->second, symbol.first);
+      }
+      else if (owner != owners.end()) {
+        const SymbolsMapType &symbols = shards[owner->second].getSymbols();
+        auto iter = symbols.find(symbol.first);
+        if (iter == symbols.end())
+          continue;
+        for (size_t i = 0, depCount = iter->second.getDependencyCount();
+          i != depCount;
+          ++i) {
+          StringRef dependency = iter->second.getDependency(i);
+          worklist.push_back(ReachedSymbol(dependency.str(),
+            notes[owner->second].Identifiers.lookup(dependency)));
+        }
+      }
+      else if (mPrescanner && !symbol.second.empty()) {
+        for (const std::string &file : mPrescanner->getFiles(symbol.second)) {
+          auto index = sourceIndices.find(file);
+          if (index != sourceIndices.end() && !parsedTUs[index->second])
+            request(index->second, symbol.first);
+        }
+      }
+      else if (mPrescanner) {
+        // Without an identifier, any TU may define the symbol.
+        for (size_t i = 0, count = sources.size(); i != count; ++i) {
+          if (!parsedTUs[i])
+            request(i, symbol.first);
+        }
+      }
+    }
+    worklist.clear();
+    std::sort(tus.begin(), tus.end());
+
+    std::vector<RelationGraph> parsed(tus.size());
+    std::vector<ParseNotes> parsedNotes(tus.size());
+    std::vector<std::string> reached;
+    for (size_t tu : tus)
+      reached.push_back(sources[tu]);
+    forEachTranslationUnit(reached, [&](size_t k) {
+      TimeTraceScope bodiesScope("FunctionBodies", reached[k]);
+      // The records of a TU parsed before are written already, but for the
+      // dependencies of the bodies parsed now, which are written below.
+      std::vector<std::string> inputFiles;
+      if (!parseTranslationUnit(reached[k], &bodies[tus[k]], nullptr,
+        parsedTUs[tus[k]] ? nullptr : mWriter, parsed[k], inputFiles,
+        &parsedNotes[k]))
+        results[tus[k]] = false;
+      if (mWriter)
+        mWriter->flush();
+    });
+
+    for (size_t k = 0, count = tus.size(); k != count; ++k) {
+      size_t tu = tus[k];
+      bool reparsed = parsedTUs[tu];
+      if (!reparsed) {
+        parsedTUs[tu] = true;
+        notes[tu] = std::move(parsedNotes[k]);
+        for (const auto &symbol : parsed[k].getSymbols())
+          owners.insert(std::make_pair(symbol.first, tu));
+        const SharedPreamble *preamble
+          = mPreambles ? mPreambles->getPreamble(sources[tu]) : nullptr;
+        if (preamble) {
+          if (mWriter)
+            mWriter->writeRelations(preamble->Relations);
+          parsed[k].merge(preamble->Relations);
+        }
+      }
+
+      for (const SymbolKeyType &symbol : bodies[tu]) {
+        auto iter = parsed[k].getSymbols().find(symbol);
+        if (iter == parsed[k].getSymbols().end())
+          continue;
+        for (size_t i = 0, depCount = iter->second.getDependencyCount();
+          i != depCount;
+          ++i) {
+          StringRef dependency = iter->second.getDependency(i);
+          if (reparsed && mWriter)
+            mWriter->writeDependency(symbol, dependency);
+          worklist.push_back(ReachedSymbol(dependency.str(),
+            parsedNotes[k].Identifiers.lookup(dependency)));
+        }
+      }
+      if (reparsed && mWriter)
+        mWriter->flush();
+      shards[tu].merge(parsed[k]);
+      bodies[tu].clear();
+    }
+  }
+}
+
+bool RelationGraphBuilder::buildShards(ArrayRef<std::string> sources,
+  std::vector<RelationGraph> &shards) {
+  mSkipKnownHeaders = false;
+  return parseShards(sources, shards);
+}
+
+bool RelationGraphBuilder::parseShards(ArrayRef<std::string> sources,
+  std::vector<RelationGraph> &shards) {
+  TimeTraceScope scope("BuildRelationGraph");
+  StringPoolScope poolScope(mStringPool);
+  shards.assign(sources.size(), RelationGraph());
+  std::vector<char> results(sources.size(), false);
+  std::vector<char> parsedTUs(sources.size(), false);
+  std::vector<ParseNotes> notes(isDemandDriven() ? sources.size() : 0);
+  // The graph of a previous build does not go into this one.
+  mKnownHeaders.clear();
+  mLocatingIndices.clear();
+  mLocatedSignatures.assign(mLocatingFiles.size(), std::string());
+  mLocatingClaimed.assign(mLocatingFiles.size(), false);
+  if (mSignature && mSignature->empty()) {
+    for (size_t i = 0, count = mLocatingFiles.size(); i != count; ++i) {
+      FileKeyType key;
+      if (!llvm::sys::fs::getUniqueID(mLocatingFiles[i], key))
+        mLocatingIndices.insert(std::make_pair(key, i));
+    }
+  }
+
+  // With a prescanner, demand-driven builds start from the TUs of the roots
+  // only, and the others are parsed once found to define a reached symbol.
+  forEachTranslationUnit(sources, [&](size_t i) {
+    if (isDemandDriven() && mPrescanner
+      && !isStartingTranslationUnit(sources[i])) {
+      results[i] = true;
+      return;
+    }
+    results[i] = buildTranslationUnit(sources[i], shards[i],
+      notes.empty() ? nullptr : &notes[i]);
+    parsedTUs[i] = true;
+  });
+
+  bool r = true;
+  if (mSignature && mSignature->empty() && !finishSymbolLocating())
+    r = false;
+
+  if (isDemandDriven())
+    parseReachedBodies(sources, shards, notes, results, parsedTUs);
+
+  for (char result : results) {
+    if (!result)
+      r = false;
+  }
+  return r;
+}
+
+bool RelationGraphBuilder::build(ArrayRef<std::string> sources,
+  RelationGraph &graph) {
+  std::vector<RelationGraph> shards;
+  mSkipKnownHeaders = true;
+  bool r = parseShards(sources, shards);
+  TimeTraceScope mergeScope("MergeShards");
+  StringPoolScope poolScope(mStringPool);
+  for (const RelationGraph &shard : shards)
+    graph.merge(shard);
+  return r;
+}
+
+} // namespace closure
+} // namespace clang
@@ -0,0 +1,261 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_RELATION_GRAPH_BUILDER_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_RELATION_GRAPH_BUILDER_H
+
+#include "RelationConstruction.h"
+#include "SymbolLocating.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace closure {
+
+class IndexCache;
+class InclusionScanner;
+class PreambleBuilder;
+class RecordWriter;
+class StringPool;
+class SymbolPrescanner;
+class SymbolsList;
+class TUCostModel;
+
+// Returns the arguments of command without file, the output and the
+// dependency file options, which are what the commands of TUs configured
+// alike share.
+std::vector<std::string> GetConfigurationArguments(
+  const tooling::CompileCommand &command,
+  StringRef file);
+
+// Returns the option whose value is a path argument starts with, and sets
+// path to the value joined to it. Empty if there is none.
+StringRef GetJoinedPathOption(StringRef argument, StringRef &path);
+
+// Makes the inputs and the paths of the options of commandLine absolute
+// against directory.
+void MakeArgumentsAbsolute(StringRef directory,
+  std::vector<std::string> &commandLine);
+
+// Returns the absolute path of path without "." and "..".
+std::string NormalizePath(StringRef path);
+
+// Runs an action returned by create on commandLine, as if from directory.
+// Unlike ClangTool::run this never changes the process working directory,
+// so it may be called from several threads at once.
+bool RunFrontendAction(StringRef directory,
+  std::vector<std::string> commandLine,
+  llvm::function_ref<FrontendAction*()> create);
+
+// Runs an action returned by create on every compile command of file, with
+// extraArgs inserted before the other arguments.
+bool RunFrontendActionOnFile(const tooling::CompilationDatabase &compilations,
+  StringRef file,
+  llvm::function_ref<FrontendAction*()> create,
+  ArrayRef<std::string> extraArgs = None);
+
+// The symbols whose closures will be computed on a graph.
+struct ClosureRoots {
+  std::vector<std::string> Signatures;
+  // Whether the symbol located during build is one of them.
+  bool IncludeLocatedSymbol = false;
+  // Every symbol defined in this file is one of them, if not empty.
+  std::string File;
+};
+
+class RelationGraphBuilder {
+public:
+  RelationGraphBuilder(const tooling::CompilationDatabase &compilations,
+    unsigned jobs)
+    : mCompilations(compilations), mJobs(jobs), mCache(nullptr),
+    mScanner(nullptr), mPreambles(nullptr), mWriter(nullptr),
+    mRoots(nullptr), mPrescanner(nullptr), mCostModel(nullptr),
+    mSymbolsLists(nullptr), mStringPool(nullptr), mHeaderBodies(false), mSkipKnownHeaders(false),
+    mSignature(nullptr) {}
+
+  // TUs whose inputs are unchanged since they were stored in cache are
+  // loaded from it instead of being parsed.
+  void setCache(IndexCache *cache) {
+    mCache = cache;
+  }
+
+  // Builds only the file inclusion graph, by scanning sources with scanner
+  // instead of parsing them. No symbols are found in this mode.
+  void setInclusionScanner(InclusionScanner *scanner) {
+    mScanner = scanner;
+  }
+
+  // TUs which have a preamble in preambles are parsed on top of its PCH.
+  void setPreambles(const PreambleBuilder *preambles) {
+    mPreambles = preambles;
+  }
+
+  // The inclusions and dependencies of every TU are also written to writer,
+  // as soon as they are found or loaded.
+  void setRecordWriter(RecordWriter *writer) {
+    mWriter = writer;
+  }
+
+  // Builds a graph only good for the closures of roots: TUs are parsed
+  // without function bodies first, and then the bodies of the functions the
+  // closures reach are parsed, until no new function is reached. Every
+  // symbol still gets its definition file, but the others lack their
+  // dependencies. Ignored with a cache, whose results must be complete.
+  void setClosureRoots(const ClosureRoots *roots) {
+    mRoots = roots;
+  }
+
+  // Makes the build with closure roots demand-driven: only the TUs of the
+  // roots are parsed at first, and the others once prescanner finds that
+  // they may define a reached symbol which no parsed TU defines. Definitions
+  // the prescan misses are not part of the closures.
+  void setPrescanner(const SymbolPrescanner *prescanner) {
+    mPrescanner = prescanner;
+  }
+
+  // TUs are started in the order of the times model predicts, longest
+  // first, and the time each parse takes is recorded to model. Loads from
+  // cache and scans of inclusions are not recorded.
+  void setCostModel(TUCostModel *model) {
+    mCostModel = model;
+  }
+
+  // Lists the symbols of every TU parsed into the list of lists named by its
+  // source, as symbols listing would, if that list is there and empty. The
+  // parse is shared with the graph. TUs loaded from cache are not listed.
+  void setSymbolsLists(std::map<std::string, SymbolsList> *lists) {
+    mSymbolsLists = lists;
+  }
+
+  // Interns the strings of the graphs and lists built in pool instead of
+  // that of the calling thread. The pool must outlive them.
+  void setStringPool(StringPool *pool) {
+    mStringPool = pool;
+  }
+
+  // Parses the bodies of the inline functions of headers too, so that the
+  // graph tells which headers these need. Results of the cache are kept
+  // apart from those of builds which skip these bodies.
+  void setHeaderFunctionBodies(bool parse) {
+    mHeaderBodies = parse;
+  }
+
+  // Locates the symbol selector selects into signature during build, unless
+  // signature is already known, from the first of files which has it. Those
+  // which are sources share the parse of their TU, so they are searched in
+  // parallel; the others are parsed for the symbol afterwards, in order,
+  // until it is found.
+  void setSymbolLocating(ArrayRef<std::string> files,
+    const SymbolSelector &selector,
+    std::string &signature) {
+    mLocatingFiles.assign(files.begin(), files.end());
+    mLocatingSelector = selector;
+    mSignature = &signature;
+  }
+
+  // Parses sources on up to jobs threads. Every TU fills a graph of its own,
+  // and these are merged into graph in the order of sources.
+  // Returns false if any TU failed to parse.
+  bool build(ArrayRef<std::string> sources, RelationGraph &graph);
+
+  // Parses sources as build does, but leaves the graph of every TU in
+  // shards, in the order of sources, instead of merging them. Every shard
+  // has all the inclusions its TU sees, so that the shards of some TUs can
+  // be replaced without the others.
+  bool buildShards(ArrayRef<std::string> sources,
+    std::vector<RelationGraph> &shards);
+
+private:
+  // What demand-driven builds need to know of a parse besides its graph.
+  struct ParseNotes {
+    // The functions whose bodies were skipped, the only symbols whose
+    // dependencies are missing.
+    std::set<SymbolKeyType> SkippedBodies;
+    // The identifiers the dependencies are declared with.
+    llvm::StringMap<std::string> Identifiers;
+  };
+
+  // Calls f with every index of sources on up to mJobs threads, the TUs
+  // predicted to take longest first.
+  void forEachTranslationUnit(ArrayRef<std::string> sources,
+    std::function<void(size_t)> f);
+  // Parses sources into shards. The inclusions of headers known from other
+  // TUs are skipped if mSkipKnownHeaders.
+  bool parseShards(ArrayRef<std::string> sources,
+    std::vector<RelationGraph> &shards);
+  bool buildTranslationUnit(StringRef source,
+    RelationGraph &shard,
+    ParseNotes *notes);
+  bool buildTranslationUnitRelations(StringRef source,
+    RelationGraph &shard,
+    ParseNotes *notes);
+
+  // Parses source into shard with the function bodies given, or all of
+  // them, on top of its preamble if any. The selected symbol is located
+  // into located if it is not null. The records of the parse are written
+  // to writer if it is not null.
+  bool parseTranslationUnit(StringRef source,
+    const std::set<SymbolKeyType> *bodies,
+    std::string *located,
+    RecordWriter *writer,
+    RelationGraph &shard,
+    std::vector<std::string> &inputFiles,
+    ParseNotes *notes = nullptr);
+
+  // Adds to shards the dependencies of every function the closures of the
+  // roots reach, parsing the TUs of parsedTUs which are not yet as needed.
+  // notes are those of the first parse of every TU.
+  void parseReachedBodies(ArrayRef<std::string> sources,
+    std::vector<RelationGraph> &shards,
+    std::vector<ParseNotes> &notes,
+    std::vector<char> &results,
+    std::vector<char> &parsedTUs);
+
+  // Whether source is the TU of the located symbol or of the root file.
+  bool isStartingTranslationUnit(StringRef source) const;
+
+  bool isDemandDriven() const {
+    return mRoots && !mScanner && !mCache;
+  }
+
+  // Returns where the TU of source should locate the selected symbol, or
+  // null. Only the first TU of each locating file to ask is told so.
+  std::string *claimSymbolLocating(StringRef source);
+  // Takes the signature of the first locating file which has the symbol,
+  // parsing those no TU located it in. Returns false if any parse failed.
+  bool finishSymbolLocating();
+
+  const tooling::CompilationDatabase &mCompilations;
+  unsigned mJobs;
+  IndexCache *mCache;
+  InclusionScanner *mScanner;
+  const PreambleBuilder *mPreambles;
+  RecordWriter *mWriter;
+  const ClosureRoots *mRoots;
+  const SymbolPrescanner *mPrescanner;
+  TUCostModel *mCostModel;
+  std::map<std::string, SymbolsList> *mSymbolsLists;
+  StringPool *mStringPool;
+  bool mHeaderBodies;
+  bool mSkipKnownHeaders;
+  KnownHeaders mKnownHeaders;
+  std::vector<std::string> mLocatingFiles;
+  SymbolSelector mLocatingSelector;
+  std::string *mSignature;
+  // Of a build: the index of every locating file by its key, what was
+  // located in each and whether a TU claimed it.
+  std::map<FileKeyType, size_t> mLocatingIndices;
+  std::vector<std::string> mLocatedSignatures;
+  std::vector<char> mLocatingClaimed;
+  std::mutex mLocatingMutex;
+};
+
+} // namespace closure
+} // namespace clang
+
+#endif
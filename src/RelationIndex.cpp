@@ -0,0 +1,379 @@
+#include "RelationIndex.h"
+#include "FileWriting.h"
+#include "TimeTracing.h"
+#include "llvm/Support/MathExtras.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace clang {
+namespace closure {
+
+const uint32_t RelationIndex::InvalidIndex;
+
+namespace {
+
+// The file starts with this header. The tables follow in the order of
+// IndexLayout, each aligned to 8 bytes, so their offsets follow from the
+// counts alone. Numbers are in the byte order of the writer.
+struct IndexHeader {
+  char Magic[8];
+  uint32_t Version;
+  uint32_t ByteOrder;
+  uint32_t FilesCount;
+  uint32_t InclusionsCount;
+  uint32_t SymbolsCount;
+  uint32_t DependenciesCount;
+  uint32_t StringsSize;
+  uint32_t Reserved;
+};
+
+struct IndexLayout {
+  size_t FileDevices;
+  size_t FileInodes;
+  size_t FileNames;
+  size_t InclusionOffsets;
+  size_t Inclusions;
+  size_t SymbolNames;
+  size_t DefinitionFiles;
+  size_t DependencyOffsets;
+  size_t Dependencies;
+  size_t FileFlags;
+  size_t SymbolExtents;
+  size_t SymbolFlags;
+  size_t Strings;
+  size_t Size;
+};
+
+} // end anonymous namespace
+
+static const char IndexMagic[8] = { 'C', 'L', 'O', 'S', 'U', 'R', 'E', 0 };
+static const uint32_t IndexVersion = 3;
+static const uint32_t IndexByteOrder = 0x01020304;
+
+static IndexLayout GetLayout(const IndexHeader &header) {
+  IndexLayout layout;
+  size_t offset = sizeof(IndexHeader);
+  auto place = [&offset](size_t count, size_t size) {
+    size_t r = offset;
+    offset = llvm::alignTo(offset + count * size, 8);
+    return r;
+  };
+  layout.FileDevices = place(header.FilesCount, sizeof(uint64_t));
+  layout.FileInodes = place(header.FilesCount, sizeof(uint64_t));
+  layout.FileNames = place(header.FilesCount, sizeof(uint32_t));
+  layout.InclusionOffsets = place(header.FilesCount + 1ull, sizeof(uint32_t));
+  layout.Inclusions = place(header.InclusionsCount, sizeof(uint32_t));
+  layout.SymbolNames = place(header.SymbolsCount, sizeof(uint32_t));
+  layout.DefinitionFiles = place(header.SymbolsCount, sizeof(uint32_t));
+  layout.DependencyOffsets = place(header.SymbolsCount + 1ull,
+    sizeof(uint32_t));
+  layout.Dependencies = place(header.DependenciesCount, sizeof(uint32_t));
+  layout.FileFlags = place(header.FilesCount, sizeof(uint8_t));
+  layout.SymbolExtents = place(2ull * header.SymbolsCount, sizeof(uint32_t));
+  layout.SymbolFlags = place(header.SymbolsCount, sizeof(uint8_t));
+  layout.Strings = place(header.StringsSize, sizeof(char));
+  layout.Size = offset;
+  return layout;
+}
+
+template <typename T>
+static void CopyTable(char *buffer,
+  size_t offset,
+  const std::vector<T> &table) {
+  if (!table.empty())
+    std::memcpy(buffer + offset, table.data(), table.size() * sizeof(T));
+}
+
+template <typename T>
+static ArrayRef<T> GetTable(const char *buffer, size_t offset, size_t count) {
+  return ArrayRef<T>(reinterpret_cast<const T*>(buffer + offset), count);
+}
+
+// Whether the rows of a table of count targets start at offsets, which rise
+// from 0 to count.
+static bool AreValidRowOffsets(ArrayRef<uint32_t> offsets, uint32_t count) {
+  if (offsets.front() != 0 || offsets.back() != count)
+    return false;
+  for (size_t i = 1, size = offsets.size(); i != size; ++i) {
+    if (offsets[i] < offsets[i - 1])
+      return false;
+  }
+  return true;
+}
+
+// Whether every index of indices is below count.
+static bool AreValidIndices(ArrayRef<uint32_t> indices, uint32_t count) {
+  for (uint32_t index : indices) {
+    if (index >= count)
+      return false;
+  }
+  return true;
+}
+
+RelationIndex::RelationIndex(const RelationGraph &graph) {
+  TimeTraceScope scope("FreezeIndex");
+
+  std::vector<char> strings(1, '\0');
+  auto addString = [&strings](StringRef s) -> uint32_t {
+    if (s.empty())
+      return 0;
+    uint32_t offset = strings.size();
+    strings.insert(strings.end(), s.begin(), s.end());
+    strings.push_back('\0');
+    return offset;
+  };
+
+  const FilesMapType &files = graph.getFiles();
+  const FilesSetType &systemHeaders = graph.getSystemHeadersInMainFiles();
+  const SymbolsMapType &symbols = graph.getSymbols();
+
+  std::vector<FileKeyType> keys;
+  for (auto iter = files.begin(); iter != files.end(); ++iter) {
+    keys.push_back(iter->first);
+    for (size_t i = 0, count = iter->second.getInclusionsCount();
+      i != count;
+      ++i)
+      keys.push_back(iter->second.getInclusion(i));
+  }
+  keys.insert(keys.end(), systemHeaders.begin(), systemHeaders.end());
+  for (auto iter = symbols.begin(); iter != symbols.end(); ++iter)
+    keys.push_back(iter->second.getDefinitionFile());
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  auto findKey = [&keys](const FileKeyType &key) -> FileIndexType {
+    return std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+  };
+
+  std::vector<uint64_t> fileDevices, fileInodes;
+  std::vector<uint32_t> fileNames;
+  std::vector<uint8_t> fileFlags;
+  for (const FileKeyType &key : keys) {
+    fileDevices.push_back(key.getDevice());
+    fileInodes.push_back(key.getFile());
+    auto iter = files.find(key);
+    fileNames.push_back(
+      iter == files.end() ? 0 : addString(iter->second.getFileName()));
+    fileFlags.push_back(systemHeaders.count(key) ? SystemHeaderInMainFile : 0);
+  }
+
+  std::vector<uint32_t> inclusionOffsets;
+  std::vector<FileIndexType> inclusions;
+  for (const FileKeyType &key : keys) {
+    inclusionOffsets.push_back(inclusions.size());
+    auto iter = files.find(key);
+    if (iter == files.end())
+      continue;
+    for (size_t i = 0, count = iter->second.getInclusionsCount();
+      i != count;
+      ++i)
+      inclusions.push_back(findKey(iter->second.getInclusion(i)));
+  }
+  inclusionOffsets.push_back(inclusions.size());
+
+  std::vector<StringRef> names;
+  for (auto iter = symbols.begin(); iter != symbols.end(); ++iter) {
+    names.push_back(iter->first);
+    for (size_t i = 0, count = iter->second.getDependencyCount();
+      i != count;
+      ++i)
+      names.push_back(iter->second.getDependency(i));
+  }
+  std::sort(names.begin(), names.end());
+  names.erase(std::unique(names.begin(), names.end()), names.end());
+  auto findName = [&names](StringRef name) -> SymbolIndexType {
+    return std::lower_bound(names.begin(), names.end(), name) - names.begin();
+  };
+
+  std::vector<uint32_t> symbolNames;
+  for (StringRef name : names)
+    symbolNames.push_back(addString(name));
+
+  std::vector<FileIndexType> definitionFiles;
+  std::vector<uint32_t> symbolExtents;
+  std::vector<uint8_t> symbolFlags;
+  std::vector<uint32_t> dependencyOffsets;
+  std::vector<SymbolIndexType> dependencies;
+  for (StringRef name : names) {
+    dependencyOffsets.push_back(dependencies.size());
+    auto iter = symbols.find(name.str());
+    if (iter == symbols.end()) {
+      definitionFiles.push_back(InvalidIndex);
+      symbolExtents.push_back(0);
+      symbolExtents.push_back(0);
+      symbolFlags.push_back(0);
+      continue;
+    }
+    definitionFiles.push_back(findKey(iter->second.getDefinitionFile()));
+    symbolExtents.push_back(iter->second.getExtentBegin());
+    symbolExtents.push_back(iter->second.getExtentEnd());
+    symbolFlags.push_back(iter->second.getExtentFlags());
+    for (size_t i = 0, count = iter->second.getDependencyCount();
+      i != count;
+      ++i)
+      dependencies.push_back(findName(iter->second.getDependency(i)));
+  }
+  dependencyOffsets.push_back(dependencies.size());
+
+  IndexHeader header;
+  std::memcpy(header.Magic, IndexMagic, sizeof(IndexMagic));
+  header.Version = IndexVersion;
+  header.ByteOrder = IndexByteOrder;
+  header.FilesCount = keys.size();
+  header.InclusionsCount = inclusions.size();
+  header.SymbolsCount = names.size();
+  header.DependenciesCount = dependencies.size();
+  header.StringsSize = strings.size();
+  header.Reserved = 0;
+  IndexLayout layout = GetLayout(header);
+
+  // The new buffer is zeroed, so padding is written out deterministically.
+  std::unique_ptr<llvm::MemoryBuffer> buffer
+    = llvm::MemoryBuffer::getNewMemBuffer(layout.Size, "relation index");
+  char *data = const_cast<char*>(buffer->getBufferStart());
+  std::memcpy(data, &header, sizeof(header));
+  CopyTable(data, layout.FileDevices, fileDevices);
+  CopyTable(data, layout.FileInodes, fileInodes);
+  CopyTable(data, layout.FileNames, fileNames);
+  CopyTable(data, layout.InclusionOffsets, inclusionOffsets);
+  CopyTable(data, layout.Inclusions, inclusions);
+  CopyTable(data, layout.SymbolNames, symbolNames);
+  CopyTable(data, layout.DefinitionFiles, definitionFiles);
+  CopyTable(data, layout.DependencyOffsets, dependencyOffsets);
+  CopyTable(data, layout.Dependencies, dependencies);
+  CopyTable(data, layout.FileFlags, fileFlags);
+  CopyTable(data, layout.SymbolExtents, symbolExtents);
+  CopyTable(data, layout.SymbolFlags, symbolFlags);
+  CopyTable(data, layout.Strings, strings);
+
+  std::string error;
+  setBuffer(std::move(buffer), error);
+}
+
+bool RelationIndex::setBuffer(std::unique_ptr<llvm::MemoryBuffer> buffer,
+  std::string &error) {
+  StringRef data = buffer->getBuffer();
+  IndexHeader header;
+  if (data.size() < sizeof(header)) {
+    error = "not a clang-closure index";
+    return false;
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (std::memcmp(header.Magic, IndexMagic, sizeof(IndexMagic)) != 0) {
+    error = "not a clang-closure index";
+    return false;
+  }
+  if (header.Version != IndexVersion) {
+    error = "index version " + std::to_string(header.Version)
+      + " is not supported";
+    return false;
+  }
+  if (header.ByteOrder != IndexByteOrder) {
+    error = "index written with another byte order";
+    return false;
+  }
+  IndexLayout layout = GetLayout(header);
+  if (data.size() < layout.Size) {
+    error = "index is truncated";
+    return false;
+  }
+
+  const char *base = data.data();
+  mFileDevices = GetTable<uint64_t>(base, layout.FileDevices,
+    header.FilesCount);
+  mFileInodes = GetTable<uint64_t>(base, layout.FileInodes,
+    header.FilesCount);
+  mFileNames = GetTable<uint32_t>(base, layout.FileNames, header.FilesCount);
+  mInclusionOffsets = GetTable<uint32_t>(base, layout.InclusionOffsets,
+    header.FilesCount + 1);
+  mInclusions = GetTable<FileIndexType>(base, layout.Inclusions,
+    header.InclusionsCount);
+  mSymbolNames = GetTable<uint32_t>(base, layout.SymbolNames,
+    header.SymbolsCount);
+  mDefinitionFiles = GetTable<FileIndexType>(base, layout.DefinitionFiles,
+    header.SymbolsCount);
+  mDependencyOffsets = GetTable<uint32_t>(base, layout.DependencyOffsets,
+    header.SymbolsCount + 1);
+  mDependencies = GetTable<SymbolIndexType>(base, layout.Dependencies,
+    header.DependenciesCount);
+  mFileFlags = GetTable<uint8_t>(base, layout.FileFlags, header.FilesCount);
+  mSymbolExtents = GetTable<uint32_t>(base, layout.SymbolExtents,
+    2 * header.SymbolsCount);
+  mSymbolFlags = GetTable<uint8_t>(base, layout.SymbolFlags,
+    header.SymbolsCount);
+  mStrings = GetTable<char>(base, layout.Strings, header.StringsSize);
+
+  // Every offset and index the accessors follow is checked once here, so
+  // that a corrupted file fails to load instead of reading out of bounds.
+  if (mStrings.empty() || mStrings.front() != '\0' || mStrings.back() != '\0'
+    || !AreValidRowOffsets(mInclusionOffsets, header.InclusionsCount)
+    || !AreValidRowOffsets(mDependencyOffsets, header.DependenciesCount)
+    || !AreValidIndices(mInclusions, header.FilesCount)
+    || !AreValidIndices(mDependencies, header.SymbolsCount)
+    || !AreValidIndices(mFileNames, header.StringsSize)
+    || !AreValidIndices(mSymbolNames, header.StringsSize)) {
+    error = "index is corrupted";
+    return false;
+  }
+  for (FileIndexType file : mDefinitionFiles) {
+    if (file != InvalidIndex && file >= header.FilesCount) {
+      error = "index is corrupted";
+      return false;
+    }
+  }
+  mBuffer = std::move(buffer);
+  return true;
+}
+
+std::unique_ptr<RelationIndex> RelationIndex::load(StringRef path,
+  std::string &error) {
+  TimeTraceScope scope("LoadIndex", path);
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer
+    = llvm::MemoryBuffer::getFile(path, -1,
+      /*RequiresNullTerminator=*/false);
+  if (!buffer) {
+    error = buffer.getError().message();
+    return nullptr;
+  }
+
+  std::unique_ptr<RelationIndex> index(new RelationIndex);
+  if (!index->setBuffer(std::move(*buffer), error))
+    return nullptr;
+  return index;
+}
+
+bool RelationIndex::write(StringRef path) const {
+  std::string error;
+  return WriteFileAtomically(path, mBuffer->getBuffer(), error);
+}
+
+FileIndexType RelationIndex::findFile(const FileKeyType &key) const {
+  FileIndexType first = 0, last = getFilesCount();
+  while (first != last) {
+    FileIndexType middle = first + (last - first) / 2;
+    if (getFileKey(middle) < key)
+      first = middle + 1;
+    else
+      last = middle;
+  }
+  if (first != getFilesCount() && getFileKey(first) == key)
+    return first;
+  return InvalidIndex;
+}
+
+SymbolIndexType RelationIndex::findSymbol(StringRef name) const {
+  SymbolIndexType first = 0, last = getSymbolsCount();
+  while (first != last) {
+    SymbolIndexType middle = first + (last - first) / 2;
+    if (getSymbolName(middle) < name)
+      first = middle + 1;
+    else
+      last = middle;
+  }
+  if (first != getSymbolsCount() && getSymbolName(first) == name)
+    return first;
+  return InvalidIndex;
+}
+
+} // namespace closure
+} // namespace clang
@@ -0,0 +1,143 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_RELATION_INDEX_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_RELATION_INDEX_H
+
+#include "RelationConstruction.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace clang {
+namespace closure {
+
+typedef uint32_t FileIndexType;
+typedef uint32_t SymbolIndexType;
+
+// Frozen form of a RelationGraph. Files and symbols are numbered densely,
+// names live in one string table and edges are stored in compressed sparse
+// row form, so traversals touch contiguous memory only.
+//
+// Files are numbered in the order of their keys and symbols in the order of
+// their names, so both can be found by binary search.
+//
+// All the tables live in one buffer laid out as the file written by write,
+// so a loaded index is used in place from the mapped file.
+class RelationIndex {
+public:
+  static const uint32_t InvalidIndex = ~0u;
+
+  explicit RelationIndex(const RelationGraph &graph);
+
+  // Maps the index file at path. Returns nullptr and sets error if it is not
+  // an index of this version.
+  static std::unique_ptr<RelationIndex> load(StringRef path,
+    std::string &error);
+
+  // Writes the index to path, replacing it atomically.
+  bool write(StringRef path) const;
+
+  size_t getFilesCount() const {
+    return mFileDevices.size();
+  }
+
+  FileKeyType getFileKey(FileIndexType file) const {
+    return FileKeyType(mFileDevices[file], mFileInodes[file]);
+  }
+
+  // Empty for files which are only known by their key.
+  StringRef getFileName(FileIndexType file) const {
+    return getString(mFileNames[file]);
+  }
+
+  bool isSystemHeaderInMainFile(FileIndexType file) const {
+    return mFileFlags[file] & SystemHeaderInMainFile;
+  }
+
+  ArrayRef<FileIndexType> getInclusions(FileIndexType file) const {
+    return getRow(mInclusionOffsets, mInclusions, file);
+  }
+
+  FileIndexType findFile(const FileKeyType &key) const;
+
+  size_t getSymbolsCount() const {
+    return mSymbolNames.size();
+  }
+
+  StringRef getSymbolName(SymbolIndexType symbol) const {
+    return getString(mSymbolNames[symbol]);
+  }
+
+  // InvalidIndex for symbols which are referenced but whose definition was
+  // not seen.
+  FileIndexType getDefinitionFile(SymbolIndexType symbol) const {
+    return mDefinitionFiles[symbol];
+  }
+
+  // The offsets of the source of symbol in its definition file, which are
+  // equal when it is not known.
+  unsigned getExtentBegin(SymbolIndexType symbol) const {
+    return mSymbolExtents[2 * symbol];
+  }
+
+  unsigned getExtentEnd(SymbolIndexType symbol) const {
+    return mSymbolExtents[2 * symbol + 1];
+  }
+
+  // A combination of SymbolNode::ExtentFlags.
+  unsigned getExtentFlags(SymbolIndexType symbol) const {
+    return mSymbolFlags[symbol];
+  }
+
+  ArrayRef<SymbolIndexType> getDependencies(SymbolIndexType symbol) const {
+    return getRow(mDependencyOffsets, mDependencies, symbol);
+  }
+
+  SymbolIndexType findSymbol(StringRef name) const;
+
+private:
+  enum FileFlags : uint8_t {
+    SystemHeaderInMainFile = 1
+  };
+
+  RelationIndex() = default;
+
+  // Points the tables into buffer, after checking its header.
+  bool setBuffer(std::unique_ptr<llvm::MemoryBuffer> buffer,
+    std::string &error);
+
+  StringRef getString(uint32_t offset) const {
+    return StringRef(mStrings.data() + offset);
+  }
+
+  static ArrayRef<uint32_t> getRow(ArrayRef<uint32_t> offsets,
+    ArrayRef<uint32_t> targets,
+    uint32_t row) {
+    return targets.slice(offsets[row], offsets[row + 1] - offsets[row]);
+  }
+
+  std::unique_ptr<llvm::MemoryBuffer> mBuffer;
+
+  // NUL terminated strings; offset 0 is the empty string.
+  ArrayRef<char> mStrings;
+
+  ArrayRef<uint64_t> mFileDevices;
+  ArrayRef<uint64_t> mFileInodes;
+  ArrayRef<uint32_t> mFileNames;
+  ArrayRef<uint8_t> mFileFlags;
+  ArrayRef<uint32_t> mInclusionOffsets;
+  ArrayRef<FileIndexType> mInclusions;
+
+  ArrayRef<uint32_t> mSymbolNames;
+  ArrayRef<FileIndexType> mDefinitionFiles;
+  // Begin and end offsets, two per symbol.
+  ArrayRef<uint32_t> mSymbolExtents;
+  ArrayRef<uint8_t> mSymbolFlags;
+  ArrayRef<uint32_t> mDependencyOffsets;
+  ArrayRef<SymbolIndexType> mDependencies;
+};
+
+} // namespace closure
+} // namespace clang
+
+#endif
@@ -0,0 +1,57 @@
+#include "StringPool.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/Compiler.h"
+#include <mutex>
+
+namespace clang {
+namespace closure {
+
+// TUs parsed in parallel intern most of their strings, so the pool is split
+// by hash to keep them from waiting on one lock.
+struct StringPool::Shard {
+  std::mutex Mutex;
+  llvm::StringSet<llvm::BumpPtrAllocator> Strings;
+};
+
+static const unsigned StringPoolShardCount = 16;
+
+StringPool::StringPool() : mShards(new Shard[StringPoolShardCount]) {}
+
+StringPool::~StringPool() {}
+
+StringRef StringPool::intern(StringRef s) {
+  Shard &shard = mShards[llvm::hash_value(s) % StringPoolShardCount];
+  std::lock_guard<std::mutex> lock(shard.Mutex);
+  return shard.Strings.insert(s).first->getKey();
+}
+
+size_t StringPool::getSize() const {
+  size_t r = 0;
+  for (unsigned i = 0; i != StringPoolShardCount; ++i) {
+    std::lock_guard<std::mutex> lock(mShards[i].Mutex);
+    r += mShards[i].Strings.getAllocator().getTotalMemory();
+  }
+  return r;
+}
+
+static LLVM_THREAD_LOCAL StringPool *CurrentStringPool = nullptr;
+
+StringPoolScope::StringPoolScope(StringPool *pool)
+  : mPrevious(CurrentStringPool) {
+  if (pool)
+    CurrentStringPool = pool;
+}
+
+StringPoolScope::~StringPoolScope() {
+  CurrentStringPool = mPrevious;
+}
+
+StringRef InternString(StringRef s) {
+  static StringPool processPool;
+  return (CurrentStringPool ? *CurrentStringPool : processPool).intern(s);
+}
+
+} // namespace closure
+} // namespace clang
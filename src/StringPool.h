@@ -0,0 +1,53 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_STRING_POOL_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_STRING_POOL_H
+
+#include "llvm/ADT/StringRef.h"
+#include <cstddef>
+#include <memory>
+
+namespace clang {
+namespace closure {
+
+// Strings saved once each. File names and signatures repeat across the
+// graphs and listings of every TU, so nodes keep these strings in a pool
+// rather than copies of their own. A pool only grows, by the distinct
+// strings saved in it, and frees them all when it is destroyed. Thread
+// safe.
+class StringPool {
+public:
+  StringPool();
+  ~StringPool();
+
+  // Returns the copy of s in the pool, saving s there first if it has none.
+  StringRef intern(StringRef s);
+
+  // The bytes the slabs of the pool hold.
+  size_t getSize() const;
+
+private:
+  struct Shard;
+  std::unique_ptr<Shard[]> mShards;
+};
+
+// Makes InternString save the strings of the current thread in pool until
+// the scope ends. A null pool leaves the thread with the pool it has.
+class StringPoolScope {
+public:
+  explicit StringPoolScope(StringPool *pool);
+  ~StringPoolScope();
+
+private:
+  StringPool *mPrevious;
+};
+
+// Returns the copy of s in the pool of the current thread, which is that of
+// the process unless a StringPoolScope says otherwise. The pool of the
+// process is never freed, so only graphs and listings kept in a pool of
+// their own, such as those of a server which builds its graph again, let
+// their strings go.
+StringRef InternString(StringRef s);
+
+} // namespace closure
+} // namespace clang
+
+#endif
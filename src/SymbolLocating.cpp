@@ -1,46 +1,79 @@
 #include "SymbolLocating.h"
+#include "SymbolPrescan.h"
 #include "clang/AST/AST.h"
-#include "clang/AST/Mangle.h"
+#include "clang/Index/USRGeneration.h"
+#include "llvm/ADT/SmallString.h"
 
 namespace clang {
 namespace closure {
 
-bool SymbolLocatingVisitor::VisitFunctionDecl(FunctionDecl *fd) {
-  if (mIndex < 0)
-    return false;
+StringRef SymbolSelector::getIdentifier() const {
+  StringRef value(Value);
+  switch (Kind) {
+  case ByIndex:
+    return StringRef();
+  case ByName: {
+    size_t pos = value.rfind("::");
+    return pos == StringRef::npos ? value : value.substr(pos + 2);
+  }
+  case ByUSR: {
+    // Such as c:@N@ns@F@foo#I#, where parameter types follow the first #.
+    StringRef name = value.split('#').first;
+    name = name.substr(name.rfind('@') + 1);
+    return IsIdentifier(name) ? name : StringRef();
+  }
+  }
+  return StringRef();
+}
+
+bool SymbolLocatingVisitor::isSelected(const NamedDecl *d) {
+  if (mSelector.Kind == SymbolSelector::ByIndex)
+    return mIndex-- == 0;
 
-  if (mContext->getSourceManager().isInMainFile(fd->getLocation())) {
-    if (mIndex == 0) {
-      std::unique_ptr<MangleContext> mangleContext =
-        std::unique_ptr<MangleContext>(mContext->createMangleContext());
-      mangleContext->mangleName(fd, llvm::raw_string_ostream(mSignature));
-    }
-    --mIndex;
+  // Most declarations are told apart by their identifier alone.
+  if (!mIdentifier.empty()) {
+    const IdentifierInfo *id = d->getIdentifier();
+    if (!id || id->getName() != mIdentifier)
+      return false;
   }
-  return true;
+
+  if (mSelector.Kind == SymbolSelector::ByName) {
+    return mIdentifier == mSelector.Value
+      || d->getQualifiedNameAsString() == mSelector.Value;
+  }
+
+  llvm::SmallString<128> usr;
+  return !index::generateUSRForDecl(d, usr) && usr == mSelector.Value;
 }
 
-bool SymbolLocatingVisitor::VisitRecordDecl(RecordDecl *rd) {
-  if (mIndex < 0)
+bool SymbolLocatingVisitor::visitSymbol(const NamedDecl *d) {
+  if (mDone)
     return false;
 
-  if (mContext->getSourceManager().isInMainFile(rd->getLocation())) {
-    if (mIndex == 0) {
-      std::unique_ptr<MangleContext> mangleContext
-        = std::unique_ptr<MangleContext>(mContext->createMangleContext());
-      QualType type = rd->getTypeForDecl()->getCanonicalTypeInternal();
-      mangleContext->mangleTypeName(type,
-        llvm::raw_string_ostream(mSignature));
-    }
-    --mIndex;
+  // As in symbols listing, declarations in function bodies do not count.
+  if (mContext->getSourceManager().isInMainFile(d->getLocation())
+    && !d->getParentFunctionOrMethod()
+    && isSelected(d)) {
+    mSignature = mMangler.getSignature(d).str();
+    mDone = true;
+    return false;
   }
   return true;
 }
 
+bool SymbolLocatingVisitor::VisitFunctionDecl(FunctionDecl *fd) {
+  return visitSymbol(fd);
+}
+
+bool SymbolLocatingVisitor::VisitRecordDecl(RecordDecl *rd) {
+  return visitSymbol(rd);
+}
+
 bool SymbolLocatingConsumer::HandleTopLevelDecl(DeclGroupRef DR) {
   for (DeclGroupRef::iterator b = DR.begin(), e = DR.end(); b != e; ++b)
     mVisitor.TraverseDecl(*b);
-  return true;
+  // Returning false ends parsing, and with it the action.
+  return !(mEndParseWhenDone && mVisitor.isDone());
 }
 
 void SymbolLocatingConsumer::Initialize(ASTContext &Context) {
@@ -1,17 +1,51 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_SYMBOL_LOCATING_H
 #define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_SYMBOL_LOCATING_H
 
+#include "SymbolMangling.h"
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendAction.h"
+#include <string>
 
 namespace clang {
 namespace closure {
 
+// Selects one of the symbols declared in the main file: the one at an index
+// in the order symbols listing prints them, or the first one with a name,
+// which may be qualified, or with a USR.
+struct SymbolSelector {
+  enum SelectorKind {
+    ByIndex,
+    ByName,
+    ByUSR
+  };
+
+  SymbolSelector(int index = 0) : Kind(ByIndex), Index(index) {}
+
+  SymbolSelector(SelectorKind kind, StringRef value)
+    : Kind(kind), Index(0), Value(value) {}
+
+  // The identifier the selected symbol is declared with, which is compared
+  // before anything costlier. Empty when selecting by index, or when it
+  // can not be told from the USR.
+  StringRef getIdentifier() const;
+
+  SelectorKind Kind;
+  int Index;
+  std::string Value;
+};
+
 class SymbolLocatingVisitor
   : public RecursiveASTVisitor<SymbolLocatingVisitor> {
 public:
-  SymbolLocatingVisitor(std::string &signature, int index) :
-    mContext(nullptr), mSignature(signature), mIndex(index) {}
+  SymbolLocatingVisitor(std::string &signature,
+    const SymbolSelector &selector,
+    SymbolMangler &mangler) :
+    mContext(nullptr), mSignature(signature), mSelector(selector),
+    mIndex(selector.Index), mIdentifier(mSelector.getIdentifier()),
+    mDone(selector.Kind == SymbolSelector::ByIndex && selector.Index < 0),
+    mMangler(mangler) {}
 
   bool VisitFunctionDecl(FunctionDecl *fd);
 
@@ -19,25 +53,74 @@ public:
 
   void SetASTContext(ASTContext *context) {
     mContext = context;
+    mMangler.setASTContext(*context);
+  }
+
+  // Whether the selected symbol was found, or can no longer be.
+  bool isDone() const {
+    return mDone;
   }
 
 private:
+  bool visitSymbol(const NamedDecl *d);
+  bool isSelected(const NamedDecl *d);
+
   ASTContext *mContext;
   std::string &mSignature;
+  SymbolSelector mSelector;
   int mIndex;
+  StringRef mIdentifier;
+  bool mDone;
+  SymbolMangler &mMangler;
 };
 
 class SymbolLocatingConsumer : public ASTConsumer {
 public:
-  SymbolLocatingConsumer(std::string &signature, int index) :
-    mVisitor(signature, index) {}
+  // Uses mangler if given, otherwise a mangler of its own.
+  SymbolLocatingConsumer(std::string &signature,
+    const SymbolSelector &selector,
+    SymbolMangler *mangler = nullptr) :
+    mOwnedMangler(mangler ? nullptr : new SymbolMangler),
+    mVisitor(signature, selector, mangler ? *mangler : *mOwnedMangler),
+    mEndParseWhenDone(false) {}
+
+  // Stops parsing the TU once the symbol is found. Only for consumers which
+  // do not share the parse with others.
+  void setEndParseWhenDone(bool end) {
+    mEndParseWhenDone = end;
+  }
 
   bool HandleTopLevelDecl(DeclGroupRef DR) override;
 
   void Initialize(ASTContext &Context) override;
 
 private:
+  std::unique_ptr<SymbolMangler> mOwnedMangler;
   SymbolLocatingVisitor mVisitor;
+  bool mEndParseWhenDone;
+};
+
+// Parses the TU only up to the declaration of the selected symbol, without
+// function bodies.
+class SymbolLocatingAction : public ASTFrontendAction {
+public:
+  SymbolLocatingAction(std::string &signature,
+    const SymbolSelector &selector) :
+    mSignature(signature), mSelector(selector) {}
+
+  std::unique_ptr<ASTConsumer> CreateASTConsumer(
+    CompilerInstance &CI,
+    StringRef InFile) override {
+    CI.getFrontendOpts().SkipFunctionBodies = true;
+    auto consumer
+      = llvm::make_unique<SymbolLocatingConsumer>(mSignature, mSelector);
+    consumer->setEndParseWhenDone(true);
+    return std::move(consumer);
+  }
+
+private:
+  std::string &mSignature;
+  SymbolSelector mSelector;
 };
 
 } // namespace closure
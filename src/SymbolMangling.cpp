@@ -0,0 +1,76 @@
+#include "SymbolMangling.h"
+#include "clang/AST/AST.h"
+#include "clang/Index/USRGeneration.h"
+#include "llvm/ADT/SmallString.h"
+
+namespace clang {
+namespace closure {
+
+void SymbolMangler::setASTContext(ASTContext &context) {
+  if (mContext == &context)
+    return;
+  mContext = &context;
+  mMangleContext.reset(context.createMangleContext());
+  mSignatures.clear();
+  mDeclarationSignatures.clear();
+  mAllocator.Reset();
+}
+
+StringRef SymbolMangler::getSignature(const NamedDecl *d) {
+  const Decl *canonical = d->getCanonicalDecl();
+  auto iter = mSignatures.find(canonical);
+  if (iter != mSignatures.end())
+    return iter->second;
+
+  if (!isa<RecordDecl>(d) && (isa<TypeDecl>(d) || isa<TemplateDecl>(d))) {
+    StringRef r = getDeclarationSignature(d);
+    mSignatures.insert(std::make_pair(canonical, r));
+    return r;
+  }
+
+  std::string signature;
+  llvm::raw_string_ostream os(signature);
+  if (const RecordDecl *rd = dyn_cast<RecordDecl>(d)) {
+    QualType type = rd->getTypeForDecl()->getCanonicalTypeInternal();
+    mMangleContext->mangleTypeName(type, os);
+  }
+  else if (const CXXConstructorDecl *ctor = dyn_cast<CXXConstructorDecl>(d)) {
+    mMangleContext->mangleCXXCtor(ctor, Ctor_Complete, os);
+  }
+  else if (const CXXDestructorDecl *dtor = dyn_cast<CXXDestructorDecl>(d)) {
+    mMangleContext->mangleCXXDtor(dtor, Dtor_Complete, os);
+  }
+  else if (!mMangleContext->shouldMangleDeclName(d)) {
+    // C functions and variables keep their names, as CodeGen emits them.
+    os << d->getName();
+  }
+  else {
+    mMangleContext->mangleName(d, os);
+  }
+  os.flush();
+
+  StringRef r(mSaver.save(signature));
+  mSignatures.insert(std::make_pair(canonical, r));
+  return r;
+}
+
+StringRef SymbolMangler::getDeclarationSignature(const NamedDecl *d) {
+  const Decl *canonical = d->getCanonicalDecl();
+  auto iter = mDeclarationSignatures.find(canonical);
+  if (iter != mDeclarationSignatures.end())
+    return iter->second;
+
+  llvm::SmallString<128> usr;
+  StringRef r;
+  if (!index::generateUSRForDecl(d, usr))
+    r = mSaver.save(usr.str());
+  mDeclarationSignatures.insert(std::make_pair(canonical, r));
+  return r;
+}
+
+std::string GetMacroSignature(StringRef name) {
+  return "c:@macro@" + name.str();
+}
+
+} // namespace closure
+} // namespace clang
@@ -0,0 +1,51 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_SYMBOL_MANGLING_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_SYMBOL_MANGLING_H
+
+#include "clang/AST/Mangle.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/StringSaver.h"
+#include <memory>
+#include <string>
+
+namespace clang {
+namespace closure {
+
+// Produces the signatures symbols are keyed by: the names functions and
+// variables have in object files, which are mangled in C++ and plain in C,
+// mangled type names of records, and USRs of the other declarations types
+// are named by, such as enums, typedefs and templates, which have no mangled
+// name of their own. There is one MangleContext per ASTContext, and each
+// declaration is mangled at most once no matter how many visitors ask for it.
+class SymbolMangler {
+public:
+  SymbolMangler() : mContext(nullptr), mSaver(mAllocator) {}
+
+  // Forgets every signature if context is not the current one.
+  void setASTContext(ASTContext &context);
+
+  // The result stays valid until the ASTContext changes.
+  StringRef getSignature(const NamedDecl *d);
+
+  // The signature of the declarations of d, as opposed to its definition:
+  // the USR of d, which differs from the signature of functions, variables
+  // and records. Empty if d has no USR.
+  StringRef getDeclarationSignature(const NamedDecl *d);
+
+private:
+  ASTContext *mContext;
+  std::unique_ptr<MangleContext> mMangleContext;
+  llvm::DenseMap<const Decl*, StringRef> mSignatures;
+  llvm::DenseMap<const Decl*, StringRef> mDeclarationSignatures;
+  llvm::BumpPtrAllocator mAllocator;
+  llvm::StringSaver mSaver;
+};
+
+// Macros are keyed by name alone, like the USRs of the macros of system
+// headers, so every definition of a name is the same symbol.
+std::string GetMacroSignature(StringRef name);
+
+} // namespace closure
+} // namespace clang
+
+#endif
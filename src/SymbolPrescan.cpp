@@ -0,0 +1,462 @@
+#include "SymbolPrescan.h"
+#include "clang/Basic/LangOptions.h"
+#include "clang/Lex/Lexer.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ThreadPool.h"
+#include <algorithm>
+#include <cctype>
+#include <memory>
+
+namespace clang {
+namespace closure {
+
+bool IsIdentifier(StringRef s) {
+  if (s.empty() || std::isdigit(static_cast<unsigned char>(s[0])))
+    return false;
+  for (char c : s) {
+    if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_')
+      return false;
+  }
+  return true;
+}
+
+// Reads the <source-name> at the start of s, a length and as many
+// characters, into name.
+static bool ReadSourceName(StringRef &s, StringRef &name) {
+  size_t digits = 0;
+  while (digits != s.size() && std::isdigit(static_cast<unsigned char>(
+    s[digits])))
+    ++digits;
+  size_t length;
+  if (digits == 0 || s.substr(0, digits).getAsInteger(10, length)
+    || s.size() - digits < length)
+    return false;
+  name = s.substr(digits, length);
+  s = s.drop_front(digits + length);
+  return true;
+}
+
+// Skips the <substitution> or <template-param> at the start of s, such as
+// St, S0_ and T_.
+static bool SkipReference(StringRef &s) {
+  if (s.size() >= 2 && s[0] == 'S'
+    && std::islower(static_cast<unsigned char>(s[1]))) {
+    s = s.drop_front(2);
+    return true;
+  }
+  size_t end = s.find('_');
+  if (end == StringRef::npos)
+    return false;
+  s = s.drop_front(end + 1);
+  return true;
+}
+
+// Skips the <template-args> at the start of s, which open with I. Only the
+// productions which hold names or numbers, or end with E, are told apart,
+// which is enough to find the end of the arguments of ordinary names.
+static bool SkipTemplateArgs(StringRef &s) {
+  unsigned depth = 0;
+  while (!s.empty()) {
+    char c = s.front();
+    StringRef name;
+    if (std::isdigit(static_cast<unsigned char>(c))) {
+      if (!ReadSourceName(s, name))
+        return false;
+    }
+    else if (c == 'S' || c == 'T') {
+      if (!SkipReference(s))
+        return false;
+    }
+    else if (c == 'L') {
+      // Literals of external names are not told apart from the others.
+      size_t end = s.find('E');
+      if (s.startswith("L_Z") || end == StringRef::npos)
+        return false;
+      s = s.drop_front(end + 1);
+    }
+    else if (c == 'A' || s.startswith("Dv")) {
+      // Arrays and vectors, whose size comes before an underscore.
+      size_t end = s.find('_');
+      if (end == StringRef::npos)
+        return false;
+      s = s.drop_front(end + 1);
+    }
+    else if (c == 'D') {
+      if (s.startswith("Dt") || s.startswith("DT"))
+        ++depth;
+      s = s.drop_front(std::min<size_t>(2, s.size()));
+    }
+    else if (c == 'I' || c == 'J' || c == 'N' || c == 'X' || c == 'F'
+      || c == 'Z') {
+      ++depth;
+      s = s.drop_front();
+    }
+    else if (c == 'E') {
+      if (depth == 0)
+        return false;
+      s = s.drop_front();
+      if (--depth == 0)
+        return true;
+    }
+    else {
+      s = s.drop_front();
+    }
+  }
+  return false;
+}
+
+std::string GetSignatureIdentifier(StringRef signature) {
+  if (signature.startswith("c:")) {
+    // Such as c:@S@point, where parameter types of functions follow a #.
+    StringRef name = signature.split('#').first;
+    name = name.substr(name.rfind('@') + 1);
+    return IsIdentifier(name) ? name.str() : std::string();
+  }
+  // C names keep their identifiers. Those which begin with _Z are reserved.
+  if (!signature.startswith("_Z"))
+    return IsIdentifier(signature) ? signature.str() : std::string();
+
+  // Itanium names, and type names of records, which mangle their types.
+  StringRef s = signature.drop_front(2);
+  if (s.startswith("TS"))
+    s = s.drop_front(2);
+  else if (s.startswith("L"))
+    s = s.drop_front();
+  if (s.startswith("St"))
+    s = s.drop_front(2);
+  StringRef name;
+  if (!s.empty() && std::isdigit(static_cast<unsigned char>(s[0])))
+    return ReadSourceName(s, name) ? name.str() : std::string();
+  if (!s.startswith("N"))
+    return std::string();
+
+  // The last <source-name> of a <nested-name> is the name, unless a
+  // substitution, an operator or a special name follows it. Constructors
+  // and destructors go by the names of their classes.
+  s = s.drop_front();
+  while (!s.empty() && StringRef("rVKRO").find(s.front()) != StringRef::npos)
+    s = s.drop_front();
+  while (!s.empty()) {
+    char c = s.front();
+    if (std::isdigit(static_cast<unsigned char>(c))) {
+      if (!ReadSourceName(s, name))
+        return std::string();
+    }
+    else if (c == 'I') {
+      if (!SkipTemplateArgs(s))
+        return std::string();
+    }
+    else if (c == 'S' || c == 'T') {
+      if (!SkipReference(s))
+        return std::string();
+      name = StringRef();
+    }
+    else if ((c == 'C' || c == 'D') && s.size() >= 2
+      && std::isdigit(static_cast<unsigned char>(s[1]))) {
+      s = s.drop_front(2);
+    }
+    else if (c == 'E') {
+      return IsIdentifier(name) ? name.str() : std::string();
+    }
+    else {
+      return std::string();
+    }
+  }
+  return std::string();
+}
+
+// Keywords which take a parenthesized operand where a declarator may stand.
+static bool IsOperatorKeyword(StringRef s) {
+  return llvm::StringSwitch<bool>(s)
+    .Cases("__attribute__", "__declspec", "alignas", "_Alignas", true)
+    .Cases("decltype", "typeof", "__typeof__", "sizeof", true)
+    .Cases("static_assert", "_Static_assert", "noexcept", "throw", true)
+    .Cases("asm", "__asm__", true)
+    .Default(false);
+}
+
+static bool IsRecordKeyword(StringRef s) {
+  return s == "struct" || s == "union" || s == "class" || s == "enum";
+}
+
+namespace {
+
+// What has been seen of the declaration being lexed at file or namespace
+// scope.
+struct DeclarationState {
+  StringRef LastIdentifier;
+  // The identifier before the parameter list of a function.
+  StringRef FunctionName;
+  bool AfterParameters = false;
+  bool AfterColon = false;
+  bool AfterRecordKeyword = false;
+  StringRef RecordName;
+  bool InBaseClause = false;
+  bool AfterExtern = false;
+  // Braces which follow a namespace or extern "C" are scanned as file scope.
+  bool IsNamespaceHead = false;
+  bool IsLinkageHead = false;
+  // Braces which follow enum hold enumerators.
+  bool IsEnumHead = false;
+  // Identifiers after = are not declared.
+  bool InInitializer = false;
+  bool AfterTemplate = false;
+  // The number of angle brackets open in a template parameter list.
+  unsigned TemplateAngles = 0;
+};
+
+} // namespace
+
+void ScanDefinitions(StringRef buffer, std::vector<std::string> &identifiers) {
+  // The lexer needs a NUL terminated buffer.
+  std::unique_ptr<llvm::MemoryBuffer> copy
+    = llvm::MemoryBuffer::getMemBufferCopy(buffer);
+  LangOptions langOpts;
+  langOpts.CPlusPlus = true;
+  langOpts.CPlusPlus11 = true;
+  Lexer lexer(SourceLocation(), langOpts, copy->getBufferStart(),
+    copy->getBufferStart(), copy->getBufferEnd());
+
+  // One entry per open brace, true for those scanned as file scope.
+  std::vector<bool> braces;
+  size_t opaqueBraces = 0;
+  unsigned parens = 0;
+  unsigned squares = 0;
+  // The number of braces open in the body of an enumeration, if scanned.
+  size_t enumBraces = 0;
+  bool expectEnumerator = false;
+  DeclarationState state;
+
+  // Declarators which are not those of functions name variables, or types
+  // after typedef. Only definitions count, so extern ones are left out.
+  auto declareVariable = [&]() {
+    if (!state.LastIdentifier.empty() && state.FunctionName.empty()
+      && !state.InInitializer && !state.AfterExtern && !state.InBaseClause
+      && !state.IsNamespaceHead
+      && (!state.AfterRecordKeyword
+      || state.LastIdentifier != state.RecordName))
+      identifiers.push_back(state.LastIdentifier);
+  };
+
+  Token tok;
+  lexer.LexFromRawLexer(tok);
+  while (tok.isNot(tok::eof)) {
+    if (tok.is(tok::hash) && tok.isAtStartOfLine()) {
+      // Macros are defined by name. The rest of a directive is skipped.
+      lexer.LexFromRawLexer(tok);
+      if (tok.is(tok::raw_identifier) && !tok.isAtStartOfLine()
+        && tok.getRawIdentifier() == "define") {
+        lexer.LexFromRawLexer(tok);
+        if (tok.is(tok::raw_identifier) && !tok.isAtStartOfLine())
+          identifiers.push_back(tok.getRawIdentifier());
+      }
+      while (tok.isNot(tok::eof) && !tok.isAtStartOfLine())
+        lexer.LexFromRawLexer(tok);
+      continue;
+    }
+
+    if (tok.is(tok::l_brace)) {
+      bool transparent = opaqueBraces == 0
+        && (state.IsNamespaceHead || state.IsLinkageHead);
+      bool enumeration = false;
+      if (opaqueBraces == 0 && !transparent && !state.InInitializer) {
+        if (state.AfterParameters && !state.FunctionName.empty())
+          identifiers.push_back(state.FunctionName);
+        else if (state.AfterRecordKeyword && !state.RecordName.empty())
+          identifiers.push_back(state.RecordName);
+        enumeration = state.AfterRecordKeyword && state.IsEnumHead;
+      }
+      braces.push_back(transparent);
+      if (!transparent)
+        ++opaqueBraces;
+      if (enumeration) {
+        enumBraces = braces.size();
+        expectEnumerator = true;
+      }
+      state = DeclarationState();
+    }
+    else if (tok.is(tok::r_brace)) {
+      if (!braces.empty()) {
+        if (!braces.back())
+          --opaqueBraces;
+        braces.pop_back();
+      }
+      if (braces.size() < enumBraces)
+        enumBraces = 0;
+      if (opaqueBraces == 0)
+        state = DeclarationState();
+    }
+    else if (enumBraces != 0 && braces.size() == enumBraces) {
+      // Enumerators are declared in the scope of their enumeration.
+      if (tok.is(tok::raw_identifier) && expectEnumerator)
+        identifiers.push_back(tok.getRawIdentifier());
+      if (tok.is(tok::l_paren))
+        ++parens;
+      else if (tok.is(tok::r_paren) && parens != 0)
+        --parens;
+      expectEnumerator = tok.is(tok::comma) && parens == 0;
+    }
+    else if (opaqueBraces != 0) {
+      // Bodies are skipped.
+    }
+    else if (state.TemplateAngles != 0) {
+      // Template parameters are no declarations of their own.
+      if (tok.is(tok::less))
+        ++state.TemplateAngles;
+      else if (tok.is(tok::greater))
+        --state.TemplateAngles;
+      else if (tok.is(tok::greatergreater))
+        state.TemplateAngles -= std::min(2u, state.TemplateAngles);
+    }
+    else if (tok.is(tok::raw_identifier)) {
+      StringRef s = tok.getRawIdentifier();
+      state.IsLinkageHead = false;
+      if (s == "namespace") {
+        state.IsNamespaceHead = true;
+      }
+      else if (s == "extern") {
+        state.AfterExtern = true;
+      }
+      else if (s == "template") {
+        state.AfterTemplate = true;
+      }
+      else if (IsRecordKeyword(s)) {
+        state.AfterRecordKeyword = true;
+        state.RecordName = StringRef();
+        state.InBaseClause = false;
+        if (s == "enum")
+          state.IsEnumHead = true;
+      }
+      else if (state.AfterRecordKeyword && parens == 0) {
+        // Another identifier after the name of the record makes it the type
+        // of a declarator.
+        if (state.RecordName.empty())
+          state.RecordName = s;
+        else if (!state.InBaseClause && s != "final")
+          state.AfterRecordKeyword = false;
+      }
+      if (parens == 0 && squares == 0)
+        state.LastIdentifier = IsOperatorKeyword(s) ? StringRef() : s;
+    }
+    else if (tok.is(tok::less) && state.AfterTemplate) {
+      state.AfterTemplate = false;
+      state.TemplateAngles = 1;
+    }
+    else if (tok.is(tok::string_literal)) {
+      state.IsLinkageHead = state.AfterExtern;
+    }
+    else if (tok.is(tok::l_paren)) {
+      state.IsLinkageHead = false;
+      if (parens == 0 && squares == 0 && !state.LastIdentifier.empty()
+        && !state.InInitializer
+        && (!state.AfterParameters || !state.AfterColon)
+        && (!state.AfterRecordKeyword
+        || state.LastIdentifier != state.RecordName)) {
+        state.FunctionName = state.LastIdentifier;
+        state.AfterParameters = false;
+        state.AfterRecordKeyword = false;
+      }
+      ++parens;
+    }
+    else if (tok.is(tok::r_paren)) {
+      if (parens != 0 && --parens == 0 && !state.FunctionName.empty())
+        state.AfterParameters = true;
+    }
+    else if (tok.is(tok::l_square)) {
+      ++squares;
+    }
+    else if (tok.is(tok::r_square)) {
+      if (squares != 0)
+        --squares;
+    }
+    else if (tok.is(tok::colon)) {
+      if (state.AfterRecordKeyword)
+        state.InBaseClause = true;
+      state.AfterColon = true;
+    }
+    else if (parens != 0 || squares != 0) {
+      // Separators of parameters and subscripts.
+    }
+    else if (tok.is(tok::equal)) {
+      declareVariable();
+      state.InInitializer = true;
+    }
+    else if (tok.is(tok::comma)) {
+      // The next declarator shares the type, but not the initializer.
+      declareVariable();
+      state.InInitializer = false;
+      state.LastIdentifier = StringRef();
+    }
+    else if (tok.is(tok::semi)) {
+      declareVariable();
+      state = DeclarationState();
+    }
+
+    lexer.LexFromRawLexer(tok);
+  }
+}
+
+void SymbolPrescanner::addDefinitions(StringRef path,
+  const std::vector<std::string> &identifiers) {
+  size_t file = mFiles.size();
+  mFiles.push_back(path.str());
+  for (const std::string &identifier : identifiers) {
+    std::vector<size_t> &files = mDefinitions[identifier];
+    if (files.empty() || files.back() != file)
+      files.push_back(file);
+  }
+}
+
+void SymbolPrescanner::addBuffer(StringRef path, StringRef buffer) {
+  std::vector<std::string> identifiers;
+  ScanDefinitions(buffer, identifiers);
+  addDefinitions(path, identifiers);
+}
+
+bool SymbolPrescanner::addFiles(ArrayRef<std::string> paths, unsigned jobs) {
+  std::vector<std::vector<std::string>> identifiers(paths.size());
+  std::vector<char> results(paths.size(), false);
+  auto scan = [&](size_t i) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer
+      = llvm::MemoryBuffer::getFile(paths[i]);
+    if (buffer) {
+      ScanDefinitions((*buffer)->getBuffer(), identifiers[i]);
+      results[i] = true;
+    }
+  };
+
+  if (jobs <= 1) {
+    for (size_t i = 0, count = paths.size(); i != count; ++i)
+      scan(i);
+  }
+  else {
+    llvm::ThreadPool pool(jobs);
+    for (size_t i = 0, count = paths.size(); i != count; ++i)
+      pool.async(scan, i);
+    pool.wait();
+  }
+
+  // Files are added in order, whichever thread scanned them.
+  bool r = true;
+  for (size_t i = 0, count = paths.size(); i != count; ++i) {
+    addDefinitions(paths[i], identifiers[i]);
+    if (!results[i])
+      r = false;
+  }
+  return r;
+}
+
+std::vector<std::string> SymbolPrescanner::getFiles(
+  StringRef identifier) const {
+  std::vector<std::string> files;
+  auto iter = mDefinitions.find(identifier);
+  if (iter != mDefinitions.end()) {
+    for (size_t file : iter->second)
+      files.push_back(mFiles[file]);
+  }
+  return files;
+}
+
+} // namespace closure
+} // namespace clang
@@ -0,0 +1,52 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_SYMBOL_PRESCAN_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_SYMBOL_PRESCAN_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace closure {
+
+// Returns whether s is a C identifier.
+bool IsIdentifier(StringRef s);
+
+// The identifier the symbol of signature is declared with: the unqualified
+// name of a mangled function, variable or record, the last name of a USR,
+// and the signature itself for C names. Empty if it can not be told, as for
+// operators and local entities.
+std::string GetSignatureIdentifier(StringRef signature);
+
+// Finds the identifiers of the functions, records, variables, typedefs,
+// enumerators and macros a file defines at file or namespace scope, with a
+// raw lex of its tokens. Nothing is preprocessed, so definitions made by
+// macros are missed, and a macro invocation which looks like a definition
+// is taken for one.
+void ScanDefinitions(StringRef buffer, std::vector<std::string> &identifiers);
+
+// Maps identifiers to the files which seem to define them, so that looking a
+// symbol up by name only needs to parse those.
+class SymbolPrescanner {
+public:
+  // Scans paths on up to jobs threads. Returns false if any can not be read.
+  bool addFiles(ArrayRef<std::string> paths, unsigned jobs);
+
+  void addBuffer(StringRef path, StringRef buffer);
+
+  // Files which define identifier, in the order they were added.
+  std::vector<std::string> getFiles(StringRef identifier) const;
+
+private:
+  void addDefinitions(StringRef path,
+    const std::vector<std::string> &identifiers);
+
+  std::vector<std::string> mFiles;
+  llvm::StringMap<std::vector<size_t>> mDefinitions;
+};
+
+} // namespace closure
+} // namespace clang
+
+#endif
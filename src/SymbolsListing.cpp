@@ -1,18 +1,33 @@
 #include "SymbolsListing.h"
+#include "RecordWriting.h"
+#include "StringPool.h"
 #include "clang/AST/AST.h"
-#include "clang/AST/Mangle.h"
-#include <string>
 #include <vector>
 
 namespace clang {
 namespace closure {
 
-// first: type(record or function)
-// second: signature(mangled name)
-typedef std::pair<std::string, std::string> SymbolsListNode;
+struct SymbolsListNode {
+  SymbolKind Kind;
+  StringRef Signature;
+};
 
 #define SYMSLIST static_cast<std::vector<SymbolsListNode>*>(mSymbolsListImpl)
 
+StringRef GetSymbolKindName(SymbolKind kind) {
+  return kind == SK_Function ? "function" : "record";
+}
+
+bool ParseSymbolKind(StringRef name, SymbolKind &kind) {
+  if (name == "function")
+    kind = SK_Function;
+  else if (name == "record")
+    kind = SK_Record;
+  else
+    return false;
+  return true;
+}
+
 SymbolsList::SymbolsList() {
   mSymbolsListImpl = new std::vector<SymbolsListNode>;
 }
@@ -25,42 +40,51 @@ size_t SymbolsList::getCount() const {
   return SYMSLIST->size();
 }
 
+SymbolKind SymbolsList::getKind(size_t index) const {
+  return (*SYMSLIST)[index].Kind;
+}
+
 StringRef SymbolsList::getType(size_t index) const {
-  return (*SYMSLIST)[index].first;
+  return GetSymbolKindName((*SYMSLIST)[index].Kind);
 }
 
 StringRef SymbolsList::getSignature(size_t index) const {
-  return (*SYMSLIST)[index].second;
+  return (*SYMSLIST)[index].Signature;
 }
 
-static inline void AppendSymbol(
-  void *mSymbolsListImpl,
-  const char* type, const std::string& signature) {
-  SYMSLIST->push_back(std::make_pair(type, signature));
+void SymbolsList::appendSymbol(SymbolKind kind, StringRef signature) {
+  SymbolsListNode node = { kind, InternString(signature) };
+  SYMSLIST->push_back(node);
 }
 
 #undef SYMSLIST
 
+void SymbolsListingVisitor::appendSymbol(SymbolKind kind,
+  const NamedDecl *d) {
+  StringRef signature = mMangler.getSignature(d);
+  mSymbols.appendSymbol(kind, signature);
+  if (!mWriter)
+    return;
+
+  const SourceManager &srcMgr = mContext->getSourceManager();
+  const FileEntry *file = srcMgr.getFileEntryForID(srcMgr.getMainFileID());
+  mWriter->writeSymbol(file ? file->getName() : StringRef(),
+    GetSymbolKindName(kind), signature);
+}
+
+// Declarations in function bodies are not symbols, so that the list is the
+// same whether bodies are parsed or not.
 bool SymbolsListingVisitor::VisitFunctionDecl(FunctionDecl *fd) {
-  if (mContext->getSourceManager().isInMainFile(fd->getLocation())) {
-    std::string signature;
-    std::unique_ptr<MangleContext> mangleContext
-      = std::unique_ptr<MangleContext>(mContext->createMangleContext());
-    mangleContext->mangleName(fd, llvm::raw_string_ostream(signature));
-    AppendSymbol(mSymbols.mSymbolsListImpl, "function", signature);
-  }
+  if (mContext->getSourceManager().isInMainFile(fd->getLocation())
+    && !fd->getParentFunctionOrMethod())
+    appendSymbol(SK_Function, fd);
   return true;
 }
 
 bool SymbolsListingVisitor::VisitRecordDecl(RecordDecl *rd) {
-  if (mContext->getSourceManager().isInMainFile(rd->getLocation())) {
-    std::string signature;
-    std::unique_ptr<MangleContext> mangleContext
-      = std::unique_ptr<MangleContext>(mContext->createMangleContext());
-    QualType type = rd->getTypeForDecl()->getCanonicalTypeInternal();
-    mangleContext->mangleTypeName(type, llvm::raw_string_ostream(signature));
-    AppendSymbol(mSymbols.mSymbolsListImpl, "record", signature);
-  }
+  if (mContext->getSourceManager().isInMainFile(rd->getLocation())
+    && !rd->getParentFunctionOrMethod())
+    appendSymbol(SK_Record, rd);
   return true;
 }
 
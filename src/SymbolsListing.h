@@ -1,23 +1,43 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_SYMBOLS_LISTING_H
 #define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_SYMBOLS_LISTING_H
 
+#include "SymbolMangling.h"
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendAction.h"
+#include <memory>
 
 namespace clang {
 namespace closure {
 
-class SymbolsList final {
-  friend class SymbolsListingVisitor;
+class RecordWriter;
+
+enum SymbolKind {
+  SK_Function,
+  SK_Record
+};
+
+// "function" or "record", as symbols are listed and cached.
+StringRef GetSymbolKindName(SymbolKind kind);
 
+// Parses the name GetSymbolKindName returns. Returns false for other names.
+bool ParseSymbolKind(StringRef name, SymbolKind &kind);
+
+// Signatures are interned, so that the list holds no string of its own and
+// what it returns stays valid after it is gone.
+class SymbolsList final {
 public:
   SymbolsList();
   ~SymbolsList();
 
   size_t getCount() const;
+  SymbolKind getKind(size_t index) const;
   StringRef getType(size_t index) const;
   StringRef getSignature(size_t index) const;
 
+  void appendSymbol(SymbolKind kind, StringRef signature);
+
 private:
   void *mSymbolsListImpl;
 };
@@ -25,8 +45,12 @@ private:
 class SymbolsListingVisitor
   : public RecursiveASTVisitor<SymbolsListingVisitor> {
 public:
-  SymbolsListingVisitor(SymbolsList &symbols) :
-    mContext(nullptr), mSymbols(symbols) {}
+  // Every symbol found is also written to writer, if given.
+  SymbolsListingVisitor(SymbolsList &symbols,
+    SymbolMangler &mangler,
+    RecordWriter *writer = nullptr) :
+    mContext(nullptr), mSymbols(symbols), mMangler(mangler),
+    mWriter(writer) {}
 
   bool VisitFunctionDecl(FunctionDecl *fd);
 
@@ -34,26 +58,56 @@ public:
 
   void SetASTContext(ASTContext *context) {
     mContext = context;
+    mMangler.setASTContext(*context);
   }
 
 private:
+  void appendSymbol(SymbolKind kind, const NamedDecl *d);
+
   ASTContext *mContext;
   SymbolsList &mSymbols;
+  SymbolMangler &mMangler;
+  RecordWriter *mWriter;
 };
 
 class SymbolsListingConsumer : public clang::ASTConsumer {
 public:
-  explicit SymbolsListingConsumer(SymbolsList &symbols)
-    : mVisitor(symbols) {}
+  // Uses mangler if given, otherwise a mangler of its own.
+  explicit SymbolsListingConsumer(SymbolsList &symbols,
+    SymbolMangler *mangler = nullptr,
+    RecordWriter *writer = nullptr)
+    : mOwnedMangler(mangler ? nullptr : new SymbolMangler),
+    mVisitor(symbols, mangler ? *mangler : *mOwnedMangler, writer) {}
 
   bool HandleTopLevelDecl(DeclGroupRef DR) override;
 
   void Initialize(ASTContext &Context) override;
 
 private:
+  std::unique_ptr<SymbolMangler> mOwnedMangler;
   SymbolsListingVisitor mVisitor;
 };
 
+class SymbolsListingAction : public ASTFrontendAction {
+public:
+  explicit SymbolsListingAction(SymbolsList &symbols,
+    RecordWriter *writer = nullptr)
+    : mSymbols(symbols), mWriter(writer) {}
+
+  // No symbol is listed from a function body, so none is parsed.
+  std::unique_ptr<ASTConsumer> CreateASTConsumer(
+    CompilerInstance &CI,
+    StringRef InFile) override {
+    CI.getFrontendOpts().SkipFunctionBodies = true;
+    return llvm::make_unique<SymbolsListingConsumer>(mSymbols, nullptr,
+      mWriter);
+  }
+
+private:
+  SymbolsList &mSymbols;
+  RecordWriter *mWriter;
+};
+
 } // namespace closure
 } // namespace clang
 
@@ -0,0 +1,201 @@
+#include "TUScheduling.h"
+#include "FileWriting.h"
+#include "TimeTracing.h"
+#include "llvm/Support/Errc.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ThreadPool.h"
+#include <algorithm>
+#include <deque>
+#include <numeric>
+#include <tuple>
+#include <utility>
+
+namespace clang {
+namespace closure {
+
+// The score of an included file, in bytes of the source. Headers usually
+// make up most of what a TU parses.
+static const double InclusionWeight = 16384;
+
+namespace {
+
+struct WorkQueue {
+  std::mutex Mutex;
+  std::deque<size_t> Indices;
+};
+
+} // end anonymous namespace
+
+void ForEachByCost(unsigned jobs,
+  ArrayRef<double> costs,
+  std::function<void(size_t)> f) {
+  std::vector<size_t> order(costs.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return costs[a] > costs[b];
+  });
+  if (jobs <= 1 || order.size() <= 1) {
+    for (size_t i : order)
+      f(i);
+    return;
+  }
+
+  // Dealing the indices out in turn gives every queue a share of the costly
+  // TUs. Thieves take the costliest left in a queue too, since a costly TU
+  // started late is what makes a build long.
+  unsigned threads = std::min<size_t>(jobs, order.size());
+  std::vector<WorkQueue> queues(threads);
+  for (size_t k = 0, count = order.size(); k != count; ++k)
+    queues[k % threads].Indices.push_back(order[k]);
+
+  auto take = [&](unsigned self, size_t &index) {
+    for (unsigned i = 0; i != threads; ++i) {
+      WorkQueue &queue = queues[(self + i) % threads];
+      std::lock_guard<std::mutex> lock(queue.Mutex);
+      if (!queue.Indices.empty()) {
+        index = queue.Indices.front();
+        queue.Indices.pop_front();
+        return true;
+      }
+    }
+    return false;
+  };
+
+  llvm::ThreadPool pool(threads);
+  for (unsigned t = 0; t != threads; ++t) {
+    pool.async([&, t]() {
+      size_t index;
+      while (take(t, index))
+        f(index);
+    });
+  }
+  pool.wait();
+}
+
+bool TUCostModel::load(StringRef path, std::string &error) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer
+    = llvm::MemoryBuffer::getFile(path);
+  if (!buffer) {
+    if (buffer.getError() == llvm::errc::no_such_file_or_directory)
+      return true;
+    error = buffer.getError().message();
+    return false;
+  }
+
+  llvm::StringMap<uint64_t> previous;
+  for (llvm::line_iterator line(**buffer), end; line != end; ++line) {
+    StringRef time, source;
+    std::tie(time, source) = line->split(' ');
+    uint64_t microseconds;
+    if (time.getAsInteger(10, microseconds) || source.empty()) {
+      error = "malformed TU stats";
+      return false;
+    }
+    previous[source] = microseconds;
+  }
+  std::lock_guard<std::mutex> lock(mMutex);
+  mPrevious = std::move(previous);
+  return true;
+}
+
+double TUCostModel::scoreSource(StringRef source) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer
+    = llvm::MemoryBuffer::getFile(source);
+  if (!buffer)
+    return 0;
+
+  size_t inclusions = 0;
+  for (llvm::line_iterator line(**buffer), end; line != end; ++line) {
+    StringRef directive = line->ltrim();
+    if (!directive.startswith("#"))
+      continue;
+    directive = directive.drop_front().ltrim();
+    if (directive.startswith("include") || directive.startswith("import"))
+      ++inclusions;
+  }
+  return (*buffer)->getBufferSize() + inclusions * InclusionWeight;
+}
+
+std::vector<double> TUCostModel::getCosts(
+  ArrayRef<std::string> sources) const {
+  TimeTraceScope scope("PredictTUCosts");
+  std::vector<double> costs(sources.size(), -1);
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (size_t i = 0, count = sources.size(); i != count; ++i) {
+      auto iter = mPrevious.find(sources[i]);
+      if (iter != mPrevious.end())
+        costs[i] = iter->second;
+    }
+  }
+  if (std::find(costs.begin(), costs.end(), -1) == costs.end())
+    return costs;
+
+  // Scores of the TUs with a time tell how much time a score stands for.
+  std::vector<double> scores(sources.size());
+  double knownTime = 0, knownScore = 0;
+  for (size_t i = 0, count = sources.size(); i != count; ++i) {
+    scores[i] = scoreSource(sources[i]);
+    if (costs[i] >= 0) {
+      knownTime += costs[i];
+      knownScore += scores[i];
+    }
+  }
+  double scale = knownScore > 0 ? knownTime / knownScore : 1;
+  for (size_t i = 0, count = sources.size(); i != count; ++i) {
+    if (costs[i] < 0)
+      costs[i] = scores[i] * scale;
+  }
+  return costs;
+}
+
+void TUCostModel::record(StringRef source, ClockType::duration time) {
+  uint64_t microseconds
+    = std::chrono::duration_cast<std::chrono::microseconds>(time).count();
+  std::lock_guard<std::mutex> lock(mMutex);
+  // Demand-driven builds parse some TUs more than once.
+  mRecorded[source] += microseconds;
+}
+
+// Entries of times, longest first.
+static std::vector<std::pair<uint64_t, StringRef>> SortTimes(
+  const llvm::StringMap<uint64_t> &times) {
+  std::vector<std::pair<uint64_t, StringRef>> r;
+  for (const auto &entry : times)
+    r.push_back(std::make_pair(entry.getValue(), entry.getKey()));
+  std::sort(r.begin(), r.end(), [](const std::pair<uint64_t, StringRef> &a,
+    const std::pair<uint64_t, StringRef> &b) {
+    return a.first != b.first ? a.first > b.first : a.second < b.second;
+  });
+  return r;
+}
+
+bool TUCostModel::write(StringRef path, std::string &error) const {
+  std::string content;
+  llvm::raw_string_ostream os(content);
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    llvm::StringMap<uint64_t> times(mPrevious);
+    for (const auto &entry : mRecorded)
+      times[entry.getKey()] = entry.getValue();
+    for (const auto &entry : SortTimes(times))
+      os << entry.first << " " << entry.second << "\n";
+  }
+  os.flush();
+  return WriteFileAtomically(path, content, error);
+}
+
+void TUCostModel::printReport(llvm::raw_ostream &os) const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (mRecorded.empty())
+    return;
+  os << "===-- clang-closure TU times --===\n"
+    << "    Time (s)  Translation unit\n";
+  for (const auto &entry : SortTimes(mRecorded))
+    os << llvm::format("%12.4f  ", entry.first / 1e6) << entry.second << "\n";
+}
+
+} // namespace closure
+} // namespace clang
@@ -0,0 +1,62 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_TU_SCHEDULING_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_TU_SCHEDULING_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace closure {
+
+// Calls f with every index of costs on up to jobs threads, costliest first,
+// so that the longest TUs do not start last. Indices are dealt out to one
+// queue per thread; a thread takes the costliest of its own queue, and once
+// it is empty steals the costliest left in another one.
+void ForEachByCost(unsigned jobs,
+  ArrayRef<double> costs,
+  std::function<void(size_t)> f);
+
+// Predicts the time TUs take to build from the times of previous runs, kept
+// in a stats file of "<microseconds> <source>" lines, longest first. TUs
+// which are not in it are scored by the size of their source and the number
+// of files it includes, scaled to the times of those which are.
+class TUCostModel {
+public:
+  typedef std::chrono::steady_clock ClockType;
+
+  // Reads the stats file at path. A missing file is no error, since the
+  // first run has none.
+  bool load(StringRef path, std::string &error);
+
+  // Predicted costs of sources, in microseconds.
+  std::vector<double> getCosts(ArrayRef<std::string> sources) const;
+
+  // Records the time source took in this run. Thread safe.
+  void record(StringRef source, ClockType::duration time);
+
+  // Writes the times of this run, and those previous runs recorded for
+  // other sources, to path.
+  bool write(StringRef path, std::string &error) const;
+
+  // Prints the times of this run, longest first.
+  void printReport(llvm::raw_ostream &os) const;
+
+private:
+  static double scoreSource(StringRef source);
+
+  mutable std::mutex mMutex;
+  llvm::StringMap<uint64_t> mPrevious;
+  llvm::StringMap<uint64_t> mRecorded;
+};
+
+} // namespace closure
+} // namespace clang
+
+#endif
@@ -0,0 +1,85 @@
+#include "TimeTracing.h"
+#include "RecordWriting.h"
+#include "llvm/Support/Format.h"
+#include <algorithm>
+
+namespace clang {
+namespace closure {
+
+std::atomic<TimeTracer*> TimeTracer::sInstance(nullptr);
+
+void TimeTracer::addSpan(StringRef name,
+  StringRef detail,
+  ClockType::time_point start,
+  ClockType::time_point end) {
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+
+  Span span;
+  span.Name = name;
+  span.Detail = detail;
+  span.Start = duration_cast<microseconds>(start - mStart).count();
+  span.Duration = duration_cast<microseconds>(end - start).count();
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  span.Thread = mThreads.insert(std::make_pair(std::this_thread::get_id(),
+    mThreads.size())).first->second;
+  mSpans.push_back(std::move(span));
+  Total &total = mTotals[name];
+  total.Time += end - start;
+  ++total.Count;
+}
+
+void TimeTracer::addTime(StringRef name,
+  ClockType::duration duration,
+  size_t count) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  Total &total = mTotals[name];
+  total.Time += duration;
+  total.Count += count;
+}
+
+void TimeTracer::writeTrace(llvm::raw_ostream &os) const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  os << "{\"traceEvents\": [\n";
+  for (size_t i = 0, count = mSpans.size(); i != count; ++i) {
+    const Span &span = mSpans[i];
+    os << "{\"ph\": \"X\", \"pid\": 1, \"tid\": " << span.Thread
+      << ", \"ts\": " << span.Start
+      << ", \"dur\": " << span.Duration
+      << ", \"name\": ";
+    WriteJSONString(os, span.Name);
+    if (!span.Detail.empty()) {
+      os << ", \"args\": {\"detail\": ";
+      WriteJSONString(os, span.Detail);
+      os << "}";
+    }
+    os << "}" << (i + 1 != count ? "," : "") << "\n";
+  }
+  os << "]}\n";
+}
+
+void TimeTracer::printReport(llvm::raw_ostream &os) const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  std::vector<std::pair<StringRef, const Total*>> totals;
+  for (const auto &total : mTotals)
+    totals.push_back(std::make_pair(total.getKey(), &total.getValue()));
+  std::sort(totals.begin(), totals.end(),
+    [](const std::pair<StringRef, const Total*> &a,
+      const std::pair<StringRef, const Total*> &b) {
+      return a.second->Time > b.second->Time;
+    });
+
+  // Spans of TUs parsed in parallel overlap, so totals may add up to more
+  // than the wall time.
+  os << "===-- clang-closure time report --===\n"
+    << "   Total (s)      Count  Name\n";
+  for (const auto &total : totals) {
+    std::chrono::duration<double> seconds = total.second->Time;
+    os << llvm::format("%12.4f %10zu  ", seconds.count(), total.second->Count)
+      << total.first << "\n";
+  }
+}
+
+} // namespace closure
+} // namespace clang
@@ -0,0 +1,174 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_TIME_TRACING_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_CLOSURE_TIME_TRACING_H
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace clang {
+namespace closure {
+
+// Collects the spans recorded by TimeTraceScope and the times added by
+// TimeTotals, from any thread. Nothing is recorded unless a tracer is
+// installed, in which case a scope costs two clock reads.
+class TimeTracer {
+public:
+  typedef std::chrono::steady_clock ClockType;
+
+  // Spans are timed relative to start.
+  explicit TimeTracer(ClockType::time_point start = ClockType::now())
+    : mStart(start) {}
+
+  // Makes tracer the one scopes record into; nullptr stops recording.
+  static void setInstance(TimeTracer *tracer) {
+    sInstance.store(tracer);
+  }
+
+  static TimeTracer *getInstance() {
+    return sInstance.load(std::memory_order_relaxed);
+  }
+
+  // Adds a span of the trace, which also counts towards the report.
+  void addSpan(StringRef name,
+    StringRef detail,
+    ClockType::time_point start,
+    ClockType::time_point end);
+
+  // Adds time taken count times to the report only, for work too
+  // fine-grained to be spans.
+  void addTime(StringRef name,
+    ClockType::duration duration,
+    size_t count = 1);
+
+  // Writes the spans in the Chrome trace event format.
+  void writeTrace(llvm::raw_ostream &os) const;
+
+  // Prints the total time and count of every name, longest first.
+  void printReport(llvm::raw_ostream &os) const;
+
+private:
+  struct Span {
+    std::string Name;
+    std::string Detail;
+    int64_t Start;
+    int64_t Duration;
+    unsigned Thread;
+  };
+
+  struct Total {
+    ClockType::duration Time = ClockType::duration::zero();
+    size_t Count = 0;
+  };
+
+  static std::atomic<TimeTracer*> sInstance;
+
+  mutable std::mutex mMutex;
+  ClockType::time_point mStart;
+  std::vector<Span> mSpans;
+  std::map<std::thread::id, unsigned> mThreads;
+  llvm::StringMap<Total> mTotals;
+};
+
+// Records a span from construction to destruction into the installed
+// tracer. Detail, such as the file worked on, must outlive the scope.
+class TimeTraceScope {
+public:
+  explicit TimeTraceScope(StringRef name, StringRef detail = StringRef())
+    : mTracer(TimeTracer::getInstance()) {
+    if (mTracer) {
+      mName = name;
+      mDetail = detail;
+      mStart = TimeTracer::ClockType::now();
+    }
+  }
+
+  ~TimeTraceScope() {
+    if (mTracer)
+      mTracer->addSpan(mName, mDetail, mStart, TimeTracer::ClockType::now());
+  }
+
+private:
+  TimeTracer *mTracer;
+  StringRef mName;
+  StringRef mDetail;
+  TimeTracer::ClockType::time_point mStart;
+};
+
+// Sums the times of scopes entered many times, such as those of callbacks
+// of a TU, and adds them to the report of the installed tracer at once when
+// destroyed, so that the scopes do not take the lock of the tracer.
+class TimeTotals {
+public:
+  TimeTotals() : mTracer(TimeTracer::getInstance()) {}
+  TimeTotals(const TimeTotals &) = delete;
+  TimeTotals &operator=(const TimeTotals &) = delete;
+
+  ~TimeTotals() {
+    for (const Total &total : mTotals)
+      mTracer->addTime(total.Name, total.Time, total.Count);
+  }
+
+  // The tracer installed when the totals were made, if any.
+  TimeTracer *getTracer() const {
+    return mTracer;
+  }
+
+  void addTime(StringRef name, TimeTracer::ClockType::duration duration) {
+    // Few names are summed by one object, and their strings are literals.
+    for (Total &total : mTotals) {
+      if (total.Name.data() == name.data()) {
+        total.Time += duration;
+        ++total.Count;
+        return;
+      }
+    }
+    Total total = { name, duration, 1 };
+    mTotals.push_back(total);
+  }
+
+private:
+  struct Total {
+    StringRef Name;
+    TimeTracer::ClockType::duration Time;
+    size_t Count;
+  };
+
+  TimeTracer *mTracer;
+  std::vector<Total> mTotals;
+};
+
+// Adds the time from construction to destruction to totals. Name must
+// outlive totals.
+class TimeTotalScope {
+public:
+  TimeTotalScope(StringRef name, TimeTotals &totals)
+    : mTotals(totals.getTracer() ? &totals : nullptr) {
+    if (mTotals) {
+      mName = name;
+      mStart = TimeTracer::ClockType::now();
+    }
+  }
+
+  ~TimeTotalScope() {
+    if (mTotals)
+      mTotals->addTime(mName, TimeTracer::ClockType::now() - mStart);
+  }
+
+private:
+  TimeTotals *mTotals;
+  StringRef mName;
+  TimeTracer::ClockType::time_point mStart;
+};
+
+} // namespace closure
+} // namespace clang
+
+#endif
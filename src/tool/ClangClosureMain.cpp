@@ -1,6 +1,20 @@
 #include "SymbolsListing.h"
 #include "SymbolLocating.h"
+#include "SymbolPrescan.h"
 #include "RelationConstruction.h"
+#include "RelationGraphBuilder.h"
+#include "RelationIndex.h"
+#include "ClosureComputation.h"
+#include "ClosureMaterializing.h"
+#include "DeclarationSlicing.h"
+#include "GraphSharding.h"
+#include "IndexCache.h"
+#include "InclusionScanning.h"
+#include "PreambleSharing.h"
+#include "QueryServer.h"
+#include "RecordWriting.h"
+#include "TUScheduling.h"
+#include "TimeTracing.h"
 #include "clang/AST/AST.h"
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/Mangle.h"
@@ -12,8 +26,13 @@
 #include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/Tooling/Tooling.h"
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
+#include <atomic>
+#include <iostream>
 #include <map>
 #include <set>
 #include <string>
@@ -38,8 +57,150 @@ llvm::cl::opt<int> SelectedSymbolIndex("symbol",
   llvm::cl::desc("Select symbol by its ID"),
   llvm::cl::cat(ClangClosureCategory));
 
+llvm::cl::opt<std::string> SelectedSymbolName("symbol-name",
+  llvm::cl::desc("Select the symbol by its name, which may be qualified, "
+    "instead of by its ID"),
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::opt<std::string> SelectedSymbolUSR("usr",
+  llvm::cl::desc("Select the symbol by its USR instead of by its ID"),
+  llvm::cl::cat(ClangClosureCategory));
+
 llvm::cl::opt<std::string> FileOfSymbol("file",
-  llvm::cl::desc("The file where the selected symbol resides"),
+  llvm::cl::desc("The file where the selected symbol resides; when a symbol "
+    "is selected by name or USR, the sources are prescanned for it if this "
+    "is not given"),
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::opt<unsigned> Jobs("j",
+  llvm::cl::desc("Number of translation units parsed in parallel"),
+  llvm::cl::init(1),
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::opt<std::string> CacheDirectory("cache-dir",
+  llvm::cl::desc("Directory of the cache of per-TU results; TUs whose "
+    "inputs are unchanged are not parsed again"),
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::opt<bool> InclusionsOnly("inclusions-only",
+  llvm::cl::desc("Only print the inclusion tree, scanning include directives "
+    "instead of parsing"),
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::opt<std::string> PreambleDirectory("preamble-dir",
+  llvm::cl::desc("Directory where the PCHs of include prefixes shared by "
+    "TUs are built; TUs are then parsed on top of them"),
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::opt<bool> Serve("serve",
+  llvm::cl::desc("Keep the graphs in memory and answer JSON requests read "
+    "from stdin, one per line"),
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::opt<std::string> EmitIndex("emit-index",
+  llvm::cl::desc("Write the graphs to an index file which -load-index maps"),
+  llvm::cl::value_desc("file"),
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::opt<std::string> LoadIndex("load-index",
+  llvm::cl::desc("Map the graphs from an index file instead of parsing the "
+    "sources"),
+  llvm::cl::value_desc("file"),
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::opt<std::string> Shard("shard",
+  llvm::cl::desc("Parse only the i-th of N parts of the sources and write "
+    "their graph to the file given by -emit-graph"),
+  llvm::cl::value_desc("i/N"),
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::opt<std::string> EmitGraph("emit-graph",
+  llvm::cl::desc("Write the graph of the sources, or of the shard, to a "
+    "graph file which -merge reads"),
+  llvm::cl::value_desc("file"),
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::list<std::string> MergeGraphs("merge",
+  llvm::cl::desc("Build the graphs by merging graph files instead of "
+    "parsing the sources"),
+  llvm::cl::value_desc("file"),
+  llvm::cl::ZeroOrMore,
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::opt<std::string> OutputDirectory("output-dir",
+  llvm::cl::desc("Place the files of the printed closures in this directory, "
+    "each at its absolute path under it, with a compile_commands.json of "
+    "the sources among them"),
+  llvm::cl::value_desc("directory"),
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::opt<bool> OutputHardlinks("output-hardlinks",
+  llvm::cl::desc("Hardlink the files placed by -output-dir where possible, "
+    "so that they share the originals rather than copies of them"),
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::opt<std::string> TimeTraceFile("time-trace",
+  llvm::cl::desc("Write a Chrome trace event file of the phases of the run "
+    "and of every TU"),
+  llvm::cl::value_desc("file"),
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::opt<bool> TimeReport("time-report",
+  llvm::cl::desc("Print the time spent in each phase, and in each TU, to "
+    "stderr"),
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::opt<std::string> TUStats("tu-stats",
+  llvm::cl::desc("Start the TUs which took longest in previous runs first, "
+    "reading their times from this file and writing them back"),
+  llvm::cl::value_desc("file"),
+  llvm::cl::cat(ClangClosureCategory));
+
+enum OutputFormat {
+  OF_Text,
+  OF_NDJSON
+};
+
+llvm::cl::opt<OutputFormat> Format("format",
+  llvm::cl::desc("Format of the results"),
+  llvm::cl::values(
+    clEnumValN(OF_Text, "text", "Print the results once they are complete"),
+    clEnumValN(OF_NDJSON, "ndjson", "Stream one JSON record per line as "
+      "results are found")),
+  llvm::cl::init(OF_Text),
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::opt<bool> AllFunctionBodies("all-bodies",
+  llvm::cl::desc("Parse every function body, instead of only those of the "
+    "functions the printed closures reach"),
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::opt<bool> DemandDriven("demand-driven",
+  llvm::cl::desc("Parse only the TUs which may define the symbols the "
+    "printed closures reach, found with a prescan of the sources; the "
+    "inclusion tree then only covers those TUs"),
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::list<std::string> ClosureSymbols("closure-symbol",
+  llvm::cl::desc("Also print the closure of the symbol with this signature"),
+  llvm::cl::ZeroOrMore,
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::opt<bool> AllSymbolsInFile("all-symbols",
+  llvm::cl::desc("Print the closure of every symbol defined in the file "
+    "given by -file"),
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::opt<bool> MinimalClosures("minimal",
+  llvm::cl::desc("Print only the files which define what the symbol needs "
+    "and the headers through which they are included; the bodies of inline "
+    "functions of headers are parsed for this"),
+  llvm::cl::cat(ClangClosureCategory));
+
+llvm::cl::opt<std::string> SliceFile("slice",
+  llvm::cl::desc("Write the declarations the printed closures need to this "
+    "file, in the order they depend on each other, instead of whole files"),
+  llvm::cl::value_desc("file"),
   llvm::cl::cat(ClangClosureCategory));
 
 //===----------------------------------------------------------------------===//
@@ -47,105 +208,195 @@ llvm::cl::opt<std::string> FileOfSymbol("file",
 //===----------------------------------------------------------------------===//
 std::string gSelectedSymbolSignature;
 
-closure::FilesMapType gFileInclusionTree;
-closure::FilesSetType gSystemHeadersInMainFiles;
+closure::RelationGraph gRelationGraph;
 
-closure::SymbolsMapType gSymbols;
+std::unique_ptr<closure::SymbolPrescanner> gPrescanner;
 
 //===----------------------------------------------------------------------===//
 // Symbols listing
 //===----------------------------------------------------------------------===//
 
-class SymbolsListingAction : public ASTFrontendAction {
-public:
-  void EndSourceFileAction() override {
-    for (size_t i = 0, count = mSymbols.getCount(); i != count; ++i) {
-      llvm::outs() << i << " "
-        << mSymbols.getType(i) << " "
-        << mSymbols.getSignature(i) << "\n";
-    }
+static void PrintSymbolsList(const closure::SymbolsList &symbols) {
+  for (size_t i = 0, count = symbols.getCount(); i != count; ++i) {
+    llvm::outs() << i << " "
+      << symbols.getType(i) << " "
+      << symbols.getSignature(i) << "\n";
   }
+}
 
-  std::unique_ptr<ASTConsumer> CreateASTConsumer(
-    CompilerInstance &CI,
-    StringRef InFile) override {
-    return llvm::make_unique<closure::SymbolsListingConsumer>(mSymbols);
-  }
+static void WriteSymbolsList(closure::RecordWriter &writer,
+  StringRef file,
+  const closure::SymbolsList &symbols) {
+  for (size_t i = 0, count = symbols.getCount(); i != count; ++i)
+    writer.writeSymbol(file, symbols.getType(i), symbols.getSignature(i));
+}
 
-private:
-  closure::SymbolsList mSymbols;
-};
+// Symbols are written to writer while TUs are parsed if it is given, and
+// printed once each TU is done otherwise.
+static int ListSymbolsOfSources(const CompilationDatabase &compilations,
+  ArrayRef<std::string> sources,
+  closure::IndexCache *cache,
+  const closure::PreambleBuilder *preambles,
+  closure::RecordWriter *writer) {
+  int r = 0;
+  for (const std::string &source : sources) {
+    closure::SymbolsList symbols;
+    if (cache && cache->loadSymbolsList(compilations, source, symbols)) {
+      if (writer)
+        WriteSymbolsList(*writer, source, symbols);
+    }
+    else {
+      const closure::SharedPreamble *preamble
+        = preambles ? preambles->getPreamble(source) : nullptr;
+      std::vector<std::string> extraArgs;
+      if (preamble) {
+        extraArgs.push_back("-include-pch");
+        extraArgs.push_back(preamble->PCHPath);
+      }
 
-//===----------------------------------------------------------------------===//
-// Symbol locating of selected symbol
-//===----------------------------------------------------------------------===//
+      std::vector<std::string> inputFiles;
+      bool parsed = closure::RunFrontendActionOnFile(compilations, source,
+        [&]() {
+          return new closure::InputFilesRecordingAction(
+            new closure::SymbolsListingAction(symbols, writer), inputFiles);
+        }, extraArgs);
+      if (parsed && preamble) {
+        inputFiles.insert(inputFiles.end(),
+          preamble->InputFiles.begin(), preamble->InputFiles.end());
+      }
+      if (!parsed)
+        r = 1;
+      else if (cache)
+        cache->storeSymbolsList(compilations, source, symbols, inputFiles);
+    }
 
-class SymbolLocatingAction : public ASTFrontendAction {
-public:
-  std::unique_ptr<ASTConsumer> CreateASTConsumer(
-    CompilerInstance &CI,
-    StringRef InFile) override {
-    return llvm::make_unique<closure::SymbolLocatingConsumer>(
-      gSelectedSymbolSignature, SelectedSymbolIndex);
+    if (writer)
+      writer->flush();
+    else
+      PrintSymbolsList(symbols);
   }
-};
+  return r;
+}
 
 //===----------------------------------------------------------------------===//
-// Relation construction
+// Symbol locating
 //===----------------------------------------------------------------------===//
 
-class RelationConstructionAction : public ASTFrontendAction {
-public:
-  std::unique_ptr<ASTConsumer> CreateASTConsumer(
-    CompilerInstance &CI,
-    StringRef InFile) override {
-    Preprocessor &pp = CI.getPreprocessor();
-    pp.addPPCallbacks(llvm::make_unique<closure::InclusionPPCallbacks>(
-      CI.getSourceManager(),
-      gSystemHeadersInMainFiles,
-      gFileInclusionTree));
-    return llvm::make_unique<closure::RelationConstructionConsumer>(gSymbols);
+static closure::SymbolSelector GetSymbolSelector() {
+  if (!SelectedSymbolUSR.empty()) {
+    return closure::SymbolSelector(closure::SymbolSelector::ByUSR,
+      SelectedSymbolUSR);
   }
-};
+  if (!SelectedSymbolName.empty()) {
+    return closure::SymbolSelector(closure::SymbolSelector::ByName,
+      SelectedSymbolName);
+  }
+  return closure::SymbolSelector(SelectedSymbolIndex);
+}
 
-static bool IsSystemHeaderInMainFile(closure::FileKeyType f) {
-  return gSystemHeadersInMainFiles.find(f)
-    != gSystemHeadersInMainFiles.end();
+// The prescan of sources is shared by symbol locating and demand-driven
+// builds.
+static const closure::SymbolPrescanner &GetPrescanner(
+  ArrayRef<std::string> sources) {
+  if (!gPrescanner) {
+    closure::TimeTraceScope scope("PrescanSymbols");
+    gPrescanner = llvm::make_unique<closure::SymbolPrescanner>();
+    gPrescanner->addFiles(sources, Jobs);
+  }
+  return *gPrescanner;
 }
 
-static size_t CountUserHeader(const closure::FileNode &node) {
+// Returns the files to look for the selected symbol in, most likely first.
+static std::vector<std::string> GetFilesOfSymbol(
+  const closure::SymbolSelector &selector,
+  ArrayRef<std::string> sources) {
+  if (!FileOfSymbol.empty())
+    return std::vector<std::string>(1, FileOfSymbol);
+  if (selector.Kind == closure::SymbolSelector::ByIndex)
+    return std::vector<std::string>();
+
+  std::vector<std::string> files;
+  if (!selector.getIdentifier().empty())
+    files = GetPrescanner(sources).getFiles(selector.getIdentifier());
+  // Definitions the prescan can not see, such as those made by macros, are
+  // still found by parsing every source.
+  if (files.empty())
+    files.assign(sources.begin(), sources.end());
+  return files;
+}
+
+// Parses files on up to Jobs threads for the selected symbol, which is
+// taken from the first of them which has it. Each parse ends as soon as the
+// symbol is found, and files after one which has it are not started.
+static void LocateSymbol(const CompilationDatabase &compilations,
+  ArrayRef<std::string> files,
+  const closure::SymbolSelector &selector) {
+  std::vector<std::string> signatures(files.size());
+  std::atomic<size_t> first(files.size());
+  auto locate = [&](size_t i) {
+    if (i > first)
+      return;
+    closure::RunFrontendActionOnFile(compilations, files[i], [&]() {
+      return new closure::SymbolLocatingAction(signatures[i], selector);
+    });
+    size_t found = first;
+    while (!signatures[i].empty() && i < found
+      && !first.compare_exchange_weak(found, i))
+      ;
+  };
+
+  if (Jobs <= 1) {
+    for (size_t i = 0, count = files.size(); i != count; ++i)
+      locate(i);
+  }
+  else {
+    llvm::ThreadPool pool(Jobs);
+    for (size_t i = 0, count = files.size(); i != count; ++i)
+      pool.async([&locate, i]() { locate(i); });
+    pool.wait();
+  }
+  if (first != files.size())
+    gSelectedSymbolSignature = signatures[first];
+}
+
+//===----------------------------------------------------------------------===//
+// Inclusion tree printing
+//===----------------------------------------------------------------------===//
+
+static size_t CountUserHeader(const closure::RelationIndex &index,
+  closure::FileIndexType file) {
   size_t r = 0;
-  for (size_t i = 0, count = node.getInclusionsCount(); i != count; ++i) {
-    if (!IsSystemHeaderInMainFile(node.getInclusion(i)))
+  for (closure::FileIndexType k : index.getInclusions(file)) {
+    if (!index.isSystemHeaderInMainFile(k))
       ++r;
   }
   return r;
 }
 
-static void PrintInclusionTree() {
-  for (auto iter = gFileInclusionTree.begin();
-    iter != gFileInclusionTree.end(); ++iter) {
-    if (IsSystemHeaderInMainFile(iter->first))
+static void PrintFileKey(const closure::FileKeyType &k) {
+  llvm::outs() << k.getDevice() << "-" << k.getFile();
+}
+
+static void PrintInclusionTree(const closure::RelationIndex &index) {
+  closure::TimeTraceScope scope("PrintInclusionTree");
+  for (closure::FileIndexType i = 0, count = index.getFilesCount();
+    i != count;
+    ++i) {
+    // Files only known by their key were never seen including anything.
+    if (index.isSystemHeaderInMainFile(i) || index.getFileName(i).empty())
       continue;
 
-    llvm::outs() << iter->first.getDevice() << "-"
-      << iter->first.getFile() << " "
-      << iter->second.getFileName() << "\n";
+    PrintFileKey(index.getFileKey(i));
+    llvm::outs() << " " << index.getFileName(i) << "\n";
 
-    if (CountUserHeader(iter->second) != 0)
+    if (CountUserHeader(index, i) != 0)
       llvm::outs() << "includes:\n";
-    for (size_t j = 0, count = iter->second.getInclusionsCount();
-      j != count;
-      ++j) {
-      const closure::FileKeyType &k = iter->second.getInclusion(j);
-      if (IsSystemHeaderInMainFile(k))
+    for (closure::FileIndexType k : index.getInclusions(i)) {
+      if (index.isSystemHeaderInMainFile(k))
         continue;
-      llvm::outs() << k.getDevice() << "-" << k.getFile();
-
-      auto r = gFileInclusionTree.find(k);
-      if (r != gFileInclusionTree.end()) {
-        llvm::outs() << " " << r->second.getFileName();
-      }
+      PrintFileKey(index.getFileKey(k));
+      if (!index.getFileName(k).empty())
+        llvm::outs() << " " << index.getFileName(k);
       llvm::outs() << "\n";
     }
 
@@ -153,32 +404,367 @@ static void PrintInclusionTree() {
   }
 }
 
+//===----------------------------------------------------------------------===//
+// Closure printing
+//===----------------------------------------------------------------------===//
+
+static void GetClosureFiles(closure::ClosureEngine &engine,
+  closure::SymbolIndexType symbol,
+  std::vector<closure::FileIndexType> &files) {
+  if (MinimalClosures)
+    engine.getMinimalFiles(symbol, files);
+  else
+    engine.getFiles(symbol, files);
+}
+
+static void PrintClosure(const closure::RelationIndex &index,
+  closure::ClosureEngine &engine,
+  StringRef signature,
+  closure::RecordWriter *writer) {
+  if (!writer)
+    llvm::outs() << "Closure of " << signature << ":\n";
+  closure::SymbolIndexType symbol = index.findSymbol(signature);
+  if (symbol != closure::RelationIndex::InvalidIndex) {
+    std::vector<closure::FileIndexType> files;
+    GetClosureFiles(engine, symbol, files);
+    for (closure::FileIndexType file : files) {
+      if (writer)
+        writer->writeClosureMember(signature, index.getFileName(file));
+      else
+        llvm::outs() << index.getFileName(file) << "\n";
+    }
+  }
+  if (writer)
+    writer->flush();
+  else
+    llvm::outs() << "\n";
+}
+
+// Calls f with the signature of every symbol whose closure is printed.
+static void ForEachPrintedSymbol(const closure::RelationIndex &index,
+  llvm::function_ref<void(StringRef)> f) {
+  if (!gSelectedSymbolSignature.empty())
+    f(gSelectedSymbolSignature);
+  for (const std::string &signature : ClosureSymbols)
+    f(signature);
+
+  closure::FileKeyType key;
+  if (!AllSymbolsInFile || llvm::sys::fs::getUniqueID(FileOfSymbol, key))
+    return;
+  closure::FileIndexType file = index.findFile(key);
+  for (closure::SymbolIndexType i = 0, count = index.getSymbolsCount();
+    i != count;
+    ++i) {
+    if (file != closure::RelationIndex::InvalidIndex
+      && index.getDefinitionFile(i) == file)
+      f(index.getSymbolName(i));
+  }
+}
+
+static void PrintClosures(const closure::RelationIndex &index,
+  closure::RecordWriter *writer) {
+  closure::TimeTraceScope scope("PrintClosures");
+  closure::ClosureEngine engine(index);
+  ForEachPrintedSymbol(index, [&](StringRef signature) {
+    PrintClosure(index, engine, signature, writer);
+  });
+}
+
+//===----------------------------------------------------------------------===//
+// Declaration slicing
+//===----------------------------------------------------------------------===//
+
+static bool WriteSlice(const closure::RelationIndex &index) {
+  closure::DeclarationSlicer slicer(index);
+  ForEachPrintedSymbol(index, [&](StringRef signature) {
+    closure::SymbolIndexType symbol = index.findSymbol(signature);
+    if (symbol != closure::RelationIndex::InvalidIndex)
+      slicer.addSymbol(symbol);
+  });
+
+  std::error_code ec;
+  llvm::raw_fd_ostream os(SliceFile, ec, llvm::sys::fs::F_Text);
+  if (ec) {
+    llvm::errs() << "Can not write " << SliceFile << ".\n";
+    return false;
+  }
+  std::string error;
+  if (!slicer.write(os, error)) {
+    llvm::errs() << "Can not slice: " << error << "\n";
+    return false;
+  }
+  for (closure::SymbolIndexType symbol : slicer.getMissingSymbols()) {
+    llvm::errs() << "The source of " << index.getSymbolName(symbol)
+      << " is not known, so it is left out of the slice.\n";
+  }
+  return true;
+}
+
+//===----------------------------------------------------------------------===//
+// Closure materializing
+//===----------------------------------------------------------------------===//
+
+static bool MaterializeClosures(const closure::RelationIndex &index,
+  const CompilationDatabase &compilations,
+  ArrayRef<std::string> sources) {
+  closure::TimeTraceScope scope("MaterializeClosures");
+  closure::ClosureEngine engine(index);
+  closure::ClosureMaterializer materializer(OutputDirectory);
+  materializer.setHardlinks(OutputHardlinks);
+  ForEachPrintedSymbol(index, [&](StringRef signature) {
+    closure::SymbolIndexType symbol = index.findSymbol(signature);
+    if (symbol == closure::RelationIndex::InvalidIndex)
+      return;
+    std::vector<closure::FileIndexType> files;
+    GetClosureFiles(engine, symbol, files);
+    for (closure::FileIndexType file : files)
+      materializer.addFile(index.getFileName(file));
+  });
+
+  std::string error;
+  if (!materializer.materialize(Jobs, error)) {
+    llvm::errs() << "Can not place the files: " << error << "\n";
+    return false;
+  }
+  if (!materializer.writeCompilationDatabase(compilations, sources, error)) {
+    llvm::errs() << "Can not write the compile commands: " << error << "\n";
+    return false;
+  }
+  return true;
+}
+
+//===----------------------------------------------------------------------===//
+// Time tracing
+//===----------------------------------------------------------------------===//
+
+// Writes what tracer recorded when main returns.
+class TimeTracingOutput {
+public:
+  explicit TimeTracingOutput(closure::TimeTracer *tracer)
+    : mTracer(tracer) {}
+
+  ~TimeTracingOutput() {
+    if (!mTracer)
+      return;
+    closure::TimeTracer::setInstance(nullptr);
+    if (!TimeTraceFile.empty()) {
+      std::error_code ec;
+      llvm::raw_fd_ostream os(TimeTraceFile, ec, llvm::sys::fs::F_Text);
+      if (ec)
+        llvm::errs() << "Can not write " << TimeTraceFile << ".\n";
+      else
+        mTracer->writeTrace(os);
+    }
+    if (TimeReport)
+      mTracer->printReport(llvm::errs());
+  }
+
+private:
+  closure::TimeTracer *mTracer;
+};
+
+// Writes the TU times model recorded when main returns, before the time
+// report.
+class TUStatsOutput {
+public:
+  explicit TUStatsOutput(const closure::TUCostModel &model)
+    : mModel(model) {}
+
+  ~TUStatsOutput() {
+    std::string error;
+    if (!TUStats.empty() && !mModel.write(TUStats, error))
+      llvm::errs() << "Can not write " << TUStats << ": " << error << "\n";
+    if (TimeReport)
+      mModel.printReport(llvm::errs());
+  }
+
+private:
+  const closure::TUCostModel &mModel;
+};
+
 //===----------------------------------------------------------------------===//
 // Main
 //===----------------------------------------------------------------------===//
 
 int main(int argc, const char **argv) {
+  closure::TimeTracer::ClockType::time_point start
+    = closure::TimeTracer::ClockType::now();
   CommonOptionsParser op(argc, argv, ClangClosureCategory);
 
+  // Options are only known once parsed, so the span of parsing them and
+  // loading the compilation database is added afterwards.
+  std::unique_ptr<closure::TimeTracer> tracer;
+  if (!TimeTraceFile.empty() || TimeReport) {
+    tracer = llvm::make_unique<closure::TimeTracer>(start);
+    closure::TimeTracer::setInstance(tracer.get());
+    tracer->addSpan("LoadCompilationDatabase", StringRef(), start,
+      closure::TimeTracer::ClockType::now());
+  }
+  TimeTracingOutput tracingOutput(tracer.get());
+
+  // Without times of previous runs, TUs are still ordered by their sizes.
+  closure::TUCostModel costModel;
+  if (!TUStats.empty()) {
+    std::string error;
+    if (!costModel.load(TUStats, error)) {
+      llvm::errs() << "Can not load " << TUStats << ": " << error << "\n";
+      return 1;
+    }
+  }
+  TUStatsOutput statsOutput(costModel);
+
+  // Destroyed before the tracing output, so the last records are flushed
+  // first.
+  std::unique_ptr<closure::RecordWriter> writer;
+  if (Format == OF_NDJSON && !Serve)
+    writer = llvm::make_unique<closure::RecordWriter>(llvm::outs());
+
+  std::unique_ptr<closure::IndexCache> cache;
+  if (!CacheDirectory.empty())
+    cache = llvm::make_unique<closure::IndexCache>(CacheDirectory);
+
+  if (Serve) {
+    closure::QueryServer server(op.getCompilations(), op.getSourcePathList(),
+      Jobs, cache.get());
+    if (!LoadIndex.empty())
+      server.setIndexFile(LoadIndex);
+    server.reload();
+    server.run(std::cin, llvm::outs());
+    return 0;
+  }
+
+  if (!Shard.empty() && EmitGraph.empty()) {
+    llvm::errs() << "-shard needs -emit-graph.\n";
+    return 1;
+  }
+
+  // Inclusions-only runs parse nothing, so they have no use for preambles.
+  closure::InclusionScanner preambleScanner;
+  std::unique_ptr<closure::PreambleBuilder> preambles;
+  if (!PreambleDirectory.empty() && !InclusionsOnly) {
+    closure::TimeTraceScope scope("BuildPreambles");
+    preambles = llvm::make_unique<closure::PreambleBuilder>(
+      op.getCompilations(), preambleScanner, PreambleDirectory);
+    if (!preambles->build(op.getSourcePathList(), Jobs))
+      llvm::errs() << "Some preambles failed to build.\n";
+  }
+
   if (ListSymbols) {
-    ClangTool Tool(op.getCompilations(), op.getSourcePathList());
-    return Tool.run(newFrontendActionFactory<SymbolsListingAction>().get());
+    return ListSymbolsOfSources(op.getCompilations(), op.getSourcePathList(),
+      cache.get(), preambles.get(), writer.get());
+  }
+  else if (InclusionsOnly) {
+    closure::InclusionScanner scanner;
+    closure::RelationGraphBuilder builder(op.getCompilations(), Jobs);
+    builder.setInclusionScanner(&scanner);
+    builder.setRecordWriter(writer.get());
+    bool r = builder.build(op.getSourcePathList(), gRelationGraph);
+    closure::RelationIndex index(gRelationGraph);
+    if (!EmitIndex.empty() && !index.write(EmitIndex))
+      llvm::errs() << "Can not write " << EmitIndex << ".\n";
+    if (!writer)
+      PrintInclusionTree(index);
+    return r ? 0 : 1;
+  }
+  else if (!EmitGraph.empty()) {
+    closure::ShardSpec shard;
+    if (!Shard.empty() && !shard.parse(Shard)) {
+      llvm::errs() << "Invalid shard " << Shard << ".\n";
+      return 1;
+    }
+    // A shard does not know which closures will be asked for, so it parses
+    // every body.
+    closure::RelationGraphBuilder builder(op.getCompilations(), Jobs);
+    builder.setCache(cache.get());
+    builder.setPreambles(preambles.get());
+    builder.setRecordWriter(writer.get());
+    builder.setHeaderFunctionBodies(MinimalClosures || !SliceFile.empty());
+    builder.setCostModel(&costModel);
+    bool r = builder.build(shard.select(op.getSourcePathList()),
+      gRelationGraph);
+    std::string error;
+    if (!closure::WriteGraphFile(gRelationGraph, EmitGraph, error)) {
+      llvm::errs() << "Can not write " << EmitGraph << ": " << error << "\n";
+      return 1;
+    }
+    return r ? 0 : 1;
   }
   else {
-    ClangTool SymbolLocatingTool(op.getCompilations(),
-      llvm::ArrayRef<std::string>(FileOfSymbol));
-    std::unique_ptr<FrontendActionFactory> factory(
-      newFrontendActionFactory<SymbolLocatingAction>());
-    SymbolLocatingTool.run(factory.get());
-    llvm::outs() << "Selected symbol signature: "
-      << gSelectedSymbolSignature << "\n";
-
-    ClangTool RelationGraphConstructionTool(op.getCompilations(),
-      op.getSourcePathList());
-    std::unique_ptr<FrontendActionFactory> RGFactory(
-      newFrontendActionFactory<RelationConstructionAction>());
-    RelationGraphConstructionTool.run(RGFactory.get());
-    PrintInclusionTree();
-    return 0;
+    closure::SymbolSelector selector = GetSymbolSelector();
+    std::vector<std::string> files
+      = GetFilesOfSymbol(selector, op.getSourcePathList());
+    std::unique_ptr<closure::RelationIndex> index;
+    // The closures are still written if some TUs fail to parse, from what
+    // the others found.
+    bool r = true;
+    if (!LoadIndex.empty()) {
+      std::string error;
+      index = closure::RelationIndex::load(LoadIndex, error);
+      if (!index) {
+        llvm::errs() << "Can not load " << LoadIndex << ": " << error << "\n";
+        return 1;
+      }
+      if (writer)
+        writer->writeRelations(*index);
+      LocateSymbol(op.getCompilations(), files, selector);
+    }
+    else if (!MergeGraphs.empty()) {
+      closure::TimeTraceScope scope("MergeGraphs");
+      for (const std::string &path : MergeGraphs) {
+        std::string error;
+        if (!closure::ReadGraphFile(path, gRelationGraph, error)) {
+          llvm::errs() << "Can not merge " << path << ": " << error << "\n";
+          return 1;
+        }
+      }
+      index = llvm::make_unique<closure::RelationIndex>(gRelationGraph);
+      if (writer)
+        writer->writeRelations(*index);
+      LocateSymbol(op.getCompilations(), files, selector);
+    }
+    else {
+      closure::RelationGraphBuilder builder(op.getCompilations(), Jobs);
+      builder.setCache(cache.get());
+      builder.setPreambles(preambles.get());
+      builder.setRecordWriter(writer.get());
+      builder.setHeaderFunctionBodies(MinimalClosures || !SliceFile.empty());
+      builder.setCostModel(&costModel);
+      // An index must serve any closure, so it needs every body.
+      closure::ClosureRoots roots;
+      roots.Signatures = ClosureSymbols;
+      roots.IncludeLocatedSymbol = true;
+      if (AllSymbolsInFile)
+        roots.File = FileOfSymbol;
+      if (!AllFunctionBodies && EmitIndex.empty()) {
+        builder.setClosureRoots(&roots);
+        if (DemandDriven)
+          builder.setPrescanner(&GetPrescanner(op.getSourcePathList()));
+      }
+      // Files which are sources share the parse of their TU, which the
+      // build runs in parallel anyway.
+      if (!files.empty())
+        builder.setSymbolLocating(files, selector, gSelectedSymbolSignature);
+      r = builder.build(op.getSourcePathList(), gRelationGraph);
+      index = llvm::make_unique<closure::RelationIndex>(gRelationGraph);
+    }
+    if (writer) {
+      writer->writeSelectedSymbol(gSelectedSymbolSignature);
+    }
+    else {
+      llvm::outs() << "Selected symbol signature: "
+        << gSelectedSymbolSignature << "\n";
+    }
+
+    if (!EmitIndex.empty() && !index->write(EmitIndex))
+      llvm::errs() << "Can not write " << EmitIndex << ".\n";
+    if (!writer)
+      PrintInclusionTree(*index);
+    PrintClosures(*index, writer.get());
+    if (!SliceFile.empty() && !WriteSlice(*index))
+      return 1;
+    if (!OutputDirectory.empty() && !MaterializeClosures(*index,
+      op.getCompilations(), op.getSourcePathList()))
+      return 1;
+    return r ? 0 : 1;
   }
 }
\ No newline at end of file
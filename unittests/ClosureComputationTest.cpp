@@ -0,0 +1,104 @@
+#include "ClosureComputation.h"
+#include "gtest/gtest.h"
+#include <vector>
+
+using namespace clang;
+
+TEST(CondensedGraphTest, Components) {
+  // 0 -> 1 -> 2 -> 1, 2 -> 3
+  std::vector<std::vector<uint32_t>> edges = {{1}, {2}, {1, 3}, {}};
+  closure::CondensedGraph graph(edges.size(),
+    [&edges](uint32_t node) { return ArrayRef<uint32_t>(edges[node]); });
+
+  ASSERT_EQ(3u, graph.getComponentsCount());
+  EXPECT_EQ(graph.getComponent(1), graph.getComponent(2));
+  EXPECT_NE(graph.getComponent(0), graph.getComponent(1));
+  EXPECT_LT(graph.getComponent(3), graph.getComponent(1));
+  EXPECT_LT(graph.getComponent(1), graph.getComponent(0));
+  EXPECT_EQ(2u, graph.getMembers(graph.getComponent(1)).size());
+
+  ArrayRef<uint32_t> successors = graph.getSuccessors(graph.getComponent(1));
+  ASSERT_EQ(1u, successors.size());
+  EXPECT_EQ(graph.getComponent(3), successors[0]);
+}
+
+TEST(ClosureEngineTest, Files) {
+  llvm::sys::fs::UniqueID mainFile(1, 1), header(1, 2), other(1, 3),
+    unused(1, 4), system(1, 5);
+
+  closure::RelationGraph graph;
+  graph.getSystemHeadersInMainFiles().insert(system);
+  graph.getFiles().insert(std::make_pair(mainFile,
+    closure::FileNode("main.c")));
+  graph.getFiles().insert(std::make_pair(header, closure::FileNode("a.h")));
+  graph.getFiles().insert(std::make_pair(other, closure::FileNode("other.c")));
+  graph.getFiles().insert(std::make_pair(unused, closure::FileNode("b.h")));
+  graph.getFiles().find(mainFile)->second.appendInclusion(header);
+  graph.getFiles().find(mainFile)->second.appendInclusion(system);
+  graph.getFiles().find(other)->second.appendInclusion(unused);
+
+  // main -> ping <-> pong
+  graph.getSymbols().insert(std::make_pair("main",
+    closure::SymbolNode(mainFile)));
+  graph.getSymbols().insert(std::make_pair("ping",
+    closure::SymbolNode(mainFile)));
+  graph.getSymbols().insert(std::make_pair("pong",
+    closure::SymbolNode(other)));
+  graph.getSymbols().find("main")->second.appendDependency("ping");
+  graph.getSymbols().find("ping")->second.appendDependency("pong");
+  graph.getSymbols().find("pong")->second.appendDependency("ping");
+
+  closure::RelationIndex index(graph);
+  closure::ClosureEngine engine(index);
+
+  std::vector<closure::FileIndexType> files;
+  engine.getFiles(index.findSymbol("main"), files);
+  ASSERT_EQ(4u, files.size());
+  EXPECT_EQ(index.findFile(mainFile), files[0]);
+  EXPECT_EQ(index.findFile(header), files[1]);
+  EXPECT_EQ(index.findFile(other), files[2]);
+  EXPECT_EQ(index.findFile(unused), files[3]);
+
+  // Both members of the cycle share one memoized closure.
+  EXPECT_EQ(&engine.getFileClosure(index.findSymbol("ping")),
+    &engine.getFileClosure(index.findSymbol("pong")));
+}
+
+TEST(ClosureEngineTest, MinimalFiles) {
+  llvm::sys::fs::UniqueID mainFile(1, 1), wrapper(1, 2), types(1, 3),
+    unrelated(1, 4);
+
+  // main.c includes wrapper.h, which includes types.h, and unrelated.h.
+  closure::RelationGraph graph;
+  graph.getFiles().insert(std::make_pair(mainFile,
+    closure::FileNode("main.c")));
+  graph.getFiles().insert(std::make_pair(wrapper,
+    closure::FileNode("wrapper.h")));
+  graph.getFiles().insert(std::make_pair(types,
+    closure::FileNode("types.h")));
+  graph.getFiles().insert(std::make_pair(unrelated,
+    closure::FileNode("unrelated.h")));
+  graph.getFiles().find(mainFile)->second.appendInclusion(wrapper);
+  graph.getFiles().find(mainFile)->second.appendInclusion(unrelated);
+  graph.getFiles().find(wrapper)->second.appendInclusion(types);
+
+  graph.getSymbols().insert(std::make_pair("main",
+    closure::SymbolNode(mainFile)));
+  graph.getSymbols().insert(std::make_pair("point",
+    closure::SymbolNode(types)));
+  graph.getSymbols().find("main")->second.appendDependency("point");
+
+  closure::RelationIndex index(graph);
+  closure::ClosureEngine engine(index);
+
+  std::vector<closure::FileIndexType> files;
+  engine.getMinimalFiles(index.findSymbol("main"), files);
+  ASSERT_EQ(3u, files.size());
+  EXPECT_EQ(index.findFile(mainFile), files[0]);
+  EXPECT_EQ(index.findFile(wrapper), files[1]);
+  EXPECT_EQ(index.findFile(types), files[2]);
+
+  files.clear();
+  engine.getFiles(index.findSymbol("main"), files);
+  EXPECT_EQ(4u, files.size());
+}
@@ -0,0 +1,115 @@
+#include "ClosureMaterializing.h"
+#include "TestFiles.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+using namespace clang;
+using namespace clang::tooling;
+
+static std::string ReadFile(StringRef path) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer
+    = llvm::MemoryBuffer::getFile(path);
+  return buffer ? (*buffer)->getBuffer().str() : std::string();
+}
+
+// Removes directory and everything under it, deepest first.
+static void RemoveTree(StringRef directory) {
+  std::vector<std::string> paths(1, directory.str());
+  std::error_code ec;
+  for (llvm::sys::fs::recursive_directory_iterator iter(directory, ec), end;
+    iter != end && !ec;
+    iter.increment(ec))
+    paths.push_back(iter->path());
+  for (auto path = paths.rbegin(); path != paths.rend(); ++path)
+    llvm::sys::fs::remove(*path);
+}
+
+TEST(ClosureMaterializingTest, PlaceFile) {
+  llvm::SmallString<128> directory;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("clang-closure-test",
+    directory));
+  llvm::SmallString<128> from(directory), copy(directory), link(directory);
+  llvm::sys::path::append(from, "from.h");
+  llvm::sys::path::append(copy, "copy.h");
+  llvm::sys::path::append(link, "link.h");
+  WriteFile(from, "int f(void);\n");
+  // Placed over a file of a previous run.
+  WriteFile(copy, "stale contents which are longer\n");
+
+  closure::PlacementKind kind;
+  std::string error;
+  EXPECT_TRUE(closure::PlaceFile(from, copy, false, kind, error)) << error;
+  EXPECT_NE(closure::PK_Hardlink, kind);
+  EXPECT_EQ("int f(void);\n", ReadFile(copy));
+  EXPECT_TRUE(closure::PlaceFile(from, link, true, kind, error)) << error;
+  EXPECT_EQ("int f(void);\n", ReadFile(link));
+
+  llvm::sys::fs::remove(from);
+  llvm::sys::fs::remove(copy);
+  llvm::sys::fs::remove(link);
+  llvm::sys::fs::remove(directory);
+}
+
+TEST(ClosureMaterializingTest, Materialize) {
+  llvm::SmallString<128> directory;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("clang-closure-test",
+    directory));
+  llvm::SmallString<128> include(directory), header(directory),
+    source(directory), output(directory);
+  llvm::sys::path::append(include, "include");
+  llvm::sys::path::append(header, "include", "a.h");
+  llvm::sys::path::append(source, "a.c");
+  llvm::sys::path::append(output, "out");
+  ASSERT_FALSE(llvm::sys::fs::create_directory(include));
+  WriteFile(header, "int a(void);\n");
+  WriteFile(source, "#include \"a.h\"\nint a(void) { return 0; }\n");
+
+  closure::ClosureMaterializer materializer(output);
+  materializer.addFile(source);
+  materializer.addFile(header);
+  std::string error;
+  EXPECT_TRUE(materializer.materialize(2, error)) << error;
+  std::string placedHeader = materializer.getOutputPath(header);
+  std::string placedSource = materializer.getOutputPath(source);
+  EXPECT_TRUE(StringRef(placedHeader).startswith(output));
+  EXPECT_EQ("int a(void);\n", ReadFile(placedHeader));
+
+  std::vector<std::string> arguments;
+  arguments.push_back("-I" + include.str().str());
+  arguments.push_back("-I/not/placed");
+  arguments.push_back("-Iother");
+  arguments.push_back("-isystem");
+  arguments.push_back(include.str());
+  FixedCompilationDatabase compilations(directory, arguments);
+  std::vector<std::string> sources(1, source.str());
+  EXPECT_TRUE(materializer.writeCompilationDatabase(compilations, sources,
+    error)) << error;
+  llvm::SmallString<128> database(output);
+  llvm::sys::path::append(database, "compile_commands.json");
+  std::string commands = ReadFile(database);
+  EXPECT_NE(std::string::npos,
+    commands.find("\"-I" + materializer.getOutputPath(include) + "\""));
+  EXPECT_NE(std::string::npos, commands.find("\"-I/not/placed\""));
+  // Relative paths are kept relative to the directory of the command, not
+  // to where it is placed.
+  llvm::SmallString<128> other(directory);
+  llvm::sys::path::append(other, "other");
+  EXPECT_NE(std::string::npos,
+    commands.find("\"-I" + other.str().str() + "\""));
+  // Directories are searched where they were too, for what is not placed.
+  EXPECT_NE(std::string::npos,
+    commands.find("\"-I" + materializer.getOutputPath(include) + "\", \"-I"
+      + include.str().str() + "\""));
+  EXPECT_NE(std::string::npos,
+    commands.find("\"-isystem\", \"" + materializer.getOutputPath(include)
+      + "\", \"-isystem\", \"" + include.str().str() + "\""));
+  EXPECT_NE(std::string::npos,
+    commands.find("\"file\": \"" + placedSource + "\""));
+
+  RemoveTree(directory);
+}
@@ -0,0 +1,132 @@
+#include "DeclarationSlicing.h"
+#include "TestFiles.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+using namespace clang;
+
+static const char *types_h = R"(#include <stddef.h>
+#include "other.h"
+#if 0
+#include <skipped.h>
+#endif
+struct point { int x; };
+typedef struct point point_t;
+int unused;
+)";
+
+static const char *area_c = R"(#include <types.h>
+int area(point_t p) { return p.x; }
+)";
+
+static void AddSymbol(closure::RelationGraph &graph,
+  StringRef name,
+  const llvm::sys::fs::UniqueID &file,
+  StringRef content,
+  StringRef source,
+  unsigned flags = 0) {
+  closure::SymbolNode &symbol = graph.getSymbols().insert(std::make_pair(
+    name.str(), closure::SymbolNode(file))).first->second;
+  size_t begin = content.find(source);
+  symbol.setExtent(begin, begin + source.size(), flags);
+}
+
+TEST(DeclarationSlicingTest, SystemInclusions) {
+  std::vector<std::string> names;
+  closure::ScanSystemInclusions(
+    "#include <stdio.h>\n  #  include\t<sys/types.h> // x\n"
+    "#include \"a.h\"\n#define X <b.h>\n", names);
+  ASSERT_EQ(2u, names.size());
+  EXPECT_EQ("stdio.h", names[0]);
+  EXPECT_EQ("sys/types.h", names[1]);
+}
+
+TEST(DeclarationSlicingTest, DependencyOrder) {
+  llvm::SmallString<128> directory;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("clang-closure-test",
+    directory));
+  llvm::SmallString<128> header(directory), source(directory);
+  llvm::sys::path::append(header, "types.h");
+  llvm::sys::path::append(source, "area.c");
+  WriteFile(header, types_h);
+  WriteFile(source, area_c);
+
+  // The header is included in angle brackets, but flattened into the slice
+  // all the same.
+  llvm::sys::fs::UniqueID headerID(1, 1), sourceID(1, 2), systemID(1, 3);
+  closure::RelationGraph graph;
+  graph.getFiles().insert(std::make_pair(headerID,
+    closure::FileNode(header.str())));
+  graph.getFiles().insert(std::make_pair(sourceID,
+    closure::FileNode(source.str())));
+  graph.getFiles().insert(std::make_pair(systemID,
+    closure::FileNode("/usr/include/stddef.h")));
+  graph.getSystemHeadersInMainFiles().insert(systemID);
+  graph.getFiles().find(sourceID)->second.appendInclusion(headerID);
+  graph.getFiles().find(headerID)->second.appendInclusion(systemID);
+
+  AddSymbol(graph, "area", sourceID, area_c,
+    "int area(point_t p) { return p.x; }",
+    closure::SymbolNode::EF_FunctionDefinition);
+  AddSymbol(graph, "point_t", headerID, types_h,
+    "typedef struct point point_t;");
+  AddSymbol(graph, "point", headerID, types_h, "struct point { int x; };");
+  AddSymbol(graph, "unused", headerID, types_h, "int unused;");
+  graph.getSymbols().insert(std::make_pair("skipped",
+    closure::SymbolNode(sourceID)));
+  graph.getSymbols().find("area")->second.appendDependency("point_t");
+  graph.getSymbols().find("area")->second.appendDependency("skipped");
+  graph.getSymbols().find("point_t")->second.appendDependency("point");
+
+  closure::RelationIndex index(graph);
+  closure::DeclarationSlicer slicer(index);
+  slicer.addSymbol(index.findSymbol("area"));
+  std::string slice, error;
+  llvm::raw_string_ostream os(slice);
+  bool r = slicer.write(os, error);
+  os.flush();
+
+  llvm::sys::fs::remove(header);
+  llvm::sys::fs::remove(source);
+  llvm::sys::fs::remove(directory);
+
+  ASSERT_TRUE(r) << error;
+  EXPECT_EQ("#include <stddef.h>\n\n"
+    "struct point { int x; };\n\n"
+    "typedef struct point point_t;\n\n"
+    "int area(point_t p) { return p.x; }\n\n", slice);
+  ASSERT_EQ(1u, slicer.getMissingSymbols().size());
+  EXPECT_EQ("skipped",
+    index.getSymbolName(slicer.getMissingSymbols().front()));
+}
+
+TEST(DeclarationSlicingTest, Namespaces) {
+  llvm::SmallString<128> source;
+  ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("clang-closure-test",
+    "cpp", source));
+  WriteFile(source, "namespace n { int f(); }\n");
+
+  llvm::sys::fs::UniqueID sourceID(1, 1);
+  closure::RelationGraph graph;
+  graph.getFiles().insert(std::make_pair(sourceID,
+    closure::FileNode(source.str())));
+  AddSymbol(graph, "_ZN1n1fEv", sourceID, "namespace n { int f(); }\n",
+    "int f();", closure::SymbolNode::EF_InNamespace);
+
+  closure::RelationIndex index(graph);
+  closure::DeclarationSlicer slicer(index);
+  slicer.addSymbol(index.findSymbol("_ZN1n1fEv"));
+  std::string slice, error;
+  llvm::raw_string_ostream os(slice);
+  bool r = slicer.write(os, error);
+  llvm::sys::fs::remove(source);
+
+  // Written outside of its namespace, the declaration would be another one.
+  EXPECT_FALSE(r);
+  EXPECT_NE(std::string::npos, error.find("namespace"));
+}
@@ -0,0 +1,42 @@
+#include "FileWriting.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "gtest/gtest.h"
+#include <string>
+
+using namespace clang;
+
+TEST(FileWritingTest, ReplacesWholeFile) {
+  llvm::SmallString<128> directory;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("clang-closure-test",
+    directory));
+  llvm::SmallString<128> path(directory);
+  llvm::sys::path::append(path, "out.txt");
+
+  std::string error;
+  EXPECT_TRUE(closure::WriteFileAtomically(path, "first\n", error)) << error;
+  EXPECT_TRUE(closure::WriteFileAtomically(path, "second\n", error)) << error;
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer
+    = llvm::MemoryBuffer::getFile(path);
+  ASSERT_TRUE(bool(buffer));
+  EXPECT_EQ("second\n", (*buffer)->getBuffer());
+
+  // No temporary file is left next to it.
+  size_t entries = 0;
+  std::error_code ec;
+  for (llvm::sys::fs::directory_iterator i(directory, ec), end;
+    !ec && i != end;
+    i.increment(ec))
+    ++entries;
+  EXPECT_EQ(1u, entries);
+
+  llvm::SmallString<128> missing(directory);
+  llvm::sys::path::append(missing, "missing", "out.txt");
+  EXPECT_FALSE(closure::WriteFileAtomically(missing, "", error));
+  EXPECT_FALSE(error.empty());
+
+  llvm::sys::fs::remove(path);
+  llvm::sys::fs::remove(directory);
+}
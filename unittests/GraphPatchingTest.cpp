@@ -0,0 +1,116 @@
+#include "GraphPatching.h"
+#include "RelationGraphBuilder.h"
+#include "TestFiles.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "gtest/gtest.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace clang;
+using namespace clang::tooling;
+
+// Whether a and b have the same files, inclusions, symbols, definitions and
+// dependencies, in whatever order.
+static bool HaveSameContent(const closure::RelationGraph &a,
+  const closure::RelationGraph &b) {
+  if (a.getFiles().size() != b.getFiles().size()
+    || a.getSymbols().size() != b.getSymbols().size())
+    return false;
+  for (const auto &file : a.getFiles()) {
+    auto other = b.getFiles().find(file.first);
+    if (other == b.getFiles().end()
+      || other->second.getInclusionsCount()
+      != file.second.getInclusionsCount())
+      return false;
+    for (size_t i = 0, count = file.second.getInclusionsCount();
+      i != count;
+      ++i) {
+      if (!other->second.hasInclusion(file.second.getInclusion(i)))
+        return false;
+    }
+  }
+  for (const auto &symbol : a.getSymbols()) {
+    auto other = b.getSymbols().find(symbol.first);
+    if (other == b.getSymbols().end()
+      || !(other->second.getDefinitionFile()
+      == symbol.second.getDefinitionFile())
+      || other->second.getDependencyCount()
+      != symbol.second.getDependencyCount())
+      return false;
+    for (size_t i = 0, count = symbol.second.getDependencyCount();
+      i != count;
+      ++i) {
+      if (!other->second.hasDependency(symbol.second.getDependency(i)))
+        return false;
+    }
+  }
+  return true;
+}
+
+TEST(GraphPatchingTest, Update) {
+  llvm::SmallString<128> directory;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("clang-closure-test",
+    directory));
+  // Only x.c sees common.h, through middle.h. Both see other.h.
+  const std::pair<const char*, const char*> files[] = {
+    { "common.h", "int shared(void);\n" },
+    { "middle.h", "#include \"common.h\"\n#include \"other.h\"\n" },
+    { "other.h",
+      "#ifndef OTHER_H\n#define OTHER_H\nstruct point { int x; };\n#endif\n" },
+    { "x.c", "#include \"middle.h\"\nint f(void) { return shared(); }\n" },
+    { "y.c", "#include \"other.h\"\nint g(void) { return 0; }\n" },
+  };
+  std::vector<std::string> paths, sources;
+  for (const auto &file : files) {
+    llvm::SmallString<128> path(directory);
+    llvm::sys::path::append(path, file.first);
+    WriteFile(path, file.second);
+    paths.push_back(path.str());
+  }
+  sources.push_back(paths[3]);
+  sources.push_back(paths[4]);
+
+  FixedCompilationDatabase compilations(directory,
+    std::vector<std::string>());
+  closure::RelationGraphBuilder builder(compilations, 1);
+  closure::PatchableGraph graph(sources);
+  EXPECT_TRUE(graph.build(builder));
+  unsigned version = graph.getVersion();
+  EXPECT_TRUE(graph.getGraph().getSymbols().count("f"));
+
+  std::vector<size_t> affected
+    = graph.getAffectedSources(std::vector<std::string>(1, paths[0]));
+  ASSERT_EQ(1u, affected.size());
+  EXPECT_EQ(0u, affected[0]);
+  EXPECT_TRUE(graph.getAffectedSources(
+    std::vector<std::string>(1, "unknown.h")).empty());
+
+  // What x.c contributed is replaced, and what y.c did is kept.
+  WriteFile(paths[3], "int h(void) { return 1; }\n");
+  std::vector<std::string> updated;
+  EXPECT_TRUE(graph.update(builder, std::vector<std::string>(1, paths[3]),
+    updated));
+  ASSERT_EQ(1u, updated.size());
+  EXPECT_EQ(paths[3], updated[0]);
+  EXPECT_NE(version, graph.getVersion());
+  const closure::SymbolsMapType &symbols = graph.getGraph().getSymbols();
+  EXPECT_FALSE(symbols.count("f"));
+  EXPECT_TRUE(symbols.count("h"));
+  EXPECT_TRUE(symbols.count("g"));
+
+  // The graph is the one a build of the files as they are now makes.
+  closure::PatchableGraph fresh(sources);
+  EXPECT_TRUE(fresh.build(builder));
+  EXPECT_TRUE(HaveSameContent(fresh.getGraph(), graph.getGraph()));
+
+  // x.c no longer sees common.h.
+  EXPECT_TRUE(graph.getAffectedSources(
+    std::vector<std::string>(1, paths[0])).empty());
+
+  for (const std::string &path : paths)
+    llvm::sys::fs::remove(path);
+  llvm::sys::fs::remove(directory);
+}
@@ -0,0 +1,90 @@
+#include "GraphSharding.h"
+#include "TestFiles.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+using namespace clang;
+
+TEST(GraphShardingTest, Select) {
+  closure::ShardSpec spec;
+  EXPECT_FALSE(spec.parse("2/2"));
+  EXPECT_FALSE(spec.parse("1"));
+  ASSERT_TRUE(spec.parse("1/2"));
+
+  std::vector<std::string> sources = { "d.c", "b.c", "a.c", "c.c", "b.c" };
+  std::vector<std::string> selected = spec.select(sources);
+  ASSERT_EQ(2u, selected.size());
+  EXPECT_EQ("b.c", selected[0]);
+  EXPECT_EQ("d.c", selected[1]);
+}
+
+TEST(GraphShardingTest, WriteAndMerge) {
+  llvm::SmallString<128> directory;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("clang-closure-test",
+    directory));
+  llvm::SmallString<128> header(directory), first(directory),
+    second(directory);
+  llvm::sys::path::append(header, "common.h");
+  llvm::sys::path::append(first, "first.graph");
+  llvm::sys::path::append(second, "second.graph");
+  {
+    std::error_code ec;
+    llvm::raw_fd_ostream os(header, ec, llvm::sys::fs::F_Text);
+  }
+  llvm::sys::fs::UniqueID headerID;
+  ASSERT_FALSE(llvm::sys::fs::getUniqueID(header, headerID));
+
+  // Each shard saw the header under an ID of its own.
+  llvm::sys::fs::UniqueID a(1, 1), b(1, 2), staleHeader(1, 3);
+  closure::RelationGraph shardA;
+  shardA.getFiles().insert(std::make_pair(a, closure::FileNode("a.c")));
+  shardA.getFiles().insert(std::make_pair(headerID,
+    closure::FileNode(header.str())));
+  shardA.getFiles().find(a)->second.appendInclusion(headerID);
+  shardA.getSymbols().insert(std::make_pair("f", closure::SymbolNode(a)));
+  shardA.getSymbols().find("f")->second.appendDependency("g");
+  shardA.getSymbols().find("f")->second.setExtent(0, 10);
+
+  closure::RelationGraph shardB;
+  shardB.getFiles().insert(std::make_pair(b, closure::FileNode("b.c")));
+  shardB.getFiles().insert(std::make_pair(staleHeader,
+    closure::FileNode(header.str())));
+  shardB.getFiles().find(b)->second.appendInclusion(staleHeader);
+  shardB.getSymbols().insert(std::make_pair("g", closure::SymbolNode(b)));
+
+  std::string error;
+  EXPECT_TRUE(closure::WriteGraphFile(shardA, first, error)) << error;
+  EXPECT_TRUE(closure::WriteGraphFile(shardB, second, error)) << error;
+
+  closure::RelationGraph merged;
+  EXPECT_TRUE(closure::ReadGraphFile(first, merged, error)) << error;
+  EXPECT_TRUE(closure::ReadGraphFile(second, merged, error)) << error;
+  llvm::sys::fs::remove(header);
+  llvm::sys::fs::remove(first);
+  llvm::sys::fs::remove(second);
+  llvm::sys::fs::remove(directory);
+
+  ASSERT_EQ(3u, merged.getFiles().size());
+  ASSERT_EQ(1u, merged.getFiles().find(b)->second.getInclusionsCount());
+  EXPECT_TRUE(merged.getFiles().find(b)->second.getInclusion(0) == headerID);
+
+  ASSERT_EQ(2u, merged.getSymbols().size());
+  const closure::SymbolNode &f = merged.getSymbols().find("f")->second;
+  EXPECT_TRUE(f.getDefinitionFile() == a);
+  EXPECT_EQ(10u, f.getExtentEnd());
+  ASSERT_EQ(1u, f.getDependencyCount());
+  EXPECT_EQ("g", f.getDependency(0));
+}
+
+TEST(GraphShardingTest, ReadRejectsOtherFiles) {
+  ExpectLoadRejects("graph", "clang-closure-index 1\n",
+    [](StringRef path, std::string &error) {
+      closure::RelationGraph graph;
+      return closure::ReadGraphFile(path, graph, error);
+    });
+}
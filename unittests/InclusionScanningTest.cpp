@@ -0,0 +1,151 @@
+#include "InclusionScanning.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+using namespace clang;
+
+static const char *directives_c = R"(
+#include "first.h"
+  #  include <second.h>
+// #include "commented.h"
+/* #include "commented.h"
+*/ #include "after_comment.h"
+const char *s = "#include \"string.h\"";
+#define HEADER "macro.h"
+#include HEADER
+#if 0
+#include "disabled.h"
+#endif
+int x; #include "not_directive.h"
+#import "imported.h"
+)";
+
+TEST(InclusionScanningTest, Directives) {
+  std::vector<closure::ScannedInclusion> inclusions;
+  closure::ScanInclusions(directives_c, inclusions);
+
+  ASSERT_EQ(5u, inclusions.size());
+  EXPECT_EQ("first.h", inclusions[0].FileName);
+  EXPECT_FALSE(inclusions[0].IsAngled);
+  EXPECT_EQ("second.h", inclusions[1].FileName);
+  EXPECT_TRUE(inclusions[1].IsAngled);
+  EXPECT_EQ("after_comment.h", inclusions[2].FileName);
+  // Conditional directives are not evaluated.
+  EXPECT_EQ("disabled.h", inclusions[3].FileName);
+  EXPECT_EQ("imported.h", inclusions[4].FileName);
+
+  EXPECT_TRUE(inclusions[0].IsLeading);
+  EXPECT_TRUE(inclusions[2].IsLeading);
+  EXPECT_FALSE(inclusions[3].IsLeading);
+}
+
+TEST(InclusionScanningTest, LineContinuations) {
+  std::vector<closure::ScannedInclusion> inclusions;
+  closure::ScanInclusions("#include \\\n  \"first.h\"\n"
+    "#  inc\\\r\nlude <second.h>\n"
+    "// comment \\\n#include \"commented.h\"\n", inclusions);
+
+  ASSERT_EQ(2u, inclusions.size());
+  EXPECT_EQ("first.h", inclusions[0].FileName);
+  EXPECT_EQ("second.h", inclusions[1].FileName);
+  EXPECT_TRUE(closure::HasIncludeGuard("#ifndef A_\\\nH\n#define A_H\n"));
+}
+
+TEST(InclusionScanningTest, IncludeGuards) {
+  EXPECT_TRUE(closure::HasIncludeGuard(
+    "// License\n#ifndef A_H\n#define A_H\nint a;\n#endif\n"));
+  EXPECT_TRUE(closure::HasIncludeGuard("/* */ #pragma once\nint a;\n"));
+  EXPECT_FALSE(closure::HasIncludeGuard(
+    "#ifndef A_H\n#define B_H\nint a;\n#endif\n"));
+  EXPECT_FALSE(closure::HasIncludeGuard("int a;\n#pragma once\n"));
+}
+
+static std::string WriteFile(StringRef directory,
+  StringRef name,
+  StringRef content) {
+  llvm::SmallString<128> path(directory);
+  llvm::sys::path::append(path, name);
+  llvm::sys::fs::create_directories(llvm::sys::path::parent_path(path));
+  std::error_code ec;
+  llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::F_Text);
+  os << content;
+  return path.str();
+}
+
+TEST(InclusionScanningTest, IncludeNext) {
+  llvm::SmallString<128> directory;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("clang-closure-test",
+    directory));
+  std::vector<std::string> files;
+  files.push_back(WriteFile(directory, "main.c", "#include <foo.h>\n"));
+  files.push_back(WriteFile(directory, "first/foo.h",
+    "#include_next <foo.h>\n"));
+  files.push_back(WriteFile(directory, "second/foo.h", "int x;\n"));
+
+  tooling::CompileCommand command;
+  command.Directory = directory.str();
+  command.CommandLine.push_back("cc");
+  command.CommandLine.push_back("-Ifirst");
+  command.CommandLine.push_back("-Isecond");
+  command.CommandLine.push_back("main.c");
+  closure::InclusionScanner scanner;
+  closure::RelationGraph graph;
+  bool r = scanner.scanTranslationUnit(command, "main.c", graph);
+
+  llvm::sys::fs::UniqueID first, second;
+  bool found = !llvm::sys::fs::getUniqueID(files[1], first)
+    && !llvm::sys::fs::getUniqueID(files[2], second);
+  for (const std::string &file : files)
+    llvm::sys::fs::remove(file);
+  llvm::sys::fs::remove(llvm::sys::path::parent_path(files[1]));
+  llvm::sys::fs::remove(llvm::sys::path::parent_path(files[2]));
+  llvm::sys::fs::remove(directory);
+
+  ASSERT_TRUE(r);
+  ASSERT_TRUE(found);
+  // The header includes the next one of its name, not itself.
+  auto iter = graph.getFiles().find(first);
+  ASSERT_TRUE(iter != graph.getFiles().end());
+  ASSERT_EQ(1u, iter->second.getInclusionsCount());
+  EXPECT_TRUE(iter->second.getInclusion(0) == second);
+}
+
+TEST(InclusionScanningTest, DriverDirectories) {
+  llvm::SmallString<128> directory;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("clang-closure-test",
+    directory));
+  std::vector<std::string> files;
+  files.push_back(WriteFile(directory, "main.c", "#include <builtin.h>\n"));
+  files.push_back(WriteFile(directory, "resource/include/builtin.h",
+    "#include <next.h>\n"));
+
+  // The builtin directory is added by the driver, not by an option.
+  tooling::CompileCommand command;
+  command.Directory = directory.str();
+  command.CommandLine.push_back("cc");
+  command.CommandLine.push_back("-resource-dir");
+  command.CommandLine.push_back("resource");
+  command.CommandLine.push_back("main.c");
+  closure::InclusionScanner scanner;
+  closure::RelationGraph graph;
+  bool r = scanner.scanTranslationUnit(command, "main.c", graph);
+
+  llvm::sys::fs::UniqueID builtin;
+  bool found = !llvm::sys::fs::getUniqueID(files[1], builtin);
+  for (const std::string &file : files)
+    llvm::sys::fs::remove(file);
+  llvm::sys::fs::remove(llvm::sys::path::parent_path(files[1]));
+  llvm::sys::fs::remove(llvm::sys::path::parent_path(
+    llvm::sys::path::parent_path(files[1])));
+  llvm::sys::fs::remove(directory);
+
+  ASSERT_TRUE(r);
+  ASSERT_TRUE(found);
+  EXPECT_TRUE(graph.getFiles().count(builtin));
+  EXPECT_TRUE(graph.getSystemHeadersInMainFiles().count(builtin));
+}
@@ -0,0 +1,73 @@
+#include "IndexCache.h"
+#include "RelationGraphBuilder.h"
+#include "TestFiles.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+using namespace clang;
+using namespace clang::tooling;
+
+static const char *calls_c = R"(
+int callee(void) {
+  return 1;
+}
+
+int caller(void) {
+  return callee();
+}
+)";
+
+static void RemoveDirectory(StringRef directory) {
+  std::error_code ec;
+  for (llvm::sys::fs::directory_iterator iter(directory, ec), end;
+    !ec && iter != end;
+    iter.increment(ec)) {
+    if (llvm::sys::fs::is_directory(iter->path()))
+      RemoveDirectory(iter->path());
+    else
+      llvm::sys::fs::remove(iter->path());
+  }
+  llvm::sys::fs::remove(directory);
+}
+
+TEST(IndexCacheTest, RelationsRoundTrip) {
+  llvm::SmallString<128> directory;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("clang-closure-test",
+    directory));
+
+  llvm::SmallString<128> source(directory);
+  llvm::sys::path::append(source, "calls.c");
+  WriteFile(source, calls_c);
+
+  llvm::SmallString<128> cacheDirectory(directory);
+  llvm::sys::path::append(cacheDirectory, "cache");
+
+  FixedCompilationDatabase compilations(directory, std::vector<std::string>());
+  closure::IndexCache cache(cacheDirectory);
+  std::vector<std::string> sources(1, source.str());
+
+  closure::RelationGraph built;
+  closure::RelationGraphBuilder builder(compilations, 1);
+  builder.setCache(&cache);
+  EXPECT_TRUE(builder.build(sources, built));
+
+  closure::RelationGraph loaded;
+  ASSERT_TRUE(cache.loadRelations(compilations, source, loaded));
+  EXPECT_EQ(built.getSymbols().size(), loaded.getSymbols().size());
+  auto iter = loaded.getSymbols().find("caller");
+  ASSERT_TRUE(iter != loaded.getSymbols().end());
+  ASSERT_EQ(1u, iter->second.getDependencyCount());
+  EXPECT_EQ("callee", iter->second.getDependency(0));
+
+  // A fresh cache does not remember hashes of the previous content.
+  WriteFile(source, "int callee(void);\n");
+  closure::IndexCache reopened(cacheDirectory);
+  closure::RelationGraph stale;
+  EXPECT_FALSE(reopened.loadRelations(compilations, source, stale));
+
+  RemoveDirectory(directory);
+}
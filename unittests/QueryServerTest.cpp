@@ -0,0 +1,84 @@
+#include "QueryServer.h"
+#include "TestFiles.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+using namespace clang;
+using namespace clang::tooling;
+
+static const char *calls_c = R"(
+int callee(void) {
+  return 1;
+}
+
+int caller(void) {
+  return callee();
+}
+)";
+
+TEST(QueryServerTest, Requests) {
+  llvm::SmallString<128> directory;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("clang-closure-test",
+    directory));
+  llvm::SmallString<128> source(directory);
+  llvm::sys::path::append(source, "calls.c");
+  WriteFile(source, calls_c);
+
+  FixedCompilationDatabase compilations(directory, std::vector<std::string>());
+  std::vector<std::string> sources(1, source.str());
+  closure::QueryServer server(compilations, sources, 1, nullptr);
+  ASSERT_TRUE(server.reload());
+  EXPECT_EQ(1u, server.getVersion());
+
+  std::string closure = server.handleRequest(
+    R"({"id": 1, "method": "closure", "signature": "caller"})");
+  EXPECT_NE(std::string::npos, closure.find("\"id\": 1"));
+  EXPECT_NE(std::string::npos, closure.find("calls.c"));
+
+  std::string list = "{\"id\": 4, \"method\": \"list\", \"file\": \""
+    + source.str().str() + "\"}";
+  std::string listed = server.handleRequest(list);
+  EXPECT_NE(std::string::npos, listed.find(
+    R"("result": [{"type": "function", "signature": "callee"}, )"
+    R"({"type": "function", "signature": "caller"}])"));
+  auto resolve = [&](StringRef selector) {
+    return server.handleRequest("{\"id\": 5, \"method\": \"resolve\", "
+      "\"file\": \"" + source.str().str() + "\", " + selector.str() + "}");
+  };
+  EXPECT_NE(std::string::npos,
+    resolve(R"("symbol": 1)").find(R"("result": "caller")"));
+  EXPECT_NE(std::string::npos,
+    resolve(R"("name": "callee")").find(R"("result": "callee")"));
+  std::string usr = resolve(R"("usr": "c:@F@callee")");
+  EXPECT_NE(std::string::npos, usr.find(R"("result": "callee")"));
+
+  // The symbols were listed along with the graph, and the USR is resolved
+  // from the cache, so neither parses the changed file.
+  WriteFile(source, "int other(void);\n");
+  EXPECT_EQ(listed, server.handleRequest(list));
+  EXPECT_EQ(usr, resolve(R"("usr": "c:@F@callee")"));
+  EXPECT_NE(std::string::npos,
+    resolve(R"("usr": "c:@F@other")").find(R"("result": "other")"));
+  WriteFile(source, calls_c);
+
+  EXPECT_NE(std::string::npos, server.handleRequest(
+    R"({"id": "a", "method": "unknown"})").find("\"error\""));
+  EXPECT_NE(std::string::npos,
+    server.handleRequest("not json").find("\"error\""));
+
+  EXPECT_NE(std::string::npos, server.handleRequest(
+    R"({"id": 2, "method": "reload"})").find("\"version\": 2"));
+
+  std::string update = server.handleRequest(
+    "{\"id\": 3, \"method\": \"update\", \"file\": \"" + source.str().str()
+    + "\"}");
+  EXPECT_NE(std::string::npos, update.find("\"version\": 3"));
+  EXPECT_NE(std::string::npos, update.find("calls.c"));
+
+  llvm::sys::fs::remove(source);
+  llvm::sys::fs::remove(directory);
+}
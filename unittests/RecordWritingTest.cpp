@@ -0,0 +1,45 @@
+#include "RecordWriting.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <string>
+
+using namespace clang;
+
+TEST(RecordWritingTest, Records) {
+  std::string output;
+  llvm::raw_string_ostream os(output);
+  {
+    closure::RecordWriter writer(os);
+    writer.writeSymbol("a.c", "function", "foo");
+    writer.writeInclusion("a.c", "dir\\a.h");
+    writer.writeDependency("foo", "bar");
+    writer.writeSelectedSymbol("\"q\"\n");
+    writer.writeClosureMember("foo", "a.c");
+  }
+  os.flush();
+  EXPECT_EQ(
+    "{\"kind\": \"symbol\", \"file\": \"a.c\", \"type\": \"function\", "
+      "\"signature\": \"foo\"}\n"
+    "{\"kind\": \"inclusion\", \"includer\": \"a.c\", "
+      "\"included\": \"dir\\\\a.h\"}\n"
+    "{\"kind\": \"dependency\", \"symbol\": \"foo\", \"dependency\": \"bar\"}\n"
+    "{\"kind\": \"selected\", \"signature\": \"\\\"q\\\"\\u000a\"}\n"
+    "{\"kind\": \"closure\", \"symbol\": \"foo\", \"file\": \"a.c\"}\n",
+    output);
+}
+
+TEST(RecordWritingTest, Buffering) {
+  std::string output;
+  llvm::raw_string_ostream os(output);
+  closure::RecordWriter writer(os, 64);
+
+  // Records stay in the buffer until it fills up or is flushed.
+  writer.writeSelectedSymbol("foo");
+  EXPECT_TRUE(os.str().empty());
+  writer.writeSelectedSymbol("a signature long enough to fill the buffer");
+  EXPECT_EQ(2, std::count(os.str().begin(), os.str().end(), '\n'));
+
+  writer.writeSelectedSymbol("bar");
+  writer.flush();
+  EXPECT_EQ(3, std::count(os.str().begin(), os.str().end(), '\n'));
+}
@@ -1,4 +1,5 @@
 #include "RelationConstruction.h"
+#include "SymbolMangling.h"
 #include "clang/Frontend/FrontendActions.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Tooling/Tooling.h"
@@ -59,6 +60,211 @@ TEST(RelationConstructionTest, Simple) {
     contents));
 }
 
+static const char *calls_c = R"(
+int callee(int x);
+int global;
+
+int caller(int x) {
+  int local = callee(x);
+  return callee(local) + global;
+}
+)";
+
+TEST(RelationConstructionTest, FunctionDependencies) {
+  closure::FilesSetType filesSet;
+  closure::FilesMapType filesMap;
+  closure::SymbolsMapType symbols;
+
+  RelationConstructionTestAction *action = new RelationConstructionTestAction(
+    filesSet, filesMap, symbols);
+
+  EXPECT_TRUE(runToolOnCode(action, calls_c, "calls.c"));
+  EXPECT_EQ(2u, symbols.size());
+  EXPECT_TRUE(symbols.find("global") != symbols.end());
+
+  auto iter = symbols.find("caller");
+  ASSERT_TRUE(iter != symbols.end());
+  ASSERT_EQ(2u, iter->second.getDependencyCount());
+  // C symbols are keyed by their names, not by mangled ones.
+  EXPECT_EQ("callee", iter->second.getDependency(0));
+  EXPECT_EQ("global", iter->second.getDependency(1));
+}
+
+static const char *bodies_c = R"(
+int callee(int x);
+
+int first(int x) {
+  return callee(x);
+}
+
+int second(int x) {
+  return callee(x) + first(x);
+}
+)";
+
+TEST(RelationConstructionTest, FunctionBodies) {
+  closure::RelationGraph graph;
+  std::set<closure::SymbolKeyType> bodies;
+  bodies.insert("second");
+  closure::RelationConstructionAction *action
+    = new closure::RelationConstructionAction(graph);
+  action->setFunctionBodies(&bodies);
+
+  EXPECT_TRUE(runToolOnCode(action, bodies_c, "bodies.c"));
+  const closure::SymbolsMapType &symbols = graph.getSymbols();
+  ASSERT_EQ(2u, symbols.size());
+  auto first = symbols.find("first");
+  auto second = symbols.find("second");
+  ASSERT_TRUE(first != symbols.end());
+  ASSERT_TRUE(second != symbols.end());
+  // The skipped body still defines its symbol.
+  EXPECT_EQ(0u, first->second.getDependencyCount());
+  EXPECT_EQ(2u, second->second.getDependencyCount());
+}
+
+static const char *types_h = R"(
+#define SCALE 2
+typedef int length_t;
+struct point { length_t x, y; };
+enum color { RED, GREEN };
+struct unused { int z; };
+)";
+
+static const char *types_c = R"(
+#include "types.h"
+
+int area(struct point p) {
+  return p.x * p.y * SCALE + RED;
+}
+)";
+
+TEST(RelationConstructionTest, TypeDependencies) {
+  closure::RelationGraph graph;
+  closure::RelationConstructionAction *action
+    = new closure::RelationConstructionAction(graph);
+  FileContentMappings contents;
+  contents.push_back(std::make_pair("types.h", types_h));
+
+  EXPECT_TRUE(runToolOnCodeWithArgs(action, types_c,
+    std::vector<std::string>(), "types.c", contents));
+  const closure::SymbolsMapType &symbols = graph.getSymbols();
+  // area, SCALE, length_t, point, color and unused.
+  ASSERT_EQ(6u, symbols.size());
+
+  auto area = symbols.find("area");
+  ASSERT_TRUE(area != symbols.end());
+  EXPECT_EQ(3u, area->second.getDependencyCount());
+  EXPECT_TRUE(area->second.hasDependency(
+    closure::GetMacroSignature("SCALE")));
+
+  // Extents cover whole directives and declarations with their semicolon.
+  auto scale = symbols.find(closure::GetMacroSignature("SCALE"));
+  ASSERT_TRUE(scale != symbols.end());
+  EXPECT_EQ("#define SCALE 2", StringRef(types_h).slice(
+    scale->second.getExtentBegin(), scale->second.getExtentEnd()));
+  EXPECT_EQ("int area(struct point p) {\n  return p.x * p.y * SCALE + RED;\n}",
+    StringRef(types_c).slice(area->second.getExtentBegin(),
+      area->second.getExtentEnd()));
+  EXPECT_EQ(0u, scale->second.getExtentFlags());
+  EXPECT_EQ(unsigned(closure::SymbolNode::EF_FunctionDefinition),
+    area->second.getExtentFlags());
+
+  // The other dependencies are the structure and the enumeration, which are
+  // defined in the header, and the structure uses the typedef.
+  size_t typedefUsers = 0;
+  for (size_t i = 0, count = area->second.getDependencyCount();
+    i != count;
+    ++i) {
+    auto dependency = symbols.find(area->second.getDependency(i));
+    ASSERT_TRUE(dependency != symbols.end());
+    EXPECT_FALSE(dependency->second.getDefinitionFile()
+      == area->second.getDefinitionFile());
+    typedefUsers += dependency->second.getDependencyCount();
+  }
+  EXPECT_EQ(1u, typedefUsers);
+}
+
+static const char *namespaces_cpp = R"(
+namespace outer {
+struct point { int x; };
+}
+
+int area(outer::point p) {
+  return p.x;
+}
+)";
+
+TEST(RelationConstructionTest, NamespaceExtents) {
+  closure::RelationGraph graph;
+  closure::RelationConstructionAction *action
+    = new closure::RelationConstructionAction(graph);
+
+  EXPECT_TRUE(runToolOnCode(action, namespaces_cpp, "namespaces.cpp"));
+  const closure::SymbolsMapType &symbols = graph.getSymbols();
+  ASSERT_EQ(2u, symbols.size());
+  for (const auto &symbol : symbols) {
+    bool function = symbol.second.getExtentFlags()
+      & closure::SymbolNode::EF_FunctionDefinition;
+    bool namespaced = symbol.second.getExtentFlags()
+      & closure::SymbolNode::EF_InNamespace;
+    // The function depends on the structure in the namespace.
+    EXPECT_NE(function, namespaced);
+    EXPECT_EQ(function, symbol.second.getDependencyCount() == 1);
+  }
+}
+
+TEST(RelationGraphTest, Merge) {
+  llvm::sys::fs::UniqueID a(1, 1), b(1, 2), c(1, 3);
+
+  closure::RelationGraph first;
+  first.getFiles().insert(std::make_pair(a, closure::FileNode("a.c")));
+  first.getFiles().find(a)->second.appendInclusion(b);
+  first.getSymbols().insert(std::make_pair("f", closure::SymbolNode(a)));
+  first.getSymbols().find("f")->second.appendDependency("g");
+
+  closure::RelationGraph second;
+  second.getSystemHeadersInMainFiles().insert(c);
+  second.getFiles().insert(std::make_pair(a, closure::FileNode("a.c")));
+  second.getFiles().find(a)->second.appendInclusion(b);
+  second.getFiles().find(a)->second.appendInclusion(c);
+  second.getSymbols().insert(std::make_pair("f", closure::SymbolNode(a)));
+  second.getSymbols().find("f")->second.appendDependency("g");
+  second.getSymbols().find("f")->second.appendDependency("h");
+
+  closure::RelationGraph merged;
+  merged.merge(first);
+  merged.merge(second);
+
+  EXPECT_EQ(1u, merged.getSystemHeadersInMainFiles().size());
+  ASSERT_EQ(1u, merged.getFiles().size());
+  const closure::FileNode &file = merged.getFiles().find(a)->second;
+  ASSERT_EQ(2u, file.getInclusionsCount());
+  EXPECT_TRUE(file.getInclusion(0) == b);
+  EXPECT_TRUE(file.getInclusion(1) == c);
+
+  ASSERT_EQ(1u, merged.getSymbols().size());
+  const closure::SymbolNode &symbol = merged.getSymbols().find("f")->second;
+  ASSERT_EQ(2u, symbol.getDependencyCount());
+  EXPECT_EQ("g", symbol.getDependency(0));
+  EXPECT_EQ("h", symbol.getDependency(1));
+}
+
+TEST(RelationGraphTest, StringPool) {
+  closure::StringPool pool;
+  StringRef scoped;
+  {
+    closure::StringPoolScope scope(&pool);
+    scoped = closure::FileNode("pooled.c").getFileName();
+    // A null pool leaves the one in scope.
+    closure::StringPoolScope nullScope(nullptr);
+    EXPECT_EQ(scoped.data(), pool.intern("pooled.c").data());
+  }
+  EXPECT_NE(0u, pool.getSize());
+  EXPECT_EQ("pooled.c", scoped);
+  // Out of the scope, strings go to the pool of the process.
+  EXPECT_NE(scoped.data(), closure::InternString("pooled.c").data());
+}
+
 class InclusionTestAction : public ASTFrontendAction {
 public:
   std::unique_ptr<ASTConsumer> CreateASTConsumer(
@@ -0,0 +1,291 @@
+#include "RelationGraphBuilder.h"
+#include "RecordWriting.h"
+#include "SymbolPrescan.h"
+#include "clang/Tooling/JSONCompilationDatabase.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace clang;
+using namespace clang::tooling;
+
+static const std::pair<const char*, const char*> Sources[] = {
+  { "a.c", "int g(void);\nint f(void) { return g(); }\n" },
+  { "b.c", "int h(void);\nint g(void) { return h(); }\n" },
+  { "c.c", "int h(void);\nint u(void) { return h(); }\n" },
+  { "d.c", "int h(void) { return 0; }\n" },
+};
+
+class RelationGraphBuilderTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("clang-closure-test",
+      mDirectory));
+    for (const auto &source : Sources)
+      mSources.push_back(writeFile(source.first, source.second));
+  }
+
+  // Writes a file to the directory, to be removed along with the sources.
+  std::string writeFile(StringRef name, StringRef content) {
+    llvm::SmallString<128> path(mDirectory);
+    llvm::sys::path::append(path, name);
+    std::error_code ec;
+    llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::F_Text);
+    os << content;
+    mFiles.push_back(path.str());
+    return path.str();
+  }
+
+  void TearDown() override {
+    for (const std::string &file : mFiles)
+      llvm::sys::fs::remove(file);
+    llvm::sys::fs::remove(mDirectory);
+  }
+
+  llvm::SmallString<128> mDirectory;
+  std::vector<std::string> mSources;
+  std::vector<std::string> mFiles;
+};
+
+TEST_F(RelationGraphBuilderTest, ClosureRoots) {
+  FixedCompilationDatabase compilations(mDirectory,
+    std::vector<std::string>());
+  closure::ClosureRoots roots;
+  roots.Signatures.push_back("f");
+
+  closure::RelationGraph graph;
+  closure::RelationGraphBuilder builder(compilations, 2);
+  builder.setClosureRoots(&roots);
+  EXPECT_TRUE(builder.build(mSources, graph));
+
+  // Every TU is parsed, but only reached bodies are.
+  const closure::SymbolsMapType &symbols = graph.getSymbols();
+  ASSERT_EQ(4u, symbols.size());
+  EXPECT_EQ(1u, symbols.find("f")->second.getDependencyCount());
+  EXPECT_EQ(1u, symbols.find("g")->second.getDependencyCount());
+  EXPECT_EQ(0u, symbols.find("u")->second.getDependencyCount());
+}
+
+TEST_F(RelationGraphBuilderTest, ClosureRootsRecords) {
+  writeFile("r.h", "int g(void);\n");
+  std::vector<std::string> sources;
+  sources.push_back(writeFile("x.c",
+    "#include \"r.h\"\nint f(void) { return g(); }\n"));
+  sources.push_back(writeFile("y.c",
+    "#include \"r.h\"\nint g(void) { return 0; }\n"));
+  FixedCompilationDatabase compilations(mDirectory,
+    std::vector<std::string>());
+  closure::ClosureRoots roots;
+  roots.Signatures.push_back("f");
+
+  std::string records;
+  closure::RelationGraph graph;
+  {
+    llvm::raw_string_ostream os(records);
+    closure::RecordWriter writer(os);
+    closure::RelationGraphBuilder builder(compilations, 2);
+    builder.setClosureRoots(&roots);
+    builder.setRecordWriter(&writer);
+    EXPECT_TRUE(builder.build(sources, graph));
+  }
+
+  // The reparses for the bodies of f and g write the dependency of f alone,
+  // not the inclusions again.
+  auto count = [&](StringRef kind) {
+    std::string key = "\"kind\": \"" + kind.str() + "\"";
+    size_t r = 0;
+    for (size_t pos = records.find(key); pos != std::string::npos;
+      pos = records.find(key, pos + 1))
+      ++r;
+    return r;
+  };
+  EXPECT_EQ(2u, count("inclusion"));
+  EXPECT_EQ(1u, count("dependency"));
+}
+
+TEST_F(RelationGraphBuilderTest, DemandDriven) {
+  FixedCompilationDatabase compilations(mDirectory,
+    std::vector<std::string>());
+  closure::SymbolPrescanner prescanner;
+  ASSERT_TRUE(prescanner.addFiles(mSources, 1));
+  closure::ClosureRoots roots;
+  roots.Signatures.push_back("f");
+
+  closure::RelationGraph graph;
+  closure::RelationGraphBuilder builder(compilations, 1);
+  builder.setClosureRoots(&roots);
+  builder.setPrescanner(&prescanner);
+  EXPECT_TRUE(builder.build(mSources, graph));
+
+  // c.c defines nothing the closure of f reaches, so it is not parsed.
+  const closure::SymbolsMapType &symbols = graph.getSymbols();
+  EXPECT_EQ(3u, symbols.size());
+  EXPECT_TRUE(symbols.count("h"));
+  EXPECT_FALSE(symbols.count("u"));
+  EXPECT_EQ("g", symbols.find("f")->second.getDependency(0));
+}
+
+TEST_F(RelationGraphBuilderTest, RelativePaths) {
+  // The command names the source and the search path relative to its
+  // directory, which is not the working directory of the process.
+  std::string json = "[{\"directory\": \"" + mDirectory.str().str()
+    + "\", \"command\": \"cc -I. -c a.c\", \"file\": \"a.c\"}]";
+  std::string error;
+  std::unique_ptr<JSONCompilationDatabase> compilations
+    = JSONCompilationDatabase::loadFromBuffer(json, error);
+  ASSERT_TRUE(compilations.get() != nullptr) << error;
+
+  closure::RelationGraph graph;
+  closure::RelationGraphBuilder builder(*compilations, 1);
+  EXPECT_TRUE(builder.build(std::vector<std::string>(1, mSources[0]), graph));
+  EXPECT_TRUE(graph.getSymbols().count("f"));
+}
+
+TEST_F(RelationGraphBuilderTest, KnownHeadersPerConfiguration) {
+  writeFile("first.h", "");
+  writeFile("second.h", "");
+  std::string config = writeFile("config.h",
+    "#ifdef FIRST\n#include \"first.h\"\n#else\n#include \"second.h\"\n"
+    "#endif\n");
+  std::vector<std::string> sources;
+  sources.push_back(writeFile("x.c", "#include \"config.h\"\n"));
+  sources.push_back(writeFile("y.c", "#include \"config.h\"\n"));
+  sources.push_back(writeFile("z.c", "#include \"config.h\"\n"));
+  // x.c and z.c are configured alike, so only one of them records config.h.
+  auto entry = [&](StringRef command, StringRef file) {
+    return "{\"directory\": \"" + mDirectory.str().str()
+      + "\", \"command\": \"" + command.str() + "\", \"file\": \""
+      + file.str() + "\"}";
+  };
+  std::string json = "[" + entry("cc -DFIRST -c x.c", "x.c") + ", "
+    + entry("cc -c y.c", "y.c") + ", "
+    + entry("cc -DFIRST -c z.c", "z.c") + "]";
+  std::string error;
+  std::unique_ptr<JSONCompilationDatabase> compilations
+    = JSONCompilationDatabase::loadFromBuffer(json, error);
+  ASSERT_TRUE(compilations.get() != nullptr) << error;
+
+  closure::RelationGraph graph;
+  closure::RelationGraphBuilder builder(*compilations, 3);
+  EXPECT_TRUE(builder.build(sources, graph));
+  llvm::sys::fs::UniqueID key;
+  ASSERT_FALSE(llvm::sys::fs::getUniqueID(config, key));
+  auto iter = graph.getFiles().find(key);
+  ASSERT_TRUE(iter != graph.getFiles().end());
+  EXPECT_EQ(2u, iter->second.getInclusionsCount());
+}
+
+TEST_F(RelationGraphBuilderTest, DemandDrivenVariables) {
+  std::vector<std::string> sources;
+  sources.push_back(writeFile("user.c",
+    "extern int counter;\nint use(void) { return counter; }\n"));
+  sources.push_back(writeFile("counter.c", "int counter = 1;\n"));
+  FixedCompilationDatabase compilations(mDirectory,
+    std::vector<std::string>());
+  closure::SymbolPrescanner prescanner;
+  ASSERT_TRUE(prescanner.addFiles(sources, 1));
+  closure::ClosureRoots roots;
+  roots.Signatures.push_back("use");
+
+  closure::RelationGraph graph;
+  closure::RelationGraphBuilder builder(compilations, 1);
+  builder.setClosureRoots(&roots);
+  builder.setPrescanner(&prescanner);
+  EXPECT_TRUE(builder.build(sources, graph));
+
+  // The variable is found in the TU which defines it.
+  const closure::SymbolsMapType &symbols = graph.getSymbols();
+  auto counter = symbols.find("counter");
+  ASSERT_TRUE(counter != symbols.end());
+  llvm::sys::fs::UniqueID counterFile;
+  ASSERT_FALSE(llvm::sys::fs::getUniqueID(sources[1], counterFile));
+  EXPECT_TRUE(counter->second.getDefinitionFile() == counterFile);
+}
+
+TEST_F(RelationGraphBuilderTest, LocatingFiles) {
+  FixedCompilationDatabase compilations(mDirectory,
+    std::vector<std::string>());
+  closure::SymbolPrescanner prescanner;
+  ASSERT_TRUE(prescanner.addFiles(mSources, 1));
+  closure::ClosureRoots roots;
+  roots.IncludeLocatedSymbol = true;
+
+  // u is in the second of the files, whose TUs are searched in parallel.
+  std::vector<std::string> files;
+  files.push_back(mSources[0]);
+  files.push_back(mSources[2]);
+  closure::SymbolSelector selector(closure::SymbolSelector::ByName, "u");
+  std::string signature;
+  closure::RelationGraph graph;
+  closure::RelationGraphBuilder builder(compilations, 2);
+  builder.setClosureRoots(&roots);
+  builder.setPrescanner(&prescanner);
+  builder.setSymbolLocating(files, selector, signature);
+  EXPECT_TRUE(builder.build(mSources, graph));
+
+  EXPECT_EQ("u", signature);
+  const closure::SymbolsMapType &symbols = graph.getSymbols();
+  auto u = symbols.find("u");
+  ASSERT_TRUE(u != symbols.end());
+  EXPECT_EQ(1u, u->second.getDependencyCount());
+  EXPECT_TRUE(symbols.count("h"));
+}
+
+TEST(RelationGraphBuilderInclusionsTest, KnownHeaders) {
+  llvm::SmallString<128> directory;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("clang-closure-test",
+    directory));
+  // common.h includes leaf.h twice and is included by both sources.
+  const std::pair<const char*, const char*> files[] = {
+    { "leaf.h", "" },
+    { "common.h", "#include \"leaf.h\"\n#include \"leaf.h\"\n" },
+    { "x.c", "#include \"common.h\"\n" },
+    { "y.c", "#include \"common.h\"\n" },
+  };
+  std::vector<std::string> paths, sources;
+  for (const auto &file : files) {
+    llvm::SmallString<128> path(directory);
+    llvm::sys::path::append(path, file.first);
+    std::error_code ec;
+    llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::F_Text);
+    os << file.second;
+    paths.push_back(path.str());
+  }
+  sources.push_back(paths[2]);
+  sources.push_back(paths[3]);
+
+  FixedCompilationDatabase compilations(directory,
+    std::vector<std::string>());
+  std::string records;
+  closure::RelationGraph graph;
+  {
+    llvm::raw_string_ostream os(records);
+    closure::RecordWriter writer(os);
+    closure::RelationGraphBuilder builder(compilations, 1);
+    builder.setRecordWriter(&writer);
+    EXPECT_TRUE(builder.build(sources, graph));
+  }
+  llvm::sys::fs::UniqueID common;
+  bool statFailed = llvm::sys::fs::getUniqueID(paths[1], common);
+  for (const std::string &path : paths)
+    llvm::sys::fs::remove(path);
+  llvm::sys::fs::remove(directory);
+
+  // The edge to leaf.h is kept once, and the second TU does not record it
+  // again.
+  ASSERT_FALSE(statFailed);
+  auto iter = graph.getFiles().find(common);
+  ASSERT_TRUE(iter != graph.getFiles().end());
+  EXPECT_EQ(1u, iter->second.getInclusionsCount());
+  size_t inclusions = 0;
+  for (size_t pos = records.find("\"inclusion\""); pos != std::string::npos;
+    pos = records.find("\"inclusion\"", pos + 1))
+    ++inclusions;
+  EXPECT_EQ(3u, inclusions);
+}
@@ -0,0 +1,136 @@
+#include "RelationIndex.h"
+#include "TestFiles.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "gtest/gtest.h"
+#include <cstring>
+#include <string>
+
+using namespace clang;
+
+TEST(RelationIndexTest, Freeze) {
+  llvm::sys::fs::UniqueID main(1, 1), header(1, 2), system(1, 3);
+
+  closure::RelationGraph graph;
+  graph.getSystemHeadersInMainFiles().insert(system);
+  graph.getFiles().insert(std::make_pair(main, closure::FileNode("main.c")));
+  graph.getFiles().insert(std::make_pair(header, closure::FileNode("a.h")));
+  graph.getFiles().find(main)->second.appendInclusion(header);
+  graph.getFiles().find(main)->second.appendInclusion(system);
+  graph.getSymbols().insert(std::make_pair("main",
+    closure::SymbolNode(main)));
+  graph.getSymbols().find("main")->second.appendDependency("function");
+  graph.getSymbols().find("main")->second.appendDependency("abort");
+
+  closure::RelationIndex index(graph);
+
+  ASSERT_EQ(3u, index.getFilesCount());
+  closure::FileIndexType mainIndex = index.findFile(main);
+  closure::FileIndexType headerIndex = index.findFile(header);
+  closure::FileIndexType systemIndex = index.findFile(system);
+  ASSERT_NE(closure::RelationIndex::InvalidIndex, mainIndex);
+  EXPECT_EQ("main.c", index.getFileName(mainIndex));
+  EXPECT_EQ("", index.getFileName(systemIndex));
+  EXPECT_TRUE(index.isSystemHeaderInMainFile(systemIndex));
+  EXPECT_FALSE(index.isSystemHeaderInMainFile(headerIndex));
+  ASSERT_EQ(2u, index.getInclusions(mainIndex).size());
+  EXPECT_EQ(headerIndex, index.getInclusions(mainIndex)[0]);
+  EXPECT_EQ(systemIndex, index.getInclusions(mainIndex)[1]);
+  EXPECT_EQ(0u, index.getInclusions(headerIndex).size());
+
+  ASSERT_EQ(3u, index.getSymbolsCount());
+  closure::SymbolIndexType mainSymbol = index.findSymbol("main");
+  closure::SymbolIndexType functionSymbol = index.findSymbol("function");
+  closure::SymbolIndexType abortSymbol = index.findSymbol("abort");
+  ASSERT_NE(closure::RelationIndex::InvalidIndex, mainSymbol);
+  EXPECT_EQ(closure::RelationIndex::InvalidIndex, index.findSymbol("exit"));
+  EXPECT_EQ(mainIndex, index.getDefinitionFile(mainSymbol));
+  EXPECT_EQ(closure::RelationIndex::InvalidIndex,
+    index.getDefinitionFile(functionSymbol));
+  EXPECT_EQ(index.getExtentBegin(functionSymbol),
+    index.getExtentEnd(functionSymbol));
+  ASSERT_EQ(2u, index.getDependencies(mainSymbol).size());
+  EXPECT_EQ(functionSymbol, index.getDependencies(mainSymbol)[0]);
+  EXPECT_EQ(abortSymbol, index.getDependencies(mainSymbol)[1]);
+}
+
+TEST(RelationIndexTest, WriteAndLoad) {
+  llvm::sys::fs::UniqueID main(1, 1), header(1, 2);
+
+  closure::RelationGraph graph;
+  graph.getFiles().insert(std::make_pair(main, closure::FileNode("main.c")));
+  graph.getFiles().insert(std::make_pair(header, closure::FileNode("a.h")));
+  graph.getFiles().find(main)->second.appendInclusion(header);
+  graph.getSymbols().insert(std::make_pair("main",
+    closure::SymbolNode(main)));
+  graph.getSymbols().find("main")->second.appendDependency("function");
+  graph.getSymbols().find("main")->second.setExtent(4, 40,
+    closure::SymbolNode::EF_FunctionDefinition);
+
+  llvm::SmallString<128> path;
+  ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("clang-closure-test",
+    "index", path));
+  ASSERT_TRUE(closure::RelationIndex(graph).write(path));
+
+  std::string error;
+  std::unique_ptr<closure::RelationIndex> index
+    = closure::RelationIndex::load(path, error);
+  llvm::sys::fs::remove(path);
+  ASSERT_TRUE(index != nullptr) << error;
+
+  ASSERT_EQ(2u, index->getFilesCount());
+  closure::FileIndexType mainIndex = index->findFile(main);
+  closure::FileIndexType headerIndex = index->findFile(header);
+  EXPECT_EQ("main.c", index->getFileName(mainIndex));
+  ASSERT_EQ(1u, index->getInclusions(mainIndex).size());
+  EXPECT_EQ(headerIndex, index->getInclusions(mainIndex)[0]);
+
+  closure::SymbolIndexType mainSymbol = index->findSymbol("main");
+  ASSERT_NE(closure::RelationIndex::InvalidIndex, mainSymbol);
+  EXPECT_EQ(mainIndex, index->getDefinitionFile(mainSymbol));
+  EXPECT_EQ(4u, index->getExtentBegin(mainSymbol));
+  EXPECT_EQ(40u, index->getExtentEnd(mainSymbol));
+  EXPECT_EQ(unsigned(closure::SymbolNode::EF_FunctionDefinition),
+    index->getExtentFlags(mainSymbol));
+  ASSERT_EQ(1u, index->getDependencies(mainSymbol).size());
+  EXPECT_EQ("function",
+    index->getSymbolName(index->getDependencies(mainSymbol)[0]));
+}
+
+TEST(RelationIndexTest, LoadRejectsOtherFiles) {
+  ExpectLoadRejects("index", "clang-closure-index 1\n",
+    [](StringRef path, std::string &error) {
+      return closure::RelationIndex::load(path, error) != nullptr;
+    });
+}
+
+TEST(RelationIndexTest, LoadRejectsCorruptedFiles) {
+  llvm::sys::fs::UniqueID main(1, 1), header(1, 2);
+  closure::RelationGraph graph;
+  graph.getFiles().insert(std::make_pair(main, closure::FileNode("main.c")));
+  graph.getFiles().find(main)->second.appendInclusion(header);
+
+  llvm::SmallString<128> path;
+  ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("clang-closure-test",
+    "index", path));
+  ASSERT_TRUE(closure::RelationIndex(graph).write(path));
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer
+    = llvm::MemoryBuffer::getFile(path);
+  llvm::sys::fs::remove(path);
+  ASSERT_TRUE(bool(buffer));
+  std::string content = (*buffer)->getBuffer();
+
+  auto load = [](StringRef path, std::string &error) {
+    return closure::RelationIndex::load(path, error) != nullptr;
+  };
+  ExpectLoadRejects("index", content.substr(0, content.size() - 8), load);
+  // With two files, the only inclusion follows the 40 bytes of the header
+  // and the devices, inodes, names and inclusion offsets of the files, each
+  // table aligned to 8 bytes. It now names a file the index does not have.
+  std::string corrupted = content;
+  uint32_t file = 7;
+  ASSERT_LE(100u, corrupted.size());
+  std::memcpy(&corrupted[96], &file, sizeof(file));
+  ExpectLoadRejects("index", corrupted, load);
+}
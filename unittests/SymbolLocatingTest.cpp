@@ -41,3 +41,45 @@ TEST(SymbolLocatingTest, Simple) {
   EXPECT_TRUE(runToolOnCode(action, simple_c, "simple.c"));
   EXPECT_TRUE(signature != "");
 }
+
+static const char *names_cpp = R"(
+int inc(int x) {
+  return x + 1;
+}
+
+namespace ns {
+int inc(int x) {
+  return x + 2;
+}
+}
+
+// Not reached once inc is found.
+int broken() {
+  return undeclared;
+}
+)";
+
+TEST(SymbolLocatingTest, ByName) {
+  std::string signature;
+  EXPECT_TRUE(runToolOnCode(new closure::SymbolLocatingAction(signature,
+    closure::SymbolSelector(closure::SymbolSelector::ByName, "inc")),
+    names_cpp, "names.cpp"));
+  EXPECT_EQ("_Z3inci", signature);
+
+  signature.clear();
+  EXPECT_TRUE(runToolOnCode(new closure::SymbolLocatingAction(signature,
+    closure::SymbolSelector(closure::SymbolSelector::ByName, "ns::inc")),
+    names_cpp, "names.cpp"));
+  EXPECT_EQ("_ZN2ns3incEi", signature);
+}
+
+TEST(SymbolLocatingTest, ByUSR) {
+  std::string signature;
+  EXPECT_TRUE(runToolOnCode(new closure::SymbolLocatingAction(signature,
+    closure::SymbolSelector(closure::SymbolSelector::ByUSR, "c:@F@inc#I#")),
+    names_cpp, "names.cpp"));
+  EXPECT_EQ("_Z3inci", signature);
+
+  EXPECT_EQ("inc", closure::SymbolSelector(closure::SymbolSelector::ByUSR,
+    "c:@N@ns@F@inc#I#").getIdentifier());
+}
@@ -0,0 +1,60 @@
+#include "SymbolMangling.h"
+#include "clang/AST/AST.h"
+#include "clang/Frontend/ASTUnit.h"
+#include "clang/Tooling/Tooling.h"
+#include "gtest/gtest.h"
+#include <vector>
+
+using namespace clang;
+using namespace clang::tooling;
+
+static const char *redeclarations_c = R"(
+int inc(int x);
+
+int inc(int x) {
+  return x + 1;
+}
+
+struct MyStruct {
+  int value;
+};
+)";
+
+TEST(SymbolManglingTest, MangledOnce) {
+  std::unique_ptr<ASTUnit> ast = buildASTFromCode(redeclarations_c,
+    "redeclarations.c");
+  ASSERT_TRUE(ast.get() != nullptr);
+
+  std::vector<const FunctionDecl*> functions;
+  const RecordDecl *record = nullptr;
+  for (const Decl *d : ast->getASTContext().getTranslationUnitDecl()->decls()) {
+    if (const FunctionDecl *fd = dyn_cast<FunctionDecl>(d))
+      functions.push_back(fd);
+    else if (const RecordDecl *rd = dyn_cast<RecordDecl>(d))
+      record = rd;
+  }
+  ASSERT_EQ(2u, functions.size());
+  ASSERT_TRUE(record != nullptr);
+
+  closure::SymbolMangler mangler;
+  mangler.setASTContext(ast->getASTContext());
+  StringRef first = mangler.getSignature(functions[0]);
+  StringRef second = mangler.getSignature(functions[1]);
+  EXPECT_EQ("inc", first);
+  EXPECT_EQ(first.data(), second.data());
+  EXPECT_FALSE(mangler.getSignature(record).empty());
+}
+
+TEST(SymbolManglingTest, CXXNames) {
+  std::unique_ptr<ASTUnit> ast = buildASTFromCode("int inc(int x);\n",
+    "inc.cpp");
+  ASSERT_TRUE(ast.get() != nullptr);
+  const FunctionDecl *inc = nullptr;
+  for (const Decl *d : ast->getASTContext().getTranslationUnitDecl()->decls())
+    inc = inc ? inc : dyn_cast<FunctionDecl>(d);
+  ASSERT_TRUE(inc != nullptr);
+
+  closure::SymbolMangler mangler;
+  mangler.setASTContext(ast->getASTContext());
+  EXPECT_EQ("_Z3inci", mangler.getSignature(inc));
+}
@@ -0,0 +1,92 @@
+#include "SymbolPrescan.h"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+using namespace clang;
+
+static const char *definitions_cpp = R"(
+#include "a.h"
+#define DECLARE(x) int x(void);
+
+DECLARE(declared)
+static int helper(int x) {
+  return x;
+}
+
+int prototype(void);
+int (*pointer)(int) = 0;
+
+namespace ns {
+struct Base {
+  int member() { return 0; }
+};
+
+struct Derived final : public Base {
+};
+}
+
+extern "C" {
+__attribute__((noinline)) struct Base *make(void) {
+  return 0;
+}
+}
+
+A::A() : mValue(helper(1)) {
+}
+)";
+
+TEST(SymbolPrescanTest, Definitions) {
+  std::vector<std::string> identifiers;
+  closure::ScanDefinitions(definitions_cpp, identifiers);
+  std::vector<std::string> expected = {
+    "DECLARE", "helper", "Base", "Derived", "make", "A"
+  };
+  EXPECT_EQ(expected, identifiers);
+}
+
+static const char *objects_c = R"(
+extern int declared;
+int counter = 1, table[SIZE] = { 2, 3 }, last;
+typedef struct point { int x, y; } point_t;
+struct point origin;
+enum color { RED, GREEN = (1 << 2), BLUE };
+int apply(int (*f)(int), int x);
+)";
+
+TEST(SymbolPrescanTest, Objects) {
+  std::vector<std::string> identifiers;
+  closure::ScanDefinitions(objects_c, identifiers);
+  std::vector<std::string> expected = {
+    "counter", "table", "last", "point", "point_t", "origin", "color", "RED",
+    "GREEN", "BLUE"
+  };
+  EXPECT_EQ(expected, identifiers);
+}
+
+TEST(SymbolPrescanTest, SignatureIdentifiers) {
+  EXPECT_EQ("f", closure::GetSignatureIdentifier("f"));
+  EXPECT_EQ("f", closure::GetSignatureIdentifier("_Z1fv"));
+  EXPECT_EQ("helper", closure::GetSignatureIdentifier("_ZL6helperi"));
+  EXPECT_EQ("get", closure::GetSignatureIdentifier("_ZNK2ns4Base3getEv"));
+  EXPECT_EQ("push_back",
+    closure::GetSignatureIdentifier("_ZNSt6vectorIiSaIiEE9push_backEOi"));
+  EXPECT_EQ("Base", closure::GetSignatureIdentifier("_ZN2ns4BaseC1Ev"));
+  EXPECT_EQ("point", closure::GetSignatureIdentifier("_ZTS5point"));
+  EXPECT_EQ("point", closure::GetSignatureIdentifier("c:@S@point"));
+  EXPECT_EQ("SCALE", closure::GetSignatureIdentifier("c:@macro@SCALE"));
+  // Operators have no identifier to look for.
+  EXPECT_EQ("", closure::GetSignatureIdentifier("_ZN2ns4BaseplERKS0_"));
+  EXPECT_EQ("", closure::GetSignatureIdentifier("_ZTV4Base"));
+}
+
+TEST(SymbolPrescanTest, Files) {
+  closure::SymbolPrescanner prescanner;
+  prescanner.addBuffer("a.c", "int f(void) { return 0; }");
+  prescanner.addBuffer("b.c", "int f(void); int g(void) { return f(); }");
+  prescanner.addBuffer("c.c", "static int f(void) { return 1; }");
+
+  std::vector<std::string> expected = { "a.c", "c.c" };
+  EXPECT_EQ(expected, prescanner.getFiles("f"));
+  EXPECT_TRUE(prescanner.getFiles("h").empty());
+}
@@ -3,6 +3,7 @@
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Tooling/Tooling.h"
 #include "gtest/gtest.h"
+#include <string>
 
 using namespace clang;
 using namespace clang::tooling;
@@ -57,5 +58,38 @@ TEST(SymbolListingTest, StructTypedef) {
   bool r = runToolOnCode(action, structtypedef_c, "structtypedef.c");
   EXPECT_TRUE(r);
   EXPECT_EQ(1, symbols.getCount());
+  EXPECT_EQ(closure::SK_Record, symbols.getKind(0));
   EXPECT_TRUE(symbols.getType(0) == "record");
 }
+
+static const char *local_c = R"(
+int f(void) {
+  struct Local {
+    int value;
+  } local = { 0 };
+  return local.value;
+}
+)";
+
+TEST(SymbolListingTest, LocalDeclarations) {
+  closure::SymbolsList symbols;
+  SymbolsListingTestAction *action = new SymbolsListingTestAction(symbols);
+  EXPECT_TRUE(runToolOnCode(action, local_c, "local.c"));
+  ASSERT_EQ(1u, symbols.getCount());
+  EXPECT_TRUE(symbols.getType(0) == "function");
+}
+
+TEST(SymbolListingTest, SharedSignatures) {
+  closure::SymbolsList first, second;
+  std::string signature = "f";
+  first.appendSymbol(closure::SK_Function, signature);
+  second.appendSymbol(closure::SK_Function, signature);
+  signature = "g";
+  EXPECT_TRUE(first.getSignature(0) == "f");
+  EXPECT_EQ(first.getSignature(0).data(), second.getSignature(0).data());
+
+  closure::SymbolKind kind;
+  EXPECT_TRUE(closure::ParseSymbolKind("record", kind));
+  EXPECT_EQ(closure::SK_Record, kind);
+  EXPECT_FALSE(closure::ParseSymbolKind("macro", kind));
+}
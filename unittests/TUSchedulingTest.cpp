@@ -0,0 +1,83 @@
+#include "TUScheduling.h"
+#include "TestFiles.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "gtest/gtest.h"
+#include <atomic>
+#include <string>
+#include <vector>
+
+using namespace clang;
+
+TEST(TUSchedulingTest, CostliestFirst) {
+  std::vector<double> costs = { 1, 5, 3, 5 };
+  std::vector<size_t> order;
+  closure::ForEachByCost(1, costs, [&](size_t i) { order.push_back(i); });
+  std::vector<size_t> expected = { 1, 3, 2, 0 };
+  EXPECT_EQ(expected, order);
+
+  std::vector<double> many(100);
+  for (size_t i = 0; i != many.size(); ++i)
+    many[i] = i % 7;
+  std::vector<std::atomic<int>> calls(many.size());
+  for (auto &count : calls)
+    count = 0;
+  closure::ForEachByCost(4, many, [&](size_t i) { ++calls[i]; });
+  for (auto &count : calls)
+    EXPECT_EQ(1, count);
+}
+
+TEST(TUSchedulingTest, PredictAndRecord) {
+  llvm::SmallString<128> directory;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("clang-closure-test",
+    directory));
+  llvm::SmallString<128> small(directory), large(directory),
+    known(directory), stats(directory);
+  llvm::sys::path::append(small, "small.c");
+  llvm::sys::path::append(large, "large.c");
+  llvm::sys::path::append(known, "known.c");
+  llvm::sys::path::append(stats, "tu.stats");
+  WriteFile(small, "int a;\n");
+  WriteFile(large, "#include \"a.h\"\n  # include <b.h>\nint b;\n");
+  WriteFile(known, "#include \"a.h\"\nint c;\n");
+  WriteFile(stats, "1000 " + known.str().str() + "\n");
+
+  std::string error;
+  closure::TUCostModel model;
+  EXPECT_TRUE(model.load(stats, error)) << error;
+  std::vector<std::string> sources = { small.str(), large.str(), known.str() };
+  std::vector<double> costs = model.getCosts(sources);
+  ASSERT_EQ(3u, costs.size());
+  EXPECT_EQ(1000, costs[2]);
+  // Scores are scaled to the time of the known TU, which has one inclusion.
+  EXPECT_GT(costs[1], costs[2]);
+  EXPECT_LT(costs[0], costs[2]);
+
+  model.record(small, std::chrono::milliseconds(3));
+  model.record(small, std::chrono::milliseconds(2));
+  EXPECT_TRUE(model.write(stats, error)) << error;
+
+  closure::TUCostModel reloaded;
+  EXPECT_TRUE(reloaded.load(stats, error)) << error;
+  costs = reloaded.getCosts(sources);
+  EXPECT_EQ(5000, costs[0]);
+  EXPECT_EQ(1000, costs[2]);
+
+  llvm::sys::fs::remove(small);
+  llvm::sys::fs::remove(large);
+  llvm::sys::fs::remove(known);
+  llvm::sys::fs::remove(stats);
+  llvm::sys::fs::remove(directory);
+}
+
+TEST(TUSchedulingTest, LoadRejectsOtherFiles) {
+  closure::TUCostModel model;
+  std::string missing = ExpectLoadRejects("stats", "clang-closure-graph 1\n",
+    [&](StringRef path, std::string &error) {
+      return model.load(path, error);
+    });
+  // A missing file is only a first run.
+  std::string error;
+  EXPECT_TRUE(model.load(missing, error));
+}
@@ -0,0 +1,44 @@
+#ifndef LLVM_CLANG_TOOLS_EXTRA_UNITTESTS_CLANG_CLOSURE_TEST_FILES_H
+#define LLVM_CLANG_TOOLS_EXTRA_UNITTESTS_CLANG_CLOSURE_TEST_FILES_H
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+#include <string>
+
+// Replaces the content of the file at path.
+inline void WriteFile(llvm::StringRef path, llvm::StringRef content) {
+  std::error_code ec;
+  llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::F_Text);
+  os << content;
+}
+
+// Checks that load fails, with an error, on a temporary file which holds
+// content, such as a file of another format. The file is removed again, and
+// its path returned.
+inline std::string ExpectLoadRejects(llvm::StringRef suffix,
+  llvm::StringRef content,
+  llvm::function_ref<bool(llvm::StringRef, std::string &)> load) {
+  llvm::SmallString<128> path;
+  int fd;
+  if (std::error_code ec = llvm::sys::fs::createTemporaryFile(
+    "clang-closure-test", suffix, fd, path)) {
+    ADD_FAILURE() << ec.message();
+    return std::string();
+  }
+  {
+    llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+    os << content;
+  }
+
+  std::string error;
+  EXPECT_FALSE(load(path, error));
+  EXPECT_FALSE(error.empty());
+  llvm::sys::fs::remove(path);
+  return path.str();
+}
+
+#endif
@@ -0,0 +1,38 @@
+#include "TimeTracing.h"
+#include "gtest/gtest.h"
+#include <string>
+
+using namespace clang;
+
+TEST(TimeTracingTest, Scopes) {
+  // Nothing is recorded without a tracer.
+  { closure::TimeTraceScope scope("Ignored"); }
+
+  closure::TimeTracer tracer;
+  closure::TimeTracer::setInstance(&tracer);
+  {
+    // Totals reach the tracer once, when the TU is done with them.
+    closure::TimeTotals totals;
+    closure::TimeTraceScope scope("TranslationUnit", "a.c");
+    { closure::TimeTotalScope total("Visitor", totals); }
+    { closure::TimeTotalScope total("Visitor", totals); }
+  }
+  closure::TimeTracer::setInstance(nullptr);
+
+  std::string trace;
+  llvm::raw_string_ostream traceStream(trace);
+  tracer.writeTrace(traceStream);
+  traceStream.flush();
+  EXPECT_NE(std::string::npos, trace.find("\"name\": \"TranslationUnit\""));
+  EXPECT_NE(std::string::npos, trace.find("\"detail\": \"a.c\""));
+  // Totals only count towards the report.
+  EXPECT_EQ(std::string::npos, trace.find("Visitor"));
+  EXPECT_EQ(std::string::npos, trace.find("Ignored"));
+
+  std::string report;
+  llvm::raw_string_ostream reportStream(report);
+  tracer.printReport(reportStream);
+  reportStream.flush();
+  EXPECT_NE(std::string::npos, report.find("2  Visitor"));
+  EXPECT_NE(std::string::npos, report.find("1  TranslationUnit"));
+}